@@ -0,0 +1,243 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Rendering benchmarks.
+-------------------------------------------------------------*/
+
+#include "Benchmark.h"
+#include "SceneLibrary.h"
+#include "ThreadPool.h"
+#include "TriangleBlock.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+// scenes left out of the default set.  'Test' only pads out the scene list, and the dragon scenes need dragon.ply,
+// which is not included with the source.
+static const char* SKIPPED_SCENES[] = {"Test", "Dragon", "ManyDragons"};
+
+/** Returns the memory the process is using now (its resident set), in megabytes. */
+static float getResidentMemory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.WorkingSetSize / (1024.0f * 1024.0f);
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size / (1024.0f * 1024.0f);
+#else
+    // the second field of statm is the resident set, in pages.
+    long pages = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    if (fscanf(file, "%*s %ld", &pages) != 1) pages = 0;
+    fclose(file);
+    return pages * (float)sysconf(_SC_PAGESIZE) / (1024.0f * 1024.0f);
+#endif
+}
+
+static float secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+void setupBenchmarkJob(RenderJob& job)
+{
+    // small and quick enough to run after every change, but with enough samples that the time is spent tracing
+    // rather than in per pass overheads.
+    job = RenderJob();
+    job.output = "benchmark.tga";
+    job.width = 256;
+    job.height = 192;
+    job.passes = 2;
+    job.samples = 8;
+    job.checkpointInterval = 0;
+}
+
+std::vector<std::string> getBenchmarkScenes()
+{
+    std::vector<std::string> scenes;
+    for (int i = 0; i < getSceneCount(); i++) {
+        bool skip = false;
+        for (int j = 0; j < (int)(sizeof(SKIPPED_SCENES) / sizeof(SKIPPED_SCENES[0])); j++) {
+            skip |= getSceneName(i) == SKIPPED_SCENES[j];
+        }
+        if (!skip) scenes.push_back(getSceneName(i));
+    }
+    return scenes;
+}
+
+bool runBenchmark(std::vector<std::string>& scenes, RenderJob& job, std::vector<BenchmarkResult>& results)
+{
+    // each scene is kept until they have all been benchmarked.  Memory a deleted scene freed would be reused by the
+    // next one, hiding part of what that scene adds, whereas with nothing freed between scenes the memory a scene
+    // adds is its own.
+    std::vector<Scene*> benchmarked;
+    bool succeeded = true;
+
+    for (int i = 0; i < (int)scenes.size(); i++) {
+        int sceneNumber = findScene(scenes[i]);
+        if (sceneNumber < 0) {
+            printf("Error, unknown scene %s.\n", scenes[i].c_str());
+            succeeded = false;
+            break;
+        }
+
+        BenchmarkResult result;
+        result.scene = getSceneName(sceneNumber);
+        printf("Benchmarking %s.\n", result.scene.c_str());
+
+        // the resident set is sampled after loading and after each pass, rather than taking the process's peak, so
+        // that earlier scenes do not count.  Brief peaks in between (such as BVH build or denoiser buffers) are missed.
+        float memoryBefore = getResidentMemory();
+        float memoryMost = memoryBefore;
+
+        auto loadStart = std::chrono::steady_clock::now();
+        Scene* scene = createScene(sceneNumber);
+        scene->load(job.acceleration);
+        result.loadTime = secondsSince(loadStart);
+        benchmarked.push_back(scene);
+        memoryMost = std::max(memoryMost, getResidentMemory());
+
+        RenderJob sceneJob = job;
+        sceneJob.scene = result.scene;
+        sceneJob.output = addFilenameSuffix(job.output, "_" + result.scene);
+
+        // only the passes themselves are timed, so writing the image does not count.
+        PassRenderer renderPass = [&](Scene* scene, Camera* camera) {
+            auto passStart = std::chrono::steady_clock::now();
+            camera->render(scene, -1, false);
+            result.renderTime += secondsSince(passStart);
+            result.pixels += camera->getNoisyPixels();
+            memoryMost = std::max(memoryMost, getResidentMemory());
+            return camera->getNoisyPixels();
+        };
+
+        resetRayStats();
+        result.passes = renderJob(scene, scene->camera, sceneJob, renderPass);
+        result.rays = getRayStats();
+        result.sampledMemoryGrowth = memoryMost - memoryBefore;
+
+        float raysPerSecond = result.renderTime > 0 ? result.rays.totalRays() / result.renderTime : 0;
+        printf("%s: loaded in %.2fs, rendered %d passes in %.2fs, %.2f million rays per second, grew by %.0fMB.\n",
+            result.scene.c_str(), result.loadTime, result.passes, result.renderTime, raysPerSecond / 1e6f,
+            result.sampledMemoryGrowth);
+
+        results.push_back(result);
+    }
+
+    for (int i = 0; i < (int)benchmarked.size(); i++) {
+        delete benchmarked[i];
+    }
+    return succeeded;
+}
+
+/** Writes a JSON string, escaping the characters that need it. */
+static void writeString(FILE* file, std::string s)
+{
+    fputc('"', file);
+    for (int i = 0; i < (int)s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') fputc('\\', file);
+        fputc(s[i], file);
+    }
+    fputc('"', file);
+}
+
+#ifdef RAY_STATS
+/** Writes counters as an object keyed by ray type, or as an array. */
+static void writeCounts(FILE* file, const char* name, const uint64_t* counts, int n, bool byType)
+{
+    fprintf(file, "      \"%s\": %s", name, byType ? "{" : "[");
+    for (int i = 0; i < n; i++) {
+        if (i > 0) fprintf(file, ", ");
+        if (byType) fprintf(file, "\"%s\": ", getRayTypeName(i));
+        fprintf(file, "%llu", (unsigned long long)counts[i]);
+    }
+    fprintf(file, "%s,\n", byType ? "}" : "]");
+}
+#endif
+
+bool writeBenchmarkJSON(std::string filename, RenderJob& job, std::vector<BenchmarkResult>& results)
+{
+    FILE* file = fopen(filename.c_str(), "w");
+    if (!file) {
+        printf("Error, can not write %s.\n", filename.c_str());
+        return false;
+    }
+
+    const char* samplerNames[] = {"random", "sobol", "bluenoise"};
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"width\": %d,\n", job.width);
+    fprintf(file, "  \"height\": %d,\n", job.height);
+    fprintf(file, "  \"passes\": %d,\n", job.passes);
+    fprintf(file, "  \"samples\": %d,\n", job.samples);
+    fprintf(file, "  \"sampler\": \"%s\",\n", samplerNames[job.samplerType]);
+    fprintf(file, "  \"lighting\": \"%s\",\n", job.lightingModel >= 0 ? getLightingModelName(job.lightingModel) : "scene");
+    fprintf(file, "  \"threads\": %d,\n", job.threads > 0 ? job.threads : ThreadPool::global().size());
+    fprintf(file, "  \"acceleration\": \"%s\",\n", getAccelerationName(job.acceleration));
+    fprintf(file, "  \"triangleKernel\": \"%s\",\n", getTriangleBlockKernel().name);
+#ifdef __VERSION__
+    fprintf(file, "  \"compiler\": ");
+    writeString(file, __VERSION__);
+    fprintf(file, ",\n");
+#endif
+    fprintf(file, "  \"scenes\": [\n");
+
+    for (int i = 0; i < (int)results.size(); i++) {
+        BenchmarkResult& result = results[i];
+        float seconds = result.renderTime > 0 ? result.renderTime : 1;
+
+        fprintf(file, "    {\n");
+        fprintf(file, "      \"scene\": ");
+        writeString(file, result.scene);
+        fprintf(file, ",\n");
+        fprintf(file, "      \"loadSeconds\": %.4f,\n", result.loadTime);
+        fprintf(file, "      \"renderSeconds\": %.4f,\n", result.renderTime);
+        fprintf(file, "      \"passes\": %d,\n", result.passes);
+        fprintf(file, "      \"pixels\": %lld,\n", result.pixels);
+        fprintf(file, "      \"pixelsPerSecond\": %.1f,\n", result.pixels / seconds);
+        fprintf(file, "      \"rays\": %llu,\n", (unsigned long long)result.rays.totalRays());
+        fprintf(file, "      \"raysPerSecond\": %.1f,\n", result.rays.totalRays() / seconds);
+        fprintf(file, "      \"raysByType\": {");
+        for (int type = 0; type < RT_COUNT; type++) {
+            fprintf(file, "%s\"%s\": %llu", type > 0 ? ", " : "", getRayTypeName(type), (unsigned long long)result.rays.rays[type]);
+        }
+        fprintf(file, "},\n");
+        fprintf(file, "      \"raysPerSecondByType\": {");
+        for (int type = 0; type < RT_COUNT; type++) {
+            fprintf(file, "%s\"%s\": %.1f", type > 0 ? ", " : "", getRayTypeName(type), result.rays.rays[type] / seconds);
+        }
+        fprintf(file, "},\n");
+#ifdef RAY_STATS
+        writeCounts(file, "hitsByType", result.rays.hits, RT_COUNT, true);
+        writeCounts(file, "boundsTestsByType", result.rays.boundsTests, RT_COUNT, true);
+        writeCounts(file, "primitiveTestsByType", result.rays.primitiveTests, RT_COUNT, true);
+        writeCounts(file, "raysByDepth", result.rays.depth, RAY_STATS_DEPTHS, false);
+#endif
+        fprintf(file, "      \"sampledMemoryGrowthMB\": %.1f\n", result.sampledMemoryGrowth);
+        fprintf(file, "    }%s\n", i + 1 < (int)results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    bool success = !ferror(file);
+    fclose(file);
+    if (!success) printf("Error, can not write %s.\n", filename.c_str());
+    return success;
+}
@@ -0,0 +1,48 @@
+/**
+ * Benchmarks.
+ *
+ * Renders a set of scenes with fixed settings and records how long each one takes, so that performance can be
+ * compared between builds.  The samplers are seeded from the pixel and sample number, so every run traces the same
+ * rays and the timings (and images) are directly comparable.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "RenderJob.h"
+#include "RayStats.h"
+
+struct BenchmarkResult
+{
+    std::string scene;
+
+    // wall clock seconds spent loading the scene, and rendering its passes (not including writing the image).
+    float loadTime = 0;
+    float renderTime = 0;
+
+    int passes = 0;
+
+    // pixels sampled, summed over all passes.
+    long long pixels = 0;
+
+    RayStats rays;
+
+    // how much the resident set grew while the scene loaded and rendered, in megabytes.  Sampled after loading and
+    // after each pass, so brief peaks in between are missed.
+    float sampledMemoryGrowth = 0;
+};
+
+/** Sets job to the benchmarks default settings. */
+void setupBenchmarkJob(RenderJob& job);
+
+/** Returns the scenes benchmarked when none are given. */
+std::vector<std::string> getBenchmarkScenes();
+
+/** Loads and renders each scene in turn with the settings from job, writing each image to a file named after job's
+ * output and the scene.  Returns false if a scene could not be found. */
+bool runBenchmark(std::vector<std::string>& scenes, RenderJob& job, std::vector<BenchmarkResult>& results);
+
+/** Writes the settings and results of a benchmark to a JSON file. */
+bool writeBenchmarkJSON(std::string filename, RenderJob& job, std::vector<BenchmarkResult>& results);
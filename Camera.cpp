@@ -1,5 +1,11 @@
 #include "Camera.h"
 #include "Scene.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <float.h>
 
 // a small offset is applied to reflected rays / shadow rays so they don't self interesect.
 const float OFFSET_BIAS = 0.001f;
@@ -8,11 +14,62 @@ Camera::Camera(glm::vec3 location) : SceneObject(location)
 {
 }
 
-void Camera::calculateLighting(RayIntersectionResult intersection, ContainerObject* scene, Light* light, Color& ambientLightSum, Color& diffuseLightSum, Color& specularLightSum)
+/** One of each sampler, so that a pixel can pick the cameras sampler type without allocating. */
+struct PixelSamplers
+{
+    RandomSampler randomSampler;
+    SobolSampler sobolSampler;
+    BlueNoiseSampler blueNoiseSampler;
+
+    Sampler* get(SamplerType samplerType)
+    {
+        switch (samplerType) {
+            case ST_SOBOL: return &sobolSampler;
+            case ST_BLUE_NOISE: return &blueNoiseSampler;
+            default: return &randomSampler;
+        }
+    }
+};
+
+/** Sorts items by the low bits of their keys with a radix sort, keeping items with equal keys in the order they were
+ * in.  scratch is used as working space. */
+static void sortByKey(std::vector<std::pair<uint64_t, int>>& items, std::vector<std::pair<uint64_t, int>>& scratch, int bits)
+{
+    const int DIGIT_BITS = 11;
+    const int DIGITS = 1 << DIGIT_BITS;
+    scratch.resize(items.size());
+    for (int shift = 0; shift < bits; shift += DIGIT_BITS) {
+        int counts[DIGITS + 1] = {};
+        for (int i = 0; i < (int)items.size(); i++) {
+            counts[((items[i].first >> shift) & (DIGITS - 1)) + 1]++;
+        }
+        for (int i = 0; i < DIGITS; i++) {
+            counts[i + 1] += counts[i];
+        }
+        for (int i = 0; i < (int)items.size(); i++) {
+            scratch[counts[(items[i].first >> shift) & (DIGITS - 1)]++] = items[i];
+        }
+        items.swap(scratch);
+    }
+}
+
+/** Creates a ray from point toward a light lightDistance away. */
+static Ray getShadowRay(glm::vec3 point, glm::vec3 lightVector, float lightDistance)
+{
+    // offsetting the shadow trace a little stops self shadowing artifacts
+    Ray shadowRay = Ray(point + lightVector * OFFSET_BIAS, lightVector);
+    shadowRay.length = lightDistance;
+    shadowRay.shadowTrace = true; // this will ignore objects that do not cast shadows.
+    shadowRay.type = RT_SHADOW;
+    return shadowRay;
+}
+
+void Camera::calculateLighting(RayIntersectionResult intersection, ContainerObject* scene, Light* light, Sampler& sampler, Color& ambientLightSum, Color& diffuseLightSum, Color& specularLightSum, const Ray* firstShadowRay)
 {
     Material* material = intersection.target->material;
 
-    glm::vec3 lightPos = light->sampleLocation();
+    glm::vec2 u = sampler.get2D();
+    glm::vec3 lightPos = light->sampleLocation(glm::vec3(u.x, u.y, sampler.get1D()));
 
     // diffuse light    
     glm::vec3 lightVector = glm::normalize(lightPos - intersection.location);    
@@ -47,16 +104,11 @@ void Camera::calculateLighting(RayIntersectionResult intersection, ContainerObje
 
         // handle transparient shadows by letting ray continue when meeting a transparient object
         for (int i = 0; i < 9; i++) {            
-            // offsetting the shadow trace a little stops self shadowing artifacts
-			
 			lightDistance = glm::length(lightPos - shadowTestPoint);
 
-			Ray shadowRay; 
-			shadowRay = Ray(shadowTestPoint + lightVector * OFFSET_BIAS, lightVector);
-			shadowRay.length = lightDistance;
-            shadowRay.shadowTrace=true; // this will ignore objects that do not cast shadows.
-
-            scene->intersect(&shadowRay);    
+            // the first shadow ray may have already been traced as part of a packet.
+			Ray shadowRay = (i == 0 && firstShadowRay) ? *firstShadowRay : getShadowRay(shadowTestPoint, lightVector, lightDistance);
+            castRay(scene, shadowRay);    
             
             if (shadowRay.collision.didCollide()) {
 
@@ -81,16 +133,108 @@ void Camera::calculateLighting(RayIntersectionResult intersection, ContainerObje
     specularLightSum += specularLight * light->color;
 }
 
-Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
+void Camera::applyNormalMap(RayIntersectionResult& intersection, Material* material)
+{
+    if (!material->normalTexture) return;
+
+    // we find the 3 vectors required to transform the normal map from object space to world space.
+    glm::vec3 materialNormal = glm::vec3(material->normalTexture->sampleNormalMap(intersection.uv) * 2.0f - 1.0f);
+
+    // soften the normal map a little
+    materialNormal = glm::normalize(materialNormal + 1.0f * glm::vec3(0,0,1));
+
+    glm::vec3 normal = intersection.normal;
+    glm::vec3 tangent = intersection.tangent;
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+
+    // update the intersection normal vector
+    intersection.normal = glm::vec3(
+        materialNormal.x*tangent + materialNormal.y*bitangent + materialNormal.z*normal             
+    );
+}
+
+bool Camera::getRefractedRay(Ray ray, Material* material, Ray& exitRay)
+{
+    glm::vec3 refractedDir = glm::refract(ray.dir, ray.collision.normal, 1.0f/material->refractionIndex);
+
+    Ray refractedRay = Ray(ray.collision.location + refractedDir * 0.001f , refractedDir);
+    refractedRay.type = RT_REFRACTION;
+    
+    // the refracted ray will exit the object at this location, don't trace against entire scene, just trace against the 
+    // specific object (faster, and less prone to error).
+    castRay(ray.collision.target, refractedRay);
+    RayIntersectionResult exitPoint = refractedRay.collision;
+
+    if (!exitPoint.didCollide()) return false;
+
+    glm::vec3 exitDir = glm::refract(refractedDir, -exitPoint.normal, material->refractionIndex);
+    exitRay = Ray(exitPoint.location + exitDir * 0.001f, exitDir);
+    exitRay.type = RT_REFRACTION;
+    return true;
+}
+
+Color Camera::sampleEmissiveLights(RayIntersectionResult intersection, Scene* scene, Sampler& sampler)
+{
+    glm::vec3 irradiance = glm::vec3(0,0,0);
+
+    if (EMISSIVE_LIGHT_SAMPLES <= 0) return Color(irradiance, 1);
+
+    for (int i = 0; i < EMISSIVE_LIGHT_SAMPLES; i++) {
+
+        float pmf;
+        EmissiveLight* light = scene->emissiveLights.sample(intersection.location, sampler.get1D(), pmf);
+        if (light == NULL) break;
+        if (pmf <= 0) continue;
+
+        // pick a direction within the cone covering the lights bounding sphere.  If we are inside the sphere the light
+        // could be in any direction so just sample the hemisphere.
+        glm::vec3 toLight = light->location - intersection.location;
+        float distance2 = glm::length2(toLight);
+        float radius2 = light->radius * light->radius;
+
+        glm::vec2 u = sampler.get2D();
+        glm::vec3 dir;
+        float pdf;
+        if (distance2 <= radius2) {
+            dir = sampleHemisphereCosine(intersection.normal, u.x, u.y);
+            pdf = maxf(glm::dot(dir, intersection.normal), EPSILON) / PI;
+        } else {
+            float cosThetaMax = sqrt(1.0f - radius2 / distance2);
+            float solidAngle = 2 * PI * (1.0f - cosThetaMax);
+            if (solidAngle <= 0) continue;
+            dir = sampleCone(toLight / sqrt(distance2), cosThetaMax, u.x, u.y);
+            pdf = 1.0f / solidAngle;
+        }
+
+        float cosTheta = glm::dot(dir, intersection.normal);
+        if (cosTheta <= 0) continue;
+
+        // the light only counts if the first thing we hit is the light itself.
+        Ray lightRay = Ray(intersection.location + dir * OFFSET_BIAS, dir);
+        lightRay.type = RT_SHADOW;
+        castRay(scene, lightRay);
+        if (lightRay.collision.target != light->object) continue;
+
+        irradiance += glm::vec3(light->color) * (cosTheta / (pdf * pmf));
+    }
+
+    return Color(irradiance / (float)EMISSIVE_LIGHT_SAMPLES, 1);
+}
+
+Color Camera::trace(Ray ray, Scene* scene, Sampler& sampler, int depth, int giSamples, const Ray* firstShadowRays)
 {        
     if (depth > MAX_RECUSION_DEPTH) {
-        lastTraceIntersection = RayIntersectionResult::NoCollision();
         return Color(0,0,0,1);
     }
 
-    bool didCollide = scene->intersect(&ray);
-    
-    lastTraceIntersection = ray.collision;
+    RAY_STAT(depth, depth < RAY_STATS_DEPTHS ? depth : RAY_STATS_DEPTHS - 1);
+
+    // the cost heatmap traces its own rays so that their tests can be counted.
+    if (lightingModel == LM_COST) {
+        return getCostColor((float)traceCost(ray, scene));
+    }
+
+    bool didCollide = castRay(scene, ray);
 
     // sepcial lighting models.
     switch (lightingModel) {
@@ -113,24 +257,7 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
     Material* material = ray.collision.target->material;
     
     // modify normal vector based on normal map (if required)
-    if (material->normalTexture) {
-        // we find the 3 vectors required to transform the normal map from object space to world space.
-        glm::vec3 materialNormal = glm::vec3(material->normalTexture->sampleNormalMap(ray.collision.uv) * 2.0f - 1.0f);
-
-        // soften the normal map a little
-        materialNormal = glm::normalize(materialNormal + 1.0f * glm::vec3(0,0,1));
-
-        glm::vec3 normal = ray.collision.normal;
-        glm::vec3 tangent = ray.collision.tangent;
-        glm::vec3 bitangent = glm::cross(normal, tangent);
-
-        glm::vec3 normalVector = glm::vec3(
-            materialNormal.x*tangent + materialNormal.y*bitangent + materialNormal.z*normal             
-        );
-
-        // update the intersection normal vector
-		ray.collision.normal = normalVector;
-    }
+    applyNormalMap(ray.collision, material);
 
     if (lightingModel == LM_NORMAL) {
         return Color(ray.collision.normal,1.0f);
@@ -143,12 +270,16 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
     // we only need to look a the lights in direct lighting mode (ignore them in GI mode.)
     if (lightingModel == LM_DIRECT) {
         for (int i = 0; i < (int)scene->lights.size(); i++) {        
-		    calculateLighting(ray.collision, scene, scene->lights[i], ambientLight, diffuseLight, specularLight);
+            const Ray* firstShadowRay = (firstShadowRays && firstShadowRays[i].intersected) ? &firstShadowRays[i] : NULL;
+		    calculateLighting(ray.collision, scene, scene->lights[i], sampler, ambientLight, diffuseLight, specularLight, firstShadowRay);
         }
     }
 
     // add in global lighting (if required)
     if (giSamples > 0) {
+
+        // emissive objects are sampled directly, scaled to match the weight the hemisphere samples below would have given them.
+        diffuseLight += sampleEmissiveLights(ray.collision, scene, sampler) * ((float)giSamples / GI_SAMPLES);
                     
         for (int i = 0; i < giSamples; i++) {
             // trace a path from this point in a random direction, then use that points radience as a 'light'                        
@@ -160,7 +291,8 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
             // this is a fast (but biased) way to sample from the hemisphere, just pick a random location, normalise it, then
             // if it's on the wrong side reverse it.             
 			glm::vec3 rayDir;
-			rayDir = glm::normalize(glm::vec3(randf() - 0.5f, randf() - 0.5f, randf() - 0.5f));
+            glm::vec2 u = sampler.get2D();
+			rayDir = glm::normalize(glm::vec3(u.x - 0.5f, u.y - 0.5f, sampler.get1D() - 0.5f));
             float diffusePower = glm::dot(rayDir, ray.collision.normal);
             if (diffusePower < 0) {
                 rayDir = -rayDir;                    
@@ -177,17 +309,18 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
             // full strength we'd get artifcats as we converge as occasinally very bright samples would be taken
             // and strong angles.
             
-            if (randf() > sqrtDiffusePower) continue;                
+            if (sampler.get1D() > sqrtDiffusePower) continue;                
             diffusePower = sqrtDiffusePower;
             
 			Ray giRay;
 			giRay = Ray(ray.collision.location + rayDir * OFFSET_BIAS, rayDir);
             giRay.giRay = true; //enable some optimizatoins.
+            giRay.type = RT_GI;
             
             // We then test the color of this ray.  
             // We set giSamples to 1 if gi was enabled, and 0 otherwise, this gives a 2 bounce lighting model.            
 			Color sampleRadiance;
-			sampleRadiance = trace(giRay, scene, depth + 1, giSamples > 1 ? 1 : 0);
+			sampleRadiance = trace(giRay, scene, sampler, depth + 1, giSamples > 1 ? 1 : 0);
 
             if (sampleRadiance.r != sampleRadiance.r) {
                 printf("Hmm, radiance is nan?\n");
@@ -206,9 +339,13 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
         
     }
 
+    // gi rays that hit a light source have already had its light counted by sampleEmissiveLights.
+    bool sampledEmission = ray.giRay && ray.collision.target->isLightSource && EMISSIVE_LIGHT_SAMPLES > 0;
+    Color emission = sampledEmission ? Color(0,0,0,0) : material->emisiveColor;
+
     // combine lighting
     Color materialColor = material->getDiffuseColor(ray.collision.uv);
-    Color color = (ambientLight + diffuseLight) * materialColor + specularLight + material->emisiveColor;    
+    Color color = (ambientLight + diffuseLight) * materialColor + specularLight + emission;    
         
     // reflection    
     if(material->reflectivity > 0 && depth < MAX_RECUSION_DEPTH) {
@@ -217,12 +354,14 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
         
         // add bluring
         if (material->reflectionBlur > EPSILON) {            
-            reflectedDir = defocus(reflectedDir, material->reflectionBlur);
+            glm::vec2 u = sampler.get2D();
+            reflectedDir = defocus(reflectedDir, material->reflectionBlur, u.x, u.y);
         }
 
 		Ray reflectedRay;
 		reflectedRay = Ray(ray.collision.location + reflectedDir * OFFSET_BIAS, reflectedDir);
-        Color reflectedCol = trace(reflectedRay, scene, depth+1, giSamples); 
+        reflectedRay.type = RT_REFLECTION;
+        Color reflectedCol = trace(reflectedRay, scene, sampler, depth+1, giSamples); 
         color += (material->reflectivity*reflectedCol);        
     }
 
@@ -234,7 +373,8 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
     
             // start the ray a little further on from where we hit.
             Ray transmittedRay = Ray(ray.collision.location + OFFSET_BIAS * ray.dir, ray.dir);
-            Color transmittedCol = trace(transmittedRay, scene, depth, giSamples); 
+            transmittedRay.type = RT_REFRACTION;
+            Color transmittedCol = trace(transmittedRay, scene, sampler, depth, giSamples); 
             color += (1.0f-materialColor.a)*transmittedCol;
             
         } else {            
@@ -242,19 +382,9 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
             // ----------------
             // refraction
     
-            glm::vec3 refractedDir = glm::refract(ray.dir, ray.collision.normal, 1.0f/material->refractionIndex);
-
-            Ray refractedRay = Ray(ray.collision.location + refractedDir * 0.001f , refractedDir);
-            
-            // the refracted ray will exit the object at this location, don't trace against entire scene, just trace against the 
-            // specific object (faster, and less prone to error).
-            ray.collision.target->intersect(&refractedRay);
-			RayIntersectionResult exitPoint = refractedRay.collision;
-
-            if (exitPoint.didCollide()) {
-                glm::vec3 exitDir = glm::refract(refractedDir, -exitPoint.normal, material->refractionIndex);
-                Ray exitRay = Ray(exitPoint.location + exitDir * 0.001f, exitDir);
-                Color refractedCol = trace(exitRay, scene, depth+1, giSamples); 
+            Ray exitRay;
+            if (getRefractedRay(ray, material, exitRay)) {
+                Color refractedCol = trace(exitRay, scene, sampler, depth+1, giSamples); 
                 color += (1.0f-materialColor.a)*refractedCol;
             } else {
                 // this case shouldn't happen, but might due to rounding... just ignore                 
@@ -265,82 +395,557 @@ Color Camera::trace(Ray ray, Scene* scene, int depth, int giSamples)
 	return color;
 }
 
-void Camera::renderPixel(Scene* scene, int pixel)
-{        
+/** Returns the light gathered by a finished path. */
+static Color getPathRadiance(const PathState& path)
+{
+    if (path.radiance.r != path.radiance.r) {
+        printf("Hmm, radiance is nan?\n");
+        return Color(0,0,0,1);
+    }
+    return path.radiance;
+}
 
-    float aspectRatio = float(SCREEN_WIDTH / SCREEN_HEIGHT);            
+bool Camera::extendPath(PathState& path, bool didCollide, Scene* scene, Sampler& sampler, int bounce)
+{
+    Ray& ray = path.ray;
+    glm::vec3& throughput = path.throughput;
+
+    if (!didCollide) {
+        path.radiance += Color(throughput * glm::vec3(backgroundColor), 0);
+        return false;
+    }
+
+    Material* material = ray.collision.target->material;
+    applyNormalMap(ray.collision, material);
+
+    bool sampledEmission = path.diffuseBounce && ray.collision.target->isLightSource && EMISSIVE_LIGHT_SAMPLES > 0;
+    if (!sampledEmission) {
+        path.radiance += Color(throughput * glm::vec3(material->emisiveColor), 0);
+    }
+
+    // the recursive tracer adds diffuse, reflected, and transmitted light together.  Here we pick just one of these
+    // in proportion to its weight, then scale by the total weight so the estimate stays unbiased.
+    Color materialColor = material->getDiffuseColor(ray.collision.uv);
+    float reflectWeight = material->reflectivity;
+    float transmitWeight = 1.0f - materialColor.a;
+    float totalWeight = 1.0f + reflectWeight + transmitWeight;
 
-    int x = pixel % SCREEN_WIDTH;
-    int y = pixel / SCREEN_WIDTH;        
+    float event = sampler.get1D() * totalWeight;
 
+    Ray nextRay;
+    path.diffuseBounce = false;
+    if (event < reflectWeight) {
+        glm::vec3 reflectedDir = glm::reflect(ray.dir, ray.collision.normal);
+        if (material->reflectionBlur > EPSILON) {
+            glm::vec2 u = sampler.get2D();
+            reflectedDir = defocus(reflectedDir, material->reflectionBlur, u.x, u.y);
+        }
+        nextRay = Ray(ray.collision.location + reflectedDir * OFFSET_BIAS, reflectedDir);
+        nextRay.type = RT_REFLECTION;
+    } else if (event < reflectWeight + transmitWeight) {
+        if (material->refractionIndex == 1.0) {
+            nextRay = Ray(ray.collision.location + OFFSET_BIAS * ray.dir, ray.dir);
+            nextRay.type = RT_REFRACTION;
+        } else if (!getRefractedRay(ray, material, nextRay)) {
+            return false;
+        }
+    } else {
+        // cosine weighted sampling cancels the cosine term, so for a lambertian surface the throughput is just scaled by the albedo.
+        if (glm::dot(ray.collision.normal, ray.dir) > 0) ray.collision.normal = -ray.collision.normal;
+
+        // direct light from emissive objects, the lambertian brdf is albedo / pi.
+        glm::vec3 directLight = glm::vec3(sampleEmissiveLights(ray.collision, scene, sampler)) * glm::vec3(materialColor) * (totalWeight / PI);
+        path.radiance += Color(throughput * directLight, 0);
+
+        glm::vec2 u = sampler.get2D();
+        glm::vec3 diffuseDir = sampleHemisphereCosine(ray.collision.normal, u.x, u.y);
+        nextRay = Ray(ray.collision.location + diffuseDir * OFFSET_BIAS, diffuseDir);
+        nextRay.giRay = true;
+        nextRay.type = RT_GI;
+        path.diffuseBounce = true;
+        throughput *= glm::vec3(materialColor);
+    }
+    throughput *= totalWeight;
+
+    // russian roulette, paths carrying little light are terminated early and the survivors are boosted to compensate.
+    if (bounce >= RR_MIN_DEPTH) {
+        float survival = clipf(maxf(throughput.x, maxf(throughput.y, throughput.z)), 0.05f, 1.0f);
+        if (sampler.get1D() > survival) return false;
+        throughput /= survival;
+    }
+
+    ray = nextRay;
+    return true;
+}
+
+Color Camera::tracePath(Ray ray, Scene* scene, Sampler& sampler)
+{
+    PathState path;
+    path.ray = ray;
+
+    for (int bounce = 0; bounce <= MAX_RECUSION_DEPTH; bounce++) {
+
+        sampler.startBounce(bounce);
+        RAY_STAT(depth, bounce < RAY_STATS_DEPTHS ? bounce : RAY_STATS_DEPTHS - 1);
+
+        bool didCollide = castRay(scene, path.ray);
+        if (!extendPath(path, didCollide, scene, sampler, bounce)) break;
+    }
+
+    return getPathRadiance(path);
+}
+
+bool Camera::isPixelSkipped(int x, int y)
+{
     if (lqMode && (((x&1)==1) || ((y&1)==1))) {
-        return;
+        return true;
+    }
+
+    // adaptive sampling, skip pixels that have already converged.
+    return !lqMode && !needsSamples(x, y);
+}
+
+int Camera::getPixelSamples()
+{
+    // path tracing takes many cheap samples per pixel.
+    if (lightingModel == LM_PATH) return PATH_SAMPLES;
+    return superSample == 0 ? 1 : superSample;
+}
+
+Ray Camera::getCameraRay(int x, int y, Sampler& sampler)
+{
+    int width = framebuffer.getWidth();
+    int height = framebuffer.getHeight();
+
+    float aspectRatio = float(width) / height;            
+
+    // path tracing takes many cheap samples per pixel, so always jitter them.
+    bool jitter = (lightingModel == LM_PATH) || (superSample != 0);
+
+    glm::vec2 pixelSample = sampler.get2D();
+    glm::vec2 lensSample = sampler.get2D();
+    float jitterx = jitter ? pixelSample.x : 0.5f;
+    float jittery = jitter ? pixelSample.y : 0.5f;
+
+    // find the rays direction
+    float rx = (2 * ((x + jitterx) / width) - 1) * tan(fov / 2 * PI / 180) * aspectRatio;
+    float ry = (1 - 2 * ((y + jittery) / height)) * tan(fov / 2 * PI / 180);
+    glm::vec3 dir = glm::normalize(glm::vec3(rx, -ry, -1));
+
+    // apply camera tranform
+    dir = toParent(glm::vec4(dir.x, dir.y, dir.z, 0.0));
+
+    // defocus
+    if (defocusBlur > EPSILON) {
+        dir = defocus(dir, defocusBlur, lensSample.x, lensSample.y);
+    }
+    
+    return Ray(location, dir);
+}
+
+bool Camera::renderPixel(Scene* scene, int pixel, const Ray* cameraRays, const Ray* firstShadowRays, const Color* sampleColors)
+{        
+    int width = framebuffer.getWidth();
+
+    int x = pixel % width;
+    int y = pixel / width;        
+
+    if (isPixelSkipped(x, y)) {
+        return false;
     }
     
     Color outputCol = Color(0, 0, 0, 1);
 
-    int requiredSamples = (superSample == 0 ? 1 : superSample);
+    // first hit features are only needed when denoising or writing AOVs.
+    bool writeFeatures = framebuffer.denoise || framebuffer.aovs;
+    PixelFeatures features;
+    int featureHits = 0;
 
-    for (int j = 0; j < requiredSamples; j++) {        
-        float jitterx = (superSample == 0) ? 0.5f : randf();
-        float jittery = (superSample == 0) ? 0.5f : randf();
+    bool pathTrace = (lightingModel == LM_PATH);
+    int requiredSamples = getPixelSamples();
 
-        // find the rays direction
-        float rx = (2 * ((x + jitterx) / SCREEN_WIDTH) - 1) * tan(fov / 2 * PI / 180) * aspectRatio;
-        float ry = (1 - 2 * ((y + jittery) / SCREEN_HEIGHT)) * tan(fov / 2 * PI / 180);
-        glm::vec3 dir = glm::normalize(glm::vec3(rx, -ry, -1));
+    PixelSamplers samplers;
+    Sampler* sampler = samplers.get(samplerType);
 
-        // apply camera tranform
-        dir = toParent(glm::vec4(dir.x, dir.y, dir.z, 0.0));
+    for (int j = 0; j < requiredSamples; j++) {        
+        sampler->startSample(x, y, passIndex * requiredSamples + j);
+
+        Ray ray;
+        if (cameraRays) {
+            ray = cameraRays[j];
+            sampler->skipCamera();
+        } else {
+            ray = getCameraRay(x, y, *sampler);
+        }
 
-        // defocus
-        if (defocusBlur > EPSILON) {
-            dir = defocus(dir, defocusBlur);
+        const Ray* shadowRays = firstShadowRays ? &firstShadowRays[j * scene->lights.size()] : NULL;
+        Color col;
+        if (sampleColors) {
+            col = sampleColors[j];
+        } else {
+            col = pathTrace ? tracePath(ray, scene, *sampler) : trace(ray, scene, *sampler, 0, (lightingModel == LM_GI) ? GI_SAMPLES : 0, shadowRays);
+        }
+        if (writeFeatures) {
+            PixelFeatures sampleFeatures = traceFeatures(ray, scene);
+            if (sampleFeatures.depth >= 0) {
+                features.albedo += sampleFeatures.albedo;
+                features.normal += sampleFeatures.normal;
+                features.depth += sampleFeatures.depth;
+                features.position += sampleFeatures.position;
+                features.local += sampleFeatures.local;
+                features.uv += sampleFeatures.uv;
+                featureHits++;
+            }
         }
-        
-        Ray ray = Ray(location, dir);
-        Color col = trace(ray, scene, 0, (lightingModel == LM_GI) ? GI_SAMPLES : 0);
         outputCol = outputCol + (col * (1.0f/requiredSamples));
     }
             
     // higher weight for more samples.
+    float weight = 0.01f + ((pathTrace && !lqMode) ? PATH_SAMPLES : superSample);
+
+    // average features over the samples that hit something, pixels on an edge get less weight.
+    float featureWeight = weight * featureHits / requiredSamples;
+    if (featureHits > 0) {
+        features.albedo /= (float)featureHits;
+        features.depth /= featureHits;
+        features.position /= (float)featureHits;
+        features.local /= (float)featureHits;
+        features.uv /= (float)featureHits;
+    }
 
     if (lqMode) {
         // render 2x2 block
-        gfx.addSample(x+1, y, outputCol, 0.01f + superSample);        
-        gfx.addSample(x, y+1, outputCol, 0.01f + superSample);        
-        gfx.addSample(x+1, y+1, outputCol, 0.01f + superSample);        
-    } else {
-        // show where we are up to.
-        gfx.putPixel(x, y+1, Color(0,0,0,1), true);            
-        gfx.putPixel(x, y+2, Color(1,1,1,1), true);                
+        framebuffer.addSample(x+1, y, outputCol, weight, requiredSamples);        
+        framebuffer.addSample(x, y+1, outputCol, weight, requiredSamples);        
+        framebuffer.addSample(x+1, y+1, outputCol, weight, requiredSamples);        
+        framebuffer.addFeatures(x+1, y, features, featureWeight);        
+        framebuffer.addFeatures(x, y+1, features, featureWeight);        
+        framebuffer.addFeatures(x+1, y+1, features, featureWeight);        
     }
 
-    gfx.addSample(x, y, outputCol, 0.01f + superSample);                                	
+    framebuffer.addSample(x, y, outputCol, weight, requiredSamples);                                	
+    framebuffer.addFeatures(x, y, features, featureWeight);                                	
+    return true;
+}
+
+PixelFeatures Camera::traceFeatures(Ray ray, Scene* scene)
+{
+    PixelFeatures features;
+    if (!castRay(scene, ray)) {
+        features.depth = -1;
+        return features;
+    }
+
+    Material* material = ray.collision.target->material;
+    applyNormalMap(ray.collision, material);
+
+    features.albedo = material->getDiffuseColor(ray.collision.uv);
+    features.normal = glm::normalize(ray.collision.normal);
+    features.depth = ray.collision.t;
+    features.position = ray.collision.location;
+    features.local = ray.collision.local;
+    // uv co-ords are only generated for materials that need them.
+    features.uv = (ray.collision.uv.x == 0) ? ray.collision.target->getUV(ray.collision.local) : ray.collision.uv;
+    return features;
+}
+
+int Camera::traceCost(Ray ray, Scene* scene)
+{
+    bool didCollide = castRay(scene, ray);
+    int tests = ray.boundsTests + ray.primitiveTests;
+    if (!didCollide || !costShadowRays) return tests;
+
+    for (int i = 0; i < (int)scene->lights.size(); i++) {
+        glm::vec3 toLight = scene->lights[i]->getLocation() - ray.collision.location;
+        float lightDistance = glm::length(toLight);
+        if (lightDistance < EPSILON) continue;
+
+        Ray shadowRay = Ray(ray.collision.location + toLight * (OFFSET_BIAS / lightDistance), toLight);
+        shadowRay.length = lightDistance;
+        shadowRay.shadowTrace = true;
+        shadowRay.type = RT_SHADOW;
+        castRay(scene, shadowRay);
+        tests += shadowRay.boundsTests + shadowRay.primitiveTests;
+    }
+    return tests;
+}
+
+Color Camera::getCostColor(float tests)
+{
+    // black, blue, cyan, green, yellow, red, roughly one step for each factor of 4.
+    static const glm::vec3 RAMP[] = {
+        glm::vec3(0,0,0), glm::vec3(0,0,1), glm::vec3(0,1,1), glm::vec3(0,1,0), glm::vec3(1,1,0), glm::vec3(1,0,0)
+    };
+    const int STEPS = 5;
+
+    if (tests > COST_HEATMAP_MAX) return Color(1,1,1,1);
+
+    float t = log(1.0f + maxf(tests, 0)) / log(1.0f + COST_HEATMAP_MAX) * STEPS;
+    int step = clipi((int)t, 0, STEPS - 1);
+    return Color(glm::mix(RAMP[step], RAMP[step + 1], t - step), 1);
 }
 
 /** Renders given number of pixels before returning control. */
 int Camera::render(Scene* scene, int pixels, bool autoReset)
 {	
-	int totalPixels = SCREEN_WIDTH * SCREEN_HEIGHT;	
+	int totalPixels = framebuffer.getWidth() * framebuffer.getHeight();	
 
 	if (pixels == -1) {
 		pixels = totalPixels - pixelOn;
 	}
 		
     if (pixelOn+pixels > totalPixels) {
-        pixels = totalPixels - pixelOn - 1;
+        pixels = totalPixels - pixelOn;
     }    
 
-	//#pragma loop(hint_parallel(8))  
-	//#pragma loop(ivdep) // ivdep will force this through. 
-	// would be better to render to independant blocks or lines, then write them through after the render... would also be interesting to see what the data dependancy is?  
-	// GFX buffer would be one, ray stats another...
-    for (int i = 0; i < pixels; i++) {
-        renderPixel(scene, pixelOn+i);
-    }
+    int sampledPixels = renderPixels(scene, pixelOn, pixels);
     
     pixelOn += pixels;
+    if (!lqMode) noisyPixels += sampledPixels;
     
 	return pixels; 
+}
+
+int Camera::renderPixels(Scene* scene, int firstPixel, int pixels, const uint8_t* mask)
+{
+    // each pixel only writes to its own samples (or its own 2x2 block in lq mode) so pixels can be rendered in 
+    // parallel.  Rows take very different amounts of time so hand them out in small chunks.
+    std::atomic<int> sampledPixels(0);
+    bool wavefrontPaths = wavefront && lightingModel == LM_PATH;
+    ThreadPool::global().parallelFor(pixels, wavefrontPaths ? WAVEFRONT_PIXELS : 64, [&](int start, int end) {
+        TRACE_ZONE("tile");
+        int sampled = 0;
+        // the cost heatmap traces its own rays so that each can be counted on its own.
+        if (wavefrontPaths) {
+            sampled = renderWavefront(scene, firstPixel, start, end, mask);
+        } else if (rayPackets && lightingModel != LM_COST) {
+            sampled = renderPixelPackets(scene, firstPixel, start, end, mask);
+        } else {
+            for (int i = start; i < end; i++) {
+                if (mask && !mask[i]) continue;
+                if (renderPixel(scene, firstPixel+i)) sampled++;
+            }
+        }
+        sampledPixels += sampled;
+    }, threads);
+    return sampledPixels;
+}
+
+void Camera::castPacket(SceneObject* object, std::vector<Ray*>& rays)
+{
+    RayPacket packet;
+    for (int start = 0; start < (int)rays.size(); start += RAY_PACKET_SIZE) {
+        packet.count = std::min(RAY_PACKET_SIZE, (int)rays.size() - start);
+        for (int i = 0; i < packet.count; i++) {
+            packet.rays[i] = rays[start + i];
+        }
+        object->intersectPacket(packet, (1 << packet.count) - 1);
+        for (int i = 0; i < packet.count; i++) {
+            packet.rays[i]->intersected = true;
+        }
+    }
+}
+
+int Camera::renderPixelPackets(Scene* scene, int firstPixel, int start, int end, const uint8_t* mask)
+{
+    int width = framebuffer.getWidth();
+    int requiredSamples = getPixelSamples();
+    int lights = (int)scene->lights.size();
+
+    PixelSamplers samplers;
+    Sampler* sampler = samplers.get(samplerType);
+
+    // the camera rays of every sample of the pixels to be rendered, in the order renderPixel takes them, so that
+    // neighbouring pixels share packets.
+    std::vector<int> pixels;
+    std::vector<Ray> cameraRays;
+    for (int i = start; i < end; i++) {
+        if (mask && !mask[i]) continue;
+        int pixel = firstPixel + i;
+        int x = pixel % width;
+        int y = pixel / width;
+        if (isPixelSkipped(x, y)) continue;
+
+        pixels.push_back(pixel);
+        for (int j = 0; j < requiredSamples; j++) {
+            sampler->startSample(x, y, passIndex * requiredSamples + j);
+            cameraRays.push_back(getCameraRay(x, y, *sampler));
+        }
+    }
+
+    std::vector<Ray*> packetRays;
+    for (int i = 0; i < (int)cameraRays.size(); i++) {
+        packetRays.push_back(&cameraRays[i]);
+    }
+    castPacket(scene, packetRays);
+
+    // the first shadow ray from where each camera ray hit to each light, traced one light at a time so that the rays
+    // in a packet all head to the same point.  Area lights are sampled at a different point by each ray, and are
+    // left to calculateLighting.
+    std::vector<Ray> shadowRays;
+    if (lightingModel == LM_DIRECT && lights > 0) {
+        shadowRays.resize(cameraRays.size() * lights);
+        for (int l = 0; l < lights; l++) {
+            Light* light = scene->lights[l];
+            if (!light->shadow || light->lightSize > 0) continue;
+
+            glm::vec3 lightPos = light->getLocation();
+            packetRays.clear();
+            for (int i = 0; i < (int)cameraRays.size(); i++) {
+                if (!cameraRays[i].collision.didCollide()) continue;
+
+                // points facing away from the light mostly need no shadow ray.  The normal map is left out here, so
+                // calculateLighting may still trace a ray that was skipped, or not need one that was traced.
+                const RayIntersectionResult& intersection = cameraRays[i].collision;
+                glm::vec3 lightVector = glm::normalize(lightPos - intersection.location);
+                if (glm::dot(lightVector, intersection.normal) <= 0) continue;
+
+                Ray& shadowRay = shadowRays[i * lights + l];
+                shadowRay = getShadowRay(intersection.location, lightVector, glm::length(lightPos - intersection.location));
+                packetRays.push_back(&shadowRay);
+            }
+            castPacket(scene, packetRays);
+        }
+    }
+
+    int sampled = 0;
+    for (int i = 0; i < (int)pixels.size(); i++) {
+        const Ray* pixelShadowRays = shadowRays.empty() ? NULL : &shadowRays[i * requiredSamples * lights];
+        if (renderPixel(scene, pixels[i], &cameraRays[i * requiredSamples], pixelShadowRays)) sampled++;
+    }
+    return sampled;
+}
+
+int Camera::renderWavefront(Scene* scene, int firstPixel, int start, int end, const uint8_t* mask)
+{
+    int width = framebuffer.getWidth();
+    int requiredSamples = getPixelSamples();
+    bool writeFeatures = framebuffer.denoise || framebuffer.aovs;
+
+    PixelSamplers samplers;
+    Sampler* sampler = samplers.get(samplerType);
+
+    struct WavefrontPath
+    {
+        PathState state;
+        int x;
+        int y;
+        int sampleIndex;
+    };
+
+    // a path for each sample of the pixels to be rendered, in the order renderPixel takes them.
+    std::vector<int> pixels;
+    std::vector<WavefrontPath> paths;
+    for (int i = start; i < end; i++) {
+        if (mask && !mask[i]) continue;
+        int pixel = firstPixel + i;
+        int x = pixel % width;
+        int y = pixel / width;
+        if (isPixelSkipped(x, y)) continue;
+
+        pixels.push_back(pixel);
+        for (int j = 0; j < requiredSamples; j++) {
+            WavefrontPath path;
+            path.x = x;
+            path.y = y;
+            path.sampleIndex = passIndex * requiredSamples + j;
+            sampler->startSample(x, y, path.sampleIndex);
+            path.state.ray = getCameraRay(x, y, *sampler);
+            paths.push_back(path);
+        }
+    }
+
+    // the camera rays once traced, for the first hit features.
+    std::vector<Ray> cameraRays;
+
+    std::vector<int> active;
+    for (int i = 0; i < (int)paths.size(); i++) {
+        active.push_back(i);
+    }
+
+    std::vector<std::pair<uint64_t, int>> order;
+    std::vector<std::pair<uint64_t, int>> scratch;
+    std::vector<Material*> materials;
+    std::vector<Ray*> rays;
+    for (int bounce = 0; bounce <= MAX_RECUSION_DEPTH && !active.empty(); bounce++) {
+
+        // sort the rays by the octant they head into, then along a Z order curve through where they start, so that
+        // rays traced one after another visit much the same parts of the scene.
+        glm::vec3 originMin = glm::vec3(FLT_MAX);
+        glm::vec3 originMax = glm::vec3(-FLT_MAX);
+        for (int i = 0; i < (int)active.size(); i++) {
+            originMin = glm::min(originMin, paths[active[i]].state.ray.pos);
+            originMax = glm::max(originMax, paths[active[i]].state.ray.pos);
+        }
+        glm::vec3 extent = glm::max(originMax - originMin, glm::vec3(EPSILON));
+
+        order.clear();
+        for (int i = 0; i < (int)active.size(); i++) {
+            const Ray& ray = paths[active[i]].state.ray;
+            uint64_t octant = (ray.dir.x < 0 ? 1 : 0) | (ray.dir.y < 0 ? 2 : 0) | (ray.dir.z < 0 ? 4 : 0);
+            order.push_back(std::make_pair((octant << 30) | mortonCode((ray.pos - originMin) / extent), active[i]));
+        }
+        sortByKey(order, scratch, 33);
+
+        rays.clear();
+        for (int i = 0; i < (int)order.size(); i++) {
+            rays.push_back(&paths[order[i].second].state.ray);
+        }
+        castPacket(scene, rays);
+
+        if (bounce == 0 && writeFeatures) {
+            for (int i = 0; i < (int)paths.size(); i++) {
+                cameraRays.push_back(paths[i].state.ray);
+            }
+        }
+
+        // shade the paths grouped by the material they hit, keeping the order they were traced in within each group.
+        // Misses are group 0.
+        materials.clear();
+        for (int i = 0; i < (int)order.size(); i++) {
+            Ray& ray = paths[order[i].second].state.ray;
+            Material* material = ray.collision.didCollide() ? ray.collision.target->material : NULL;
+            int group = 0;
+            if (material) {
+                group = (int)(std::find(materials.begin(), materials.end(), material) - materials.begin());
+                if (group == (int)materials.size()) materials.push_back(material);
+                group++;
+            }
+            order[i].first = group;
+        }
+        int groupBits = 1;
+        while ((1 << groupBits) <= (int)materials.size()) groupBits++;
+        sortByKey(order, scratch, groupBits);
+
+        active.clear();
+        for (int i = 0; i < (int)order.size(); i++) {
+            WavefrontPath& path = paths[order[i].second];
+            sampler->startSample(path.x, path.y, path.sampleIndex);
+            sampler->startBounce(bounce);
+            RAY_STAT(depth, bounce < RAY_STATS_DEPTHS ? bounce : RAY_STATS_DEPTHS - 1);
+
+            bool didCollide = castRay(scene, path.state.ray);
+            if (extendPath(path.state, didCollide, scene, *sampler, bounce)) active.push_back(order[i].second);
+        }
+    }
+
+    std::vector<Color> colors;
+    for (int i = 0; i < (int)paths.size(); i++) {
+        colors.push_back(getPathRadiance(paths[i].state));
+    }
+
+    int sampled = 0;
+    for (int i = 0; i < (int)pixels.size(); i++) {
+        const Ray* pixelCameraRays = writeFeatures ? &cameraRays[i * requiredSamples] : NULL;
+        if (renderPixel(scene, pixels[i], pixelCameraRays, NULL, &colors[i * requiredSamples])) sampled++;
+    }
+    return sampled;
+}
+
+bool Camera::needsSamples(int x, int y)
+{
+    if (ADAPTIVE_ERROR_THRESHOLD <= 0) return true;
+    if (framebuffer.getSamples(x, y) < ADAPTIVE_MIN_SAMPLES) return true;
+    if (framebuffer.getEffectiveSamples(x, y) < ADAPTIVE_MIN_PASSES) return true;
+    return framebuffer.getError(x, y) >= ADAPTIVE_ERROR_THRESHOLD;
 }
\ No newline at end of file
@@ -5,13 +5,16 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <vector>
 
 #include "SceneObject.h"
 #include "Utils.h"
 #include "Ray.h"
-#include "GFX.h"
+#include "RayStats.h"
+#include "Framebuffer.h"
 #include "ContainerObject.h"
 #include "Light.h"
+#include "Sampler.h"
 
 // various lighting models for the render
 enum LightingModel {
@@ -28,12 +31,36 @@ enum LightingModel {
     // displays world coords
     LM_WORLD,
     // displays local coords
-    LM_LOCAL
+    LM_LOCAL,
+    // iterative path tracer with russian roulette.  Many cheap non-branching paths per pixel.
+    LM_PATH,
+    // displays the number of bounds and primitive tests made by each pixels rays as a heatmap.
+    LM_COST
 };
 
+// number of tests shown as the top (red) of the LM_COST heatmap, anything higher is white.
+const int COST_HEATMAP_MAX = 1024;
+
+// pixels each thread renders a bounce at a time in wavefront mode, each with PATH_SAMPLES paths.
+const int WAVEFRONT_PIXELS = 1024;
+
 // forward declare the scene object.
 class Scene;
 
+/** A path being traced by the path tracer. */
+struct PathState
+{
+    // the next ray along the path.
+    Ray ray;
+
+    // light gathered along the path, and how much of the light arriving at the current vertex makes it back to the camera.
+    Color radiance = Color(0,0,0,1);
+    glm::vec3 throughput = glm::vec3(1,1,1);
+
+    // set when the last bounce was diffuse, in which case emissive objects have already been sampled directly.
+    bool diffuseBounce = false;
+};
+
 class Camera : public SceneObject
 {
 protected:
@@ -42,12 +69,34 @@ protected:
 
 	int pixelOn = 0;
 
-    // a bit of a hack, but this is the intersection result from the last call to 'trace'.
-    // idealy I'd return this and the color from the trace function in some kind of struct.
-    RayIntersectionResult lastTraceIntersection;
+    // number of passes started, used to give each pass its own samples from the sampler.
+    int passIndex = 0;
+
+    // number of pixels that were still noisy enough to be sampled this pass.
+    int noisyPixels = 0;
+
+    // render a single pixel, returns false if the pixel was skipped.  cameraRays and firstShadowRays optionally give
+    // the pixels camera rays and the first shadow ray from each to each light, already traced by renderPixelPackets.
+    // sampleColors optionally gives the colour of each sample, already found by renderWavefront.
+    bool renderPixel(Scene* scene, int pixel, const Ray* cameraRays = NULL, const Ray* firstShadowRays = NULL, const Color* sampleColors = NULL);
+
+    // renders pixels [start, end) of a chunk beginning at firstPixel, tracing their camera rays and the shadow rays
+    // from them to point lights as packets first.  Returns the number of pixels sampled.
+    int renderPixelPackets(Scene* scene, int firstPixel, int start, int end, const uint8_t* mask);
+
+    // path traces pixels [start, end) of a chunk beginning at firstPixel a bounce at a time.  Each bounce the rays
+    // of all the paths still going are sorted by where they start and the way they head, traced together, then
+    // shaded grouped by the material they hit.  Returns the number of pixels sampled.
+    int renderWavefront(Scene* scene, int firstPixel, int start, int end, const uint8_t* mask);
+
+    // returns if pixel is skipped this pass, in lq mode or because it has converged.
+    bool isPixelSkipped(int x, int y);
 
-    // render a single pixel
-    void renderPixel(Scene* scene, int pixel);
+    // returns the number of samples taken for each pixel per pass.
+    int getPixelSamples();
+
+    // returns the camera ray for a sample of pixel x,y, which takes the first dimensions of sampler.
+    Ray getCameraRay(int x, int y, Sampler& sampler);
     
 public:
 
@@ -57,22 +106,61 @@ public:
     // number of global illumination samples to test per lighting calculation. 
     int GI_SAMPLES = 32;    
 	
-    // maximum recursive depth (e.g. reflections).
+    // maximum recursive depth (e.g. reflections).  Also the maximum number of bounces in path tracing mode.
     int MAX_RECUSION_DEPTH = 9;
 
+    // number of paths to trace per pixel in path tracing mode.
+    int PATH_SAMPLES = 16;
+
+    // number of bounces before russian roulette starts terminating paths.
+    int RR_MIN_DEPTH = 3;
+
+    // number of emissive objects to sample directly at each GI or path tracing bounce.  0 disables light sampling, in
+    // which case emissive objects only contribute when a ray happens to hit them.
+    int EMISSIVE_LIGHT_SAMPLES = 1;
+
     // Number of rays to trace per pixel.  0 disables supersampling.
 	int superSample=0;
 
     // Randomly defocus rays by this number of radians.  Requires high oversampling for best results.
     float defocusBlur = 0.0f;
 
+    // source of random numbers for pixel samples.
+    SamplerType samplerType = ST_SOBOL;
+
     // renders only 1/4th of the pixels.
     bool lqMode = false;
 
+    // in high quality mode pixels whose estimated relative error is below this threshold are skipped, so further
+    // samples go only where the image is still noisy.  0 disables adaptive sampling.
+    float ADAPTIVE_ERROR_THRESHOLD = 0.02f;
+
+    // number of samples a pixel needs before we trust its error estimate.  A few samples that happen to agree (such as
+    // paths that all missed the light) look converged, so this counts every sample rather than passes.
+    float ADAPTIVE_MIN_SAMPLES = 32.0f;
+
+    // the error is estimated from the spread between passes, so it also needs a few of them.
+    float ADAPTIVE_MIN_PASSES = 4.0f;
+
     // The lighting model to use when rendering.
     LightingModel lightingModel = LM_DIRECT;
 
+    // in the LM_COST lighting model, also count the shadow rays from the first hit to each light.
+    bool costShadowRays = false;
+
+    // maximum number of threads from the thread pool to render with, 0 uses all of them.
+    int threads = 0;
+    // trace camera rays, and the shadow rays from where they hit to point lights, in packets of RAY_PACKET_SIZE.
+    // The image is the same either way.
+    bool rayPackets = true;
+    // in the path tracing lighting model, render WAVEFRONT_PIXELS pixels at a time a bounce at a time, rather than
+    // following each path to its end before starting the next.  The image is the same either way.
+    bool wavefront = false;
+
     // ----------------------------
+
+    // the image this camera renders into.
+    Framebuffer framebuffer;
         
     Color backgroundColor = Color(0.1f,0.2f,0.4f,1.0f);
 
@@ -83,22 +171,76 @@ public:
      * Traces ray through camera's scene and calculates lighting at intersection point.
      * @ray The ray to test
      * @scene The scene to trace through
+     * @sampler Source of random numbers for this sample
      * @depth Recusion depth
      * @giSamples Number of GI samples to use, 0 to disable.
+     * @firstShadowRays Optional first shadow ray to each light, those that are intersected are used instead of tracing them.
      * @returns color at the interesection point of the ray and the scene.
      **/
-	Color trace(Ray ray, Scene* scene, int depth = 0, int giSamples = 0);
+	Color trace(Ray ray, Scene* scene, Sampler& sampler, int depth = 0, int giSamples = 0, const Ray* firstShadowRays = NULL);
+
+    /**
+     * Traces a single path through the scene.  Unlike trace this does not branch, at each bounce one of diffuse,
+     * reflection or transmission is chosen at random, and paths are terminated by russian roulette on their throughput.
+     * @ray The camera ray to start the path from
+     * @scene The scene to trace through
+     * @sampler Source of random numbers for this sample, each bounce draws from its own dimensions
+     * @returns radiance along the path.
+     **/
+    Color tracePath(Ray ray, Scene* scene, Sampler& sampler);
+
+    /** Returns the albedo, normal and depth of the first surface hit by ray, for use by the denoiser. */
+    PixelFeatures traceFeatures(Ray ray, Scene* scene);
+
+    /** Returns the number of bounds and primitive tests made tracing ray, along with the shadow rays from where it
+     * hits to each light if costShadowRays is set. */
+    int traceCost(Ray ray, Scene* scene);
+
+    /** Returns the LM_COST heatmap colour for a number of tests.  The scale is logarithmic, going from black through
+     * blue (4 tests), cyan (16), green (64) and yellow (256) to red at COST_HEATMAP_MAX, and white above that. */
+    static Color getCostColor(float tests);
 	
-	/** Render this number of pixels.  Rendering can be done bit by bit.  
+	/** Render this number of pixels.  Rendering can be done bit by bit.  The pixels are shared between the threads of the 
+	 global thread pool.
 	 @param pixels: maximum number of pixels to render.  -1 renders entire image.
 	 @param autoReset: causes renderer to render next frame once this frame finishes rendering.
 	*/
 	int render(Scene* scene, int pixels, bool autoReset=false);	
 
+    /** Renders pixels [firstPixel, firstPixel+pixels) of the current pass without advancing the pass.  If mask is given
+     * only pixels with a non zero mask entry are rendered.  Returns the number of pixels sampled. */
+    int renderPixels(Scene* scene, int firstPixel, int pixels, const uint8_t* mask = NULL);
+
+    /** Returns if a pixel is still too noisy for adaptive sampling to skip it. */
+    bool needsSamples(int x, int y);
+
     /** Reset the camerea rendering. */
     void reset()
     {
         pixelOn = 0;
+        noisyPixels = 0;
+        passIndex++;
+    }
+
+    /** Returns number of pixels that needed sampling in the current pass. */
+    int getNoisyPixels() { return noisyPixels; }
+
+    /** Returns if every pixel of the current pass has been rendered. */
+    bool isPassComplete() { return pixelOn >= framebuffer.getWidth() * framebuffer.getHeight(); }
+
+    /** Returns the index of the current pass, which selects the samples taken by the sampler. */
+    int getPassIndex() { return passIndex; }
+
+    /** Sets the index of the current pass, used to carry on the sample sequence when resuming a render. */
+    void setPassIndex(int passIndex) { this->passIndex = passIndex; }
+
+    /** Returns the index of the next pixel to be rendered this pass. */
+    int getPixelOn() { return pixelOn; }
+
+    /** Returns if every pixel was below the adaptive error threshold on the last completed pass. */
+    bool isConverged() 
+    {
+        return ADAPTIVE_ERROR_THRESHOLD > 0 && !lqMode && pixelOn > 0 && noisyPixels == 0;
     }
     
     /** moves camera.
@@ -120,7 +262,43 @@ public:
 
 protected:
 
-    /** Calculates lighting of given light at this intersection point. */
-    void calculateLighting(RayIntersectionResult intersection, ContainerObject* scene, Light* light, Color& ambientLightSum, Color& diffuseLightSum, Color& specularLightSum);
+    /** Intersects ray with object (usually the scene), counting it in the ray statistics.  Rays already intersected
+     * as part of a packet keep their collision, and are counted here with the tests they made in the packet. */
+    bool castRay(SceneObject* object, Ray& ray)
+    {
+        RayStats& stats = threadRayStats();
+        stats.rays[ray.type]++;
+#ifdef RAY_STATS
+        int boundsTests = ray.intersected ? 0 : ray.boundsTests;
+        int primitiveTests = ray.intersected ? 0 : ray.primitiveTests;
+#endif
+        bool didCollide = ray.intersected ? ray.collision.didCollide() : object->intersect(&ray);
+#ifdef RAY_STATS
+        stats.boundsTests[ray.type] += ray.boundsTests - boundsTests;
+        stats.primitiveTests[ray.type] += ray.primitiveTests - primitiveTests;
+        if (didCollide) stats.hits[ray.type]++;
+#endif
+        return didCollide;
+    }
+    /** Perturbs the intersection normal by the materials normal map (if it has one). */
+    void applyNormalMap(RayIntersectionResult& intersection, Material* material);
+
+    /** Finds the ray leaving a refractive object after entering it at intersection.  Returns false if the ray
+     * failed to exit (this can happen due to rounding). */
+    bool getRefractedRay(Ray ray, Material* material, Ray& exitRay);
+
+    /** Estimates cosine weighted light arriving at intersection from the scenes emissive objects. */
+    Color sampleEmissiveLights(RayIntersectionResult intersection, Scene* scene, Sampler& sampler);
+
+    /** Calculates lighting of given light at this intersection point.  firstShadowRay is used as the first shadow
+     * ray if it has already been traced. */
+    void calculateLighting(RayIntersectionResult intersection, ContainerObject* scene, Light* light, Sampler& sampler, Color& ambientLightSum, Color& diffuseLightSum, Color& specularLightSum, const Ray* firstShadowRay = NULL);
+
+    /** Adds the light arriving along the paths ray, which hit the scene if didCollide, then moves the path on to its
+     * next ray.  sampler must be at the paths sample and bounce.  Returns false if the path has ended. */
+    bool extendPath(PathState& path, bool didCollide, Scene* scene, Sampler& sampler, int bounce);
+
+    /** Intersects rays with object in packets of RAY_PACKET_SIZE, marking them as intersected. */
+    void castPacket(SceneObject* object, std::vector<Ray*>& rays);
 	
 };
\ No newline at end of file
@@ -4,66 +4,194 @@
 -------------------------------------------------------------*/
 
 #include "ContainerObject.h"
+#include "ThreadPool.h"
+
+// containers with fewer children than this keep testing them one by one.
+const int BVH_MIN_OBJECTS = 4;
 
 void ContainerObject::add(SceneObject* object) 
 {
     children.push_back(object);
 }
 
-bool ContainerObject::intersectObject(Ray* ray)
+bool ContainerObject::intersectBounds(Ray* ray, float& t)
 {
+    t = 0;
+    if (boundingSphereRadius <= 0) return true;
 
-    if (boundingSphereRadius > 0) {
-
-		bool distanceFromSphere2 = glm::length2(ray->pos);
-		float sphereRadius2 = boundingSphereRadius * boundingSphereRadius;
-		float maxRadius2 = (boundingSphereRadius + ray->length) * (boundingSphereRadius + ray->length);
+	RAY_COUNT_TESTS(ray, boundsTests, 1);
 
-		// no way to hit the sphere, we are too far away.
-		if (distanceFromSphere2 > maxRadius2) return false;
+	bool distanceFromSphere2 = glm::length2(ray->pos);
+	float sphereRadius2 = boundingSphereRadius * boundingSphereRadius;
+	float maxRadius2 = (boundingSphereRadius + ray->length) * (boundingSphereRadius + ray->length);
 
-		if (distanceFromSphere2 > boundingSphereRadius*boundingSphereRadius) {
-			// we may or may not hit the sphere so check futher
+	// no way to hit the sphere, we are too far away.
+	if (distanceFromSphere2 > maxRadius2) return false;
 
-			float t = raySphereIntersection(ray->pos, ray->dir, glm::vec3(0, 0, 0), boundingSphereRadius);
+	if (distanceFromSphere2 > boundingSphereRadius*boundingSphereRadius) {
+		// we may or may not hit the sphere so check futher
 
-			if (t > ray->length) return false;
+		t = raySphereIntersection(ray->pos, ray->dir, glm::vec3(0, 0, 0), boundingSphereRadius);
 
-			// big hack, use bounds if we are far away.  Should be fine for GI rays.
-			if (ray->giRay && t > boundingSphereRadius*10.0f && t < ray->length) {
-				glm::vec3 local = (ray->pos + ray->dir * t);
-				glm::vec3 normal = glm::normalize(local);
-				ray->collision = RayIntersectionResult(this, t, local, normal, normal);
-				return true;
-			}
-			// we did not hit sphere bounds so exit.
-			if (t <= 0) {
-				return false;
-			}
+		if (t > ray->length) return false;
 
+		// we did not hit sphere bounds so exit.
+		if (t <= 0) {
+			return false;
 		}
+	}
+    return true;
+}
+
+void ContainerObject::applyContainerMaterial(Ray* ray)
+{
+    if (!useContainerMaterial) return;
 
+    // if we set the target to ourselves then getting the uvs won't work later on so we 
+    // eval them here.        
+    if (material->needsUV()) {            
+        ray->collision.uv = ray->collision.target->getUV(ray->collision.local);
     }
+	ray->collision.target = this;        
+}
+
+bool ContainerObject::intersectObject(Ray* ray)
+{
+    float t;
+    if (!intersectBounds(ray, t)) return false;
+
+	// big hack, use bounds if we are far away.  Should be fine for GI rays.
+	if (ray->giRay && t > boundingSphereRadius*10.0f && t < ray->length) {
+		glm::vec3 local = (ray->pos + ray->dir * t);
+		glm::vec3 normal = glm::normalize(local);
+		ray->collision = RayIntersectionResult(this, t, local, normal, normal);
+		return true;
+	}
         
     // we check each child object and take the closest collision.
 	bool didCollide = false;
-    for (int i = 0; i < children.size(); i++) {
+    if (bvh) {
+        didCollide = bvh->intersect(ray);
+    } else {
+        for (int i = 0; i < children.size(); i++) {
 
-        if (ray->shadowTrace && !children[i]->castsShadows) continue;
-        didCollide |= children[i]->intersect(ray);        
+            if (ray->shadowTrace && !children[i]->castsShadows) continue;
+            didCollide |= children[i]->intersect(ray);        
+        }
     }
 
-    if (useContainerMaterial && didCollide) {
-        // if we set the target to ourselves then getting the uvs won't work later on so we 
-        // eval them here.        
-        if (material->needsUV()) {            
-            ray->collision.uv = ray->collision.target->getUV(ray->collision.local);
+    if (didCollide) applyContainerMaterial(ray);
+    return didCollide;
+}
+
+int ContainerObject::intersectObjectPacket(RayPacket& packet, int mask)
+{
+    // without a hierarchy each child is tested by each ray anyway, so there is nothing to share.
+    if (!bvh) return SceneObject::intersectObjectPacket(packet, mask);
+
+    int hits = 0;
+    int active = 0;
+    for (int i = 0; i < packet.count; i++) {
+        if (!(mask & (1 << i))) continue;
+        Ray* ray = packet.rays[i];
+
+        // gi rays may stop at the bounds, which is handled by the single ray path.
+        if (ray->giRay) {
+            if (intersectObject(ray)) hits |= 1 << i;
+            continue;
         }
-		ray->collision.target = this;        
+
+        float t;
+        if (intersectBounds(ray, t)) active |= 1 << i;
     }
-    return didCollide;
+
+    int bvhHits = active ? bvh->intersectPacket(packet, active) : 0;
+    for (int i = 0; i < packet.count; i++) {
+        if (bvhHits & (1 << i)) applyContainerMaterial(packet.rays[i]);
+    }
+    return hits | bvhHits;
 }
 
 
 
 
+void ContainerObject::refit()
+{
+    TRACE_ZONE("refit");
+    bool bounded = true;
+    float newRadius = 0;
+
+    for (int i = 0; i < (int)children.size(); i++) {
+        ContainerObject* container = dynamic_cast<ContainerObject*>(children[i]);
+        if (container) container->refit();
+
+        float r = children[i]->getRadius();
+        if (r < 0) {
+            bounded = false;
+            continue;
+        }
+        glm::vec3 scale = glm::abs(children[i]->getScale());
+        r *= maxf(scale.x, maxf(scale.y, scale.z));
+        newRadius = maxf(newRadius, glm::length(children[i]->getLocation()) + r);
+    }
+
+    // containers without bounds, or with children we can not bound, keep the radius they were given.
+    if (boundingSphereRadius > 0 && bounded && children.size() > 0) {
+        boundingSphereRadius = newRadius;
+    }
+
+    // the hierarchy keeps its shape, only its boxes move.  It is built again only if the objects in it changed.
+    if (bvh) {
+        vector<BVHObject> objects;
+        getBVHObjects(objects);
+        if (!bvh->refit(objects)) buildBVH();
+    }
+}
+
+void ContainerObject::getBVHObjects(vector<BVHObject>& objects)
+{
+    for (int i = 0; i < (int)children.size(); i++) {
+        BVHObject object;
+        object.object = children[i];
+        object.offset = glm::vec3(0, 0, 0);
+        objects.push_back(object);
+    }
+}
+
+void ContainerObject::buildBVH()
+{
+    delete bvh;
+    bvh = NULL;
+    if (acceleration == ACCEL_SPHERES) return;
+
+    vector<BVHObject> objects;
+    getBVHObjects(objects);
+    if ((int)objects.size() < BVH_MIN_OBJECTS) return;
+    bvh = new WideBVH(objects, getAccelerationWidth(acceleration), getAccelerationBits(acceleration), bvhBuilder);
+}
+
+void ContainerObject::setAcceleration(Acceleration acceleration)
+{
+    vector<ContainerObject*> builds;
+    setAcceleration(acceleration, builds);
+
+    // each container's hierarchy is over its own children, so they do not depend on each other.  Large builds
+    // share the pool again from within, for their top levels and subtrees.
+    ThreadPool::global().parallelFor((int)builds.size(), 1, [&builds](int start, int end) {
+        for (int i = start; i < end; i++) {
+            builds[i]->buildBVH();
+        }
+    });
+}
+
+void ContainerObject::setAcceleration(Acceleration acceleration, vector<ContainerObject*>& builds)
+{
+    // objects can be shared (see ReferenceObject), so may be reached more than once.
+    if (acceleration == this->acceleration) return;
+    this->acceleration = acceleration;
+
+    for (int i = 0; i < (int)children.size(); i++) {
+        children[i]->setAcceleration(acceleration, builds);
+    }
+    builds.push_back(this);
+}
@@ -9,6 +9,8 @@
 #pragma once
 
 #include "SceneObject.h"
+#include "WideBVH.h"
+#include "Trace.h"
 
 #include <glm/glm.hpp>
 #include <vector>
@@ -32,6 +34,18 @@ public:
         if (didCollide) ray->collision.target = this;
         return didCollide;
     }
+
+    int intersectObjectPacket(RayPacket& packet, int mask) override {
+        int hits = this->reference->intersectPacket(packet, mask);
+        for (int i = 0; i < packet.count; i++) {
+            if (hits & (1 << i)) packet.rays[i]->collision.target = this;
+        }
+        return hits;
+    }
+
+    void setAcceleration(Acceleration acceleration, vector<ContainerObject*>& builds) override {
+        reference->setAcceleration(acceleration, builds);
+    }
 };
 
 class ContainerObject : public SceneObject
@@ -39,21 +53,57 @@ class ContainerObject : public SceneObject
 protected:
     vector<SceneObject*> children = vector<SceneObject*>();
 
+    // hierarchy over the children when using a BVH, NULL when using bounding spheres or there are only a few children.
+    WideBVH* bvh = NULL;
+    Acceleration acceleration = ACCEL_SPHERES;
+
+    /** Adds the objects to build the BVH over to objects, which are the children unless overridden. */
+    virtual void getBVHObjects(vector<BVHObject>& objects);
+
+    /** Builds the BVH for the current acceleration, replacing any previous one. */
+    void buildBVH();
+
+    /** Tests ray against the bounding sphere, returns false if it can not hit any of the children.  t is set to the
+     * distance to the sphere, or 0 if the ray starts inside it or there is no sphere. */
+    bool intersectBounds(Ray* ray, float& t);
+
+    /** Reports a hit on one of the children as a hit on this container if it uses the containers material. */
+    void applyContainerMaterial(Ray* ray);
+
 public:	
 	ContainerObject(glm::vec3 location = glm::vec3()) : SceneObject(location)
     {
 
     }
 
+    /** Deletes the children along with the container.  Objects only used through a ReferenceObject, and materials,
+     * may be shared so are not deleted. */
+    ~ContainerObject()
+    {
+        delete bvh;
+        for (int i = 0; i < (int)children.size(); i++) {
+            delete children[i];
+        }
+    }
+
     bool showBounds = false;
     bool useContainerMaterial = false;
 
+    // how the BVH is built.  Containers rebuilt every frame may want a faster builder than the default.
+    BVHBuilder bvhBuilder = BVH_BUILD_SAH;
+
     /** Adds object to container. */
     virtual void add(SceneObject* object);
 
     /** Intersects ray with object. */
 	bool intersectObject(Ray* ray) override; 
 
+    /** Intersects a packet of rays, tracing them together through the BVH if there is one. */
+    int intersectObjectPacket(RayPacket& packet, int mask) override;
+
+    /** Returns objects in this container. */
+    const vector<SceneObject*>& getChildren() { return children; }
+
     /** Sets material for all child objects. */
     void setChildrenMaterial(Material* material)
     {
@@ -63,6 +113,16 @@ public:
         }
     }
 
+    /** Builds a BVH over the children of this container and the containers within it, or goes back to testing
+     * each childs bounding sphere.  The containers are built at the same time on the thread pool. */
+    void setAcceleration(Acceleration acceleration);
+
+    void setAcceleration(Acceleration acceleration, vector<ContainerObject*>& builds) override;
+
+    /** Updates the bounding spheres of this container and the containers below it after objects have moved.  The
+     * hierarchy itself is kept as it is, only the radii (and the boxes of any BVH) change. */
+    virtual void refit();
+
     /** Calculate radius based on objects within the group */
     void autoRadius() 
     {
@@ -86,6 +146,7 @@ public:
      * */
     void cluster(bool recurse=true, float CLUSTER_RADIUS = 3.0f)
     {
+        TRACE_ZONE("cluster");
 
         // maximum number of objects per cluster.
         int MAX_OBJECTS = 8;
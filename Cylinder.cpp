@@ -5,6 +5,8 @@
 
 bool Cylinder::intersectObject(Ray* ray)
 {    
+    RAY_COUNT_TESTS(ray, primitiveTests, 1);
+
     // we project everything down onto the xz plane and do a circle intersection test.
     // this gives us two points of intersection.
     // we then test the cylinder caps by intersecting two planes and checking them.    
@@ -0,0 +1,144 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Edge avoiding a-trous denoiser.
+-------------------------------------------------------------*/
+
+#include "Denoiser.h"
+#include "Utils.h"
+#include "ThreadPool.h"
+
+#include <vector>
+#include <math.h>
+
+// B3 spline kernel, applied separably.
+static const float KERNEL[5] = {1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16};
+
+float Denoiser::spatialVariance(int width, int height, int p, const Color* irradiance, const PixelFeatures* features)
+{
+    const int RADIUS = 2;
+    int x = p % width;
+    int y = p / width;
+
+    float sum = 0;
+    float sum2 = 0;
+    float weightSum = 0;
+    for (int qy = y - RADIUS; qy <= y + RADIUS; qy++) {
+        if (qy < 0 || qy >= height) continue;
+        for (int qx = x - RADIUS; qx <= x + RADIUS; qx++) {
+            if (qx < 0 || qx >= width) continue;
+            int q = qy * width + qx;
+            if ((features[q].depth < 0) != (features[p].depth < 0)) continue;
+            float weight = pow(maxf(glm::dot(features[p].normal, features[q].normal), 0.0f), SIGMA_NORMAL);
+            if (features[p].depth < 0) weight = 1;
+            float l = luminance(irradiance[q]);
+            sum += weight * l;
+            sum2 += weight * l * l;
+            weightSum += weight;
+        }
+    }
+
+    if (weightSum <= 0) return 0;
+    float mean = sum / weightSum;
+    return maxf(sum2 / weightSum - mean * mean, 0.0f);
+}
+
+void Denoiser::apply(int width, int height, const Color* color, const float* variance, const PixelFeatures* features, Color* output)
+{
+    int n = width * height;
+
+    std::vector<Color> albedo(n);
+    std::vector<Color> irradiance(n);
+    std::vector<Color> irradianceTemp(n);
+    std::vector<float> irradianceVariance(n);
+    std::vector<float> irradianceVarianceTemp(n);
+
+    ThreadPool& pool = ThreadPool::global();
+
+    // remove the surface texture, so we only filter the lighting.
+    pool.parallelFor(n, 4096, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            Color a = (features[i].depth < 0) ? Color(1,1,1,1) : features[i].albedo;
+            a = Color(maxf(a.r, MIN_ALBEDO), maxf(a.g, MIN_ALBEDO), maxf(a.b, MIN_ALBEDO), 1);
+            float l = maxf(luminance(a), MIN_ALBEDO);
+            albedo[i] = a;
+            irradiance[i] = Color(color[i].r / a.r, color[i].g / a.g, color[i].b / a.b, 1);
+            irradianceVariance[i] = variance[i] / (l * l);
+        }
+    });
+
+    // progressive frames may have too few samples to know the variance, so fall back to a spatial estimate.
+    pool.parallelFor(n, 4096, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            if (variance[i] < 0) irradianceVariance[i] = spatialVariance(width, height, i, &irradiance[0], features);
+        }
+    });
+
+    for (int iteration = 0; iteration < ITERATIONS; iteration++) {
+        int step = 1 << iteration;
+
+        pool.parallelFor(height, 8, [&](int startRow, int endRow) {
+            for (int y = startRow; y < endRow; y++) {
+                for (int x = 0; x < width; x++) {
+                    int p = y * width + x;
+                    const PixelFeatures& fp = features[p];
+
+                    if (fp.depth < 0) {
+                        // the background is not noisy.
+                        irradianceTemp[p] = irradiance[p];
+                        irradianceVarianceTemp[p] = irradianceVariance[p];
+                        continue;
+                    }
+
+                    float lp = luminance(irradiance[p]);
+                    float colorScale = SIGMA_COLOR * sqrt(irradianceVariance[p]) + 0.0001f;
+                    float depthScale = SIGMA_DEPTH * fp.depth * step + 0.0001f;
+
+                    Color sum = Color(0,0,0,0);
+                    float varianceSum = 0;
+                    float weightSum = 0;
+
+                    for (int dy = -2; dy <= 2; dy++) {
+                        int qy = y + dy * step;
+                        if (qy < 0 || qy >= height) continue;
+                        for (int dx = -2; dx <= 2; dx++) {
+                            int qx = x + dx * step;
+                            if (qx < 0 || qx >= width) continue;
+                            int q = qy * width + qx;
+                            const PixelFeatures& fq = features[q];
+                            if (fq.depth < 0) continue;
+
+                            float normalWeight = pow(maxf(glm::dot(fp.normal, fq.normal), 0.0f), SIGMA_NORMAL);
+                            float depthWeight = exp(-fabs(fp.depth - fq.depth) / depthScale);
+                            float colorWeight = exp(-fabs(lp - luminance(irradiance[q])) / colorScale);
+                            float weight = KERNEL[dx + 2] * KERNEL[dy + 2] * normalWeight * depthWeight * colorWeight;
+
+                            sum += irradiance[q] * weight;
+                            varianceSum += irradianceVariance[q] * weight * weight;
+                            weightSum += weight;
+                        }
+                    }
+
+                    if (weightSum <= 0) {
+                        irradianceTemp[p] = irradiance[p];
+                        irradianceVarianceTemp[p] = irradianceVariance[p];
+                        continue;
+                    }
+
+                    irradianceTemp[p] = sum / weightSum;
+                    irradianceVarianceTemp[p] = varianceSum / (weightSum * weightSum);
+                }
+            }
+        });
+
+        irradiance.swap(irradianceTemp);
+        irradianceVariance.swap(irradianceVarianceTemp);
+    }
+
+    // put the texture back.
+    pool.parallelFor(n, 4096, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            output[i] = Color(irradiance[i].r * albedo[i].r, irradiance[i].g * albedo[i].g, irradiance[i].b * albedo[i].b, 1);
+        }
+    });
+}
@@ -0,0 +1,70 @@
+/**
+ * Denoiser.
+ *
+ * Edge avoiding a-trous wavelet filter (Dammertz et al. 2010, with the variance guided colour weight from SVGF).  The
+ * filter repeatedly blurs the image with a sparse 5x5 kernel whose taps are spaced further apart each iteration, and
+ * stops the blur from crossing edges by comparing first hit albedo, normal and depth of the pixels.
+ *
+ * Lighting is filtered separately from the surface texture: the colour is divided by the albedo before filtering and
+ * multiplied back afterwards, so texture detail is kept sharp while the noisy lighting is smoothed.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Color.h"
+
+/** Information about the first surface seen through a pixel, used to guide the denoiser and written out as extra
+ * image layers (AOVs). */
+struct PixelFeatures
+{
+    // diffuse color of the surface.
+    Color albedo = Color(0,0,0,1);
+
+    // surface normal (in world space).
+    glm::vec3 normal = glm::vec3(0,0,0);
+
+    // distance from camera, or -1 if the pixel sees the background.
+    float depth = 0;
+
+    // location of the hit in world space, and in the space of the object that was hit.
+    glm::vec3 position = glm::vec3(0,0,0);
+    glm::vec3 local = glm::vec3(0,0,0);
+
+    // texture coordinates of the hit.
+    glm::vec2 uv = glm::vec2(0,0);
+};
+
+class Denoiser
+{
+protected:
+    /** Estimates variance of pixel p from its neighbours on the same surface. */
+    float spatialVariance(int width, int height, int p, const Color* irradiance, const PixelFeatures* features);
+
+public:
+
+    // number of filter iterations, each one doubles the filters radius.
+    int ITERATIONS = 5;
+
+    // how strongly to avoid blurring across different colors, in terms of the pixels standard deviation.
+    float SIGMA_COLOR = 4.0f;
+
+    // how strongly to avoid blurring across different normals, higher is sharper.
+    float SIGMA_NORMAL = 64.0f;
+
+    // how strongly to avoid blurring across different depths, as a fraction of the pixels depth.
+    float SIGMA_DEPTH = 0.05f;
+
+    // smallest albedo we will divide by.
+    float MIN_ALBEDO = 0.01f;
+
+    /**
+     * Denoises an image.
+     * @param color the noisy image.
+     * @param variance estimated variance of each pixels luminance, or < 0 if unknown.
+     * @param features first hit albedo, normal and depth of each pixel.
+     * @param output receives the denoised image, may not be the same buffer as color.
+     */
+    void apply(int width, int height, const Color* color, const float* variance, const PixelFeatures* features, Color* output);
+};
@@ -0,0 +1,259 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Coordinator and workers for rendering across processes.
+-------------------------------------------------------------*/
+
+#include "DistributedRender.h"
+#include "SceneLibrary.h"
+#include "Socket.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+enum MessageType {
+    // coordinator -> worker: the jobs options.
+    MSG_JOB = 1,
+    // coordinator -> worker: pass index, first row, number of rows, then the mask of pixels to sample.
+    MSG_BAND,
+    // worker -> coordinator: number of pixels sampled, then the packed samples for the band.
+    MSG_SAMPLES,
+    // coordinator -> worker: the job is finished.
+    MSG_STOP
+};
+
+// rows per band.  Small bands balance better between workers, but every band costs a round trip.
+static const int BAND_ROWS = 8;
+
+// how long workers keep trying to reach the coordinator before giving up.
+static const int CONNECT_ATTEMPTS = 30;
+
+// ------------------------------------------------------------
+// Coordinator
+// ------------------------------------------------------------
+
+/** State shared between the coordinators pass loop and its connections to workers. */
+struct Coordinator
+{
+    Camera* camera;
+    std::vector<std::string> args;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // bands of the current pass waiting for a worker.
+    std::deque<int> pendingBands;
+    int bandsRemaining = 0;
+    int sampledPixels = 0;
+    int passIndex = 0;
+    int workers = 0;
+    bool stopping = false;
+
+    /** Handles one worker until the job finishes or the worker disconnects. */
+    void serveWorker(Socket connection, int id);
+};
+
+void Coordinator::serveWorker(Socket connection, int id)
+{
+    bool connected = connection.sendInt(MSG_JOB) && connection.sendInt((int32_t)args.size());
+    for (int i = 0; connected && i < (int)args.size(); i++) {
+        connected = connection.sendBlock(std::vector<char>(args[i].begin(), args[i].end()));
+    }
+
+    Framebuffer& framebuffer = camera->framebuffer;
+    int width = framebuffer.getWidth();
+    std::vector<char> mask;
+    std::vector<char> samples;
+
+    while (connected) {
+        int band, pass;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() { return stopping || !pendingBands.empty(); });
+            if (pendingBands.empty()) break;
+            band = pendingBands.front();
+            pendingBands.pop_front();
+            pass = passIndex;
+        }
+
+        int y = band * BAND_ROWS;
+        int rows = std::min(BAND_ROWS, framebuffer.getHeight() - y);
+
+        // bands are only ever merged by the connection that rendered them, so reading our own rows here is safe.
+        mask.resize(rows * width);
+        for (int i = 0; i < rows * width; i++) {
+            mask[i] = camera->needsSamples(i % width, y + i / width) ? 1 : 0;
+        }
+
+        int32_t reply, sampled;
+        connected = connection.sendInt(MSG_BAND) && connection.sendInt(pass) && connection.sendInt(y) &&
+            connection.sendInt(rows) && connection.sendBlock(mask) &&
+            connection.receiveInt(reply) && reply == MSG_SAMPLES && connection.receiveInt(sampled) &&
+            connection.receiveBlock(samples) && framebuffer.mergeRows(y, rows, samples);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (connected) {
+            sampledPixels += sampled;
+            bandsRemaining--;
+        } else {
+            // give the band to someone else.
+            pendingBands.push_front(band);
+        }
+        changed.notify_all();
+    }
+
+    if (connected) {
+        connection.sendInt(MSG_STOP);
+    } else {
+        printf("Worker %d disconnected.\n", id);
+    }
+    connection.close();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    workers--;
+}
+
+int renderDistributed(Scene* scene, Camera* camera, RenderJob& job, std::vector<std::string>& args, int port)
+{
+    Socket listener;
+    if (!listener.listen(port)) return -1;
+
+    Coordinator coordinator;
+    coordinator.camera = camera;
+    coordinator.args = args;
+
+    // accept workers for as long as the job is running.
+    std::vector<std::thread> connections;
+    std::thread acceptThread([&]() {
+        int nextId = 1;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(coordinator.mutex);
+                if (coordinator.stopping) return;
+            }
+            Socket connection = listener.accept(250);
+            if (!connection.isOpen()) continue;
+
+            std::lock_guard<std::mutex> lock(coordinator.mutex);
+            int id = nextId++;
+            coordinator.workers++;
+            printf("Worker %d connected (%d workers).\n", id, coordinator.workers);
+            connections.push_back(std::thread(&Coordinator::serveWorker, &coordinator, connection, id));
+        }
+    });
+
+    printf("Waiting for workers on port %d.\n", port);
+
+    PassRenderer renderPass = [&](Scene*, Camera* camera) {
+        int bands = (camera->framebuffer.getHeight() + BAND_ROWS - 1) / BAND_ROWS;
+        std::unique_lock<std::mutex> lock(coordinator.mutex);
+        coordinator.passIndex = camera->getPassIndex();
+        coordinator.sampledPixels = 0;
+        coordinator.bandsRemaining = bands;
+        for (int i = 0; i < bands; i++) {
+            coordinator.pendingBands.push_back(i);
+        }
+        coordinator.changed.notify_all();
+        coordinator.changed.wait(lock, [&]() { return coordinator.bandsRemaining == 0; });
+        return coordinator.sampledPixels;
+    };
+
+    int passes = renderJob(scene, camera, job, renderPass);
+
+    {
+        std::lock_guard<std::mutex> lock(coordinator.mutex);
+        coordinator.stopping = true;
+        coordinator.changed.notify_all();
+    }
+    acceptThread.join();
+    for (int i = 0; i < (int)connections.size(); i++) {
+        connections[i].join();
+    }
+    listener.close();
+
+    return passes;
+}
+
+// ------------------------------------------------------------
+// Worker
+// ------------------------------------------------------------
+
+bool runRenderWorker(std::string host, int port)
+{
+    Socket connection;
+    for (int attempt = 0; !connection.connect(host, port); attempt++) {
+        if (attempt + 1 >= CONNECT_ATTEMPTS) {
+            printf("Error, can not connect to %s:%d.\n", host.c_str(), port);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    int32_t type, count;
+    if (!connection.receiveInt(type) || type != MSG_JOB || !connection.receiveInt(count) || count < 0) {
+        printf("Error, coordinator did not send a job.\n");
+        return false;
+    }
+    std::vector<std::string> args;
+    for (int i = 0; i < count; i++) {
+        std::vector<char> arg;
+        if (!connection.receiveBlock(arg)) return false;
+        args.push_back(std::string(arg.begin(), arg.end()));
+    }
+
+    RenderJob job;
+    std::string error;
+    if (!parseRenderJob(args, job, error)) {
+        printf("Error, invalid job from coordinator: %s\n", error.c_str());
+        return false;
+    }
+
+    Scene* scene = createScene(findScene(job.scene));
+    scene->load(job.acceleration);
+    Camera* camera = scene->camera;
+    setupRenderCamera(camera, job);
+
+    Framebuffer& framebuffer = camera->framebuffer;
+    int width = framebuffer.getWidth();
+    printf("Rendering %s (%dx%d) for %s:%d.\n", job.scene.c_str(), job.width, job.height, host.c_str(), port);
+
+    std::vector<char> mask;
+    std::vector<char> samples;
+    int bands = 0;
+    while (true) {
+        if (!connection.receiveInt(type)) {
+            printf("Lost connection to coordinator.\n");
+            return false;
+        }
+        if (type == MSG_STOP) break;
+
+        int32_t pass, y, rows;
+        if (type != MSG_BAND || !connection.receiveInt(pass) || !connection.receiveInt(y) ||
+            !connection.receiveInt(rows) || !connection.receiveBlock(mask) ||
+            y < 0 || rows <= 0 || y + rows > framebuffer.getHeight() || (int)mask.size() != rows * width) {
+            printf("Error, invalid message from coordinator.\n");
+            return false;
+        }
+
+        // start each band from empty rows so only the new samples are sent back.  packRows only reads these rows, so
+        // the rest of the framebuffer is left alone.
+        framebuffer.clearRows(y, rows);
+        camera->setPassIndex(pass);
+        int sampled = camera->renderPixels(scene, y * width, rows * width, (const uint8_t*)&mask[0]);
+        framebuffer.packRows(y, rows, samples);
+
+        if (!connection.sendInt(MSG_SAMPLES) || !connection.sendInt(sampled) || !connection.sendBlock(samples)) {
+            printf("Lost connection to coordinator.\n");
+            return false;
+        }
+        bands++;
+    }
+
+    printf("Job finished, rendered %d bands.\n", bands);
+    connection.close();
+    return true;
+}
@@ -0,0 +1,28 @@
+/**
+ * Distributed rendering.
+ *
+ * Splits each pass of a render job across worker processes, which may be on other machines.  The coordinator
+ * listens on a port, sends every worker that connects the job (scenes are built in code, so the scene name and job
+ * options are the whole scene description), then hands out bands of rows.  For each band the coordinator also sends
+ * which pixels adaptive sampling still wants sampled.  The worker renders the band into an empty framebuffer and
+ * returns its weighted sample sums, which the coordinator adds to its own framebuffer.
+ *
+ * Samples are chosen by pixel and pass index alone, so the image matches a local render regardless of how many
+ * workers took part.  Workers can join or leave at any time; a band being rendered by a worker that disconnects is
+ * handed to another worker.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "RenderJob.h"
+
+/** Renders job as the coordinator, listening on port for workers.  args are the jobs command line options, which
+ * are forwarded to the workers.  Returns the number of passes rendered, or -1 on failure. */
+int renderDistributed(Scene* scene, Camera* camera, RenderJob& job, std::vector<std::string>& args, int port);
+
+/** Connects to the coordinator at host:port and renders bands until the job is finished.  Returns false if the
+ * connection or job failed. */
+bool runRenderWorker(std::string host, int port);
@@ -370,8 +370,15 @@ public:
 // --------------------------------------------------------------------
 class ManyDragonsScene : public Scene
 {    
+    // only used through references, so it is not one of the scenes children and is deleted here instead.
+    Mesh* dragon = NULL;
+
 public:
 
+    ~ManyDragonsScene() {
+        delete dragon;
+    }
+
     void loadScene() override {
     
         name = "ManyDragons";
@@ -387,10 +394,10 @@ public:
         add(plane); 
 
         // mesh objects...
-        vector<glm::vec3>* dragonMesh = ReadPLY("./dragon.ply", 10.0f);
+        const vector<glm::vec3>* dragonMesh = ReadPLY("./dragon.ply");
 
         // base dragon
-        Mesh* dragon = new Mesh(glm::vec3(0,0,0), dragonMesh);    
+        dragon = new Mesh(glm::vec3(0,0,0), dragonMesh, 10.0f);    
         //Sphere* dragon = new Sphere(glm::vec3(0,1.0,0),0.5); 
         //Cube* dragon = new Cube(glm::vec3(0,1,0),glm::vec3(0.5)); 
 
@@ -486,7 +493,7 @@ public:
         add(plane); 
         
         // our high res mesh
-        Mesh* mesh = new Mesh(glm::vec3(0,0,0), ReadPLY("./dragon.ply", 20.0f));    
+        Mesh* mesh = new Mesh(glm::vec3(0,0,0), ReadPLY("./dragon.ply"), 20.0f);    
         mesh->setLocation(glm::vec3(0,-1,-7.5));        
         add(mesh); 
         
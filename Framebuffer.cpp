@@ -0,0 +1,380 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Framebuffer for accumulating samples.
+-------------------------------------------------------------*/
+
+#include "Framebuffer.h"
+#include "TGAWriter.h"
+#include "HDRWriter.h"
+#include "Trace.h"
+
+#include <string.h>
+
+Framebuffer::Framebuffer(int width, int height)
+{
+    resize(width, height);
+}
+
+void Framebuffer::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    image.assign(width*height, 0);
+    sampleBuffer.assign(width*height, Color(0,0,0,0));
+    statsBuffer.assign(width*height, PixelStats());
+    featureBuffer.assign(width*height, PixelFeatures());
+    clear();
+}
+
+/** Returns if (x,y) is in screen bounds or not. */
+bool Framebuffer::inBounds(int x, int y) {
+	return ((x >= 0) && (y >= 0) && (x < width) && (y < height));
+}
+
+/** Place a pixel on the frame buffer.
+ * If shallow is true then only the image is updated, not the sample buffer.
+ * This allows writing to the image without destroying the sample buffer.
+ */
+void Framebuffer::putPixel(int x, int y, Color col, bool shallow)
+{
+    if (!inBounds(x,y)) return;
+    if (shallow) {
+        image[y*width + x] = colorToInt24(col);
+    } else {
+	    sampleBuffer[y*width+x] = Color(0,0,0,0);
+        statsBuffer[y*width+x] = PixelStats();
+        featureBuffer[y*width+x] = PixelFeatures();
+        featureBuffer[y*width+x].albedo = Color(0,0,0,0);
+        addSample(x,y,col);
+    }
+}
+
+
+/** Sets image to sample buffer. */
+void Framebuffer::updateImage()
+{
+    TRACE_ZONE("resolve");
+    if (denoise) {
+        updateDenoisedImage();
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+            {
+                image[y*width + x] = colorToInt24(sampleBuffer[y*width + x] / sampleBuffer[y*width + x].a);
+            }
+        }
+    }
+}
+
+/** Runs the denoiser over the sample buffer and writes the result to the image. */
+void Framebuffer::updateDenoisedImage()
+{
+    std::vector<Color> output;
+    getDenoisedColors(output);
+    for (int i = 0; i < width * height; i++) {
+        image[i] = colorToInt24(output[i]);
+    }
+}
+
+void Framebuffer::getDenoisedColors(std::vector<Color>& output)
+{
+    TRACE_ZONE("denoise");
+    int n = width * height;
+    std::vector<Color> color(n);
+    std::vector<float> variance(n);
+    std::vector<PixelFeatures> features(n);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = y*width + x;
+            float weight = sampleBuffer[i].a;
+            color[i] = (weight > 0) ? sampleBuffer[i] / weight : Color(0,0,0,1);
+            // with too few samples the variance is unknown and the denoiser will estimate it from the neighbourhood.
+            variance[i] = (getEffectiveSamples(x, y) >= 2) ? getVariance(x, y) : -1;
+
+            float hitWeight = featureBuffer[i].albedo.a;
+            if (hitWeight > 0) {
+                features[i].albedo = Color(glm::vec3(featureBuffer[i].albedo) / hitWeight, 1);
+                float normalLength = glm::length(featureBuffer[i].normal);
+                features[i].normal = (normalLength > 0) ? featureBuffer[i].normal / normalLength : glm::vec3(0,0,0);
+                features[i].depth = featureBuffer[i].depth / hitWeight;
+            } else {
+                features[i].depth = -1;
+            }
+        }
+    }
+
+    output.resize(n);
+    denoiser.apply(width, height, &color[0], &variance[0], &features[0], &output[0]);
+}
+
+void Framebuffer::getColors(std::vector<float>& rgb)
+{
+    int n = width * height;
+    std::vector<Color> denoised;
+    if (denoise) getDenoisedColors(denoised);
+
+    rgb.resize(n * 3);
+    for (int i = 0; i < n; i++) {
+        float weight = sampleBuffer[i].a;
+        Color color = denoise ? denoised[i] : (weight > 0 ? sampleBuffer[i] / weight : Color(0,0,0,1));
+        rgb[i*3+0] = color.r;
+        rgb[i*3+1] = color.g;
+        rgb[i*3+2] = color.b;
+    }
+}
+
+/** Adds a simple to the buffer, samples are averaged by weight. */
+void Framebuffer::addSample(int x, int y, Color col, float weight, int samples)
+{
+	if (!inBounds(x,y) || weight == 0.0f) return;
+	col.a = 1.0f;
+    sampleBuffer[y*width + x] += (col*weight);
+    float l = luminance(col);
+    statsBuffer[y*width + x].luminance2 += weight * l * l;
+    statsBuffer[y*width + x].weight2 += weight * weight;
+    statsBuffer[y*width + x].samples += samples;
+	image[y*width + x] = colorToInt24(sampleBuffer[y*width + x] / sampleBuffer[y*width + x].a);
+}
+
+void Framebuffer::addFeatures(int x, int y, PixelFeatures features, float weight)
+{
+    if (!inBounds(x,y) || weight == 0.0f || features.depth < 0) return;
+    PixelFeatures& sum = featureBuffer[y*width + x];
+    sum.albedo += Color(glm::vec3(features.albedo) * weight, weight);
+    sum.normal += features.normal * weight;
+    sum.depth += features.depth * weight;
+    sum.position += features.position * weight;
+    sum.local += features.local * weight;
+    sum.uv += features.uv * weight;
+}
+
+void Framebuffer::clear(Color col, bool shallow)
+{
+    clearRows(0, height, col, shallow);
+}
+
+void Framebuffer::clearRows(int y, int rows, Color col, bool shallow)
+{
+    col.a = 0.0;
+	uint32_t c = colorToInt24(col);
+	for (int i = y * width; i < (y + rows) * width; i++) {
+        if (!shallow)
+            image[i] = c;
+        sampleBuffer[i] = col;
+        statsBuffer[i] = PixelStats();
+        featureBuffer[i] = PixelFeatures();
+        featureBuffer[i].albedo = Color(0,0,0,0);
+	}
+}
+
+/** Samples are weighted, so the effective number of samples is (sum w)^2 / sum w^2. */
+float Framebuffer::getEffectiveSamples(int x, int y)
+{
+    if (!inBounds(x,y)) return 0;
+    float weight = sampleBuffer[y*width + x].a;
+    float weight2 = statsBuffer[y*width + x].weight2;
+    return (weight2 > 0) ? (weight * weight) / weight2 : 0;
+}
+
+float Framebuffer::getSamples(int x, int y)
+{
+    if (!inBounds(x,y)) return 0;
+    return statsBuffer[y*width + x].samples;
+}
+
+float Framebuffer::getVariance(int x, int y)
+{
+    if (!inBounds(x,y)) return 0;
+
+    float weight = sampleBuffer[y*width + x].a;
+    float samples = getEffectiveSamples(x, y);
+    if (weight <= 0 || samples <= 0) return INFINITY;
+
+    float mean = luminance(sampleBuffer[y*width + x] / weight);
+    float variance = maxf(statsBuffer[y*width + x].luminance2 / weight - mean * mean, 0.0f);
+    return variance / samples;
+}
+
+float Framebuffer::getError(int x, int y)
+{
+    if (!inBounds(x,y)) return 0;
+
+    float weight = sampleBuffer[y*width + x].a;
+    if (weight <= 0) return INFINITY;
+
+    float mean = luminance(sampleBuffer[y*width + x] / weight);
+
+    // dark pixels would never converge on a purely relative error, so don't let the divisor get too small.
+    return sqrt(getVariance(x, y)) / maxf(mean, 0.05f);
+}
+
+void Framebuffer::getChannels(std::vector<HDRChannel>& channels)
+{
+    const char* names[] = {
+        "R", "G", "B", "A",
+        "albedo.R", "albedo.G", "albedo.B",
+        "N.X", "N.Y", "N.Z",
+        "Z",
+        "P.X", "P.Y", "P.Z",
+        "local.X", "local.Y", "local.Z",
+        "uv.U", "uv.V",
+        "samples"
+    };
+    const int count = sizeof(names) / sizeof(names[0]);
+    int n = width * height;
+
+    channels.resize(count);
+    for (int c = 0; c < count; c++) {
+        channels[c].name = names[c];
+        channels[c].data.assign(n, 0.0f);
+    }
+
+    std::vector<float> rgb;
+    getColors(rgb);
+
+    for (int i = 0; i < n; i++) {
+        float weight = sampleBuffer[i].a;
+        PixelFeatures& sum = featureBuffer[i];
+        float hitWeight = sum.albedo.a;
+
+        float values[count] = {0};
+        values[0] = rgb[i*3+0];
+        values[1] = rgb[i*3+1];
+        values[2] = rgb[i*3+2];
+        values[3] = (weight > 0) ? hitWeight / weight : 0;
+
+        // pixels that only saw the background have no features, so their AOVs are left at 0.
+        if (hitWeight > 0) {
+            glm::vec3 albedo = glm::vec3(sum.albedo) / hitWeight;
+            float normalLength = glm::length(sum.normal);
+            glm::vec3 normal = (normalLength > 0) ? sum.normal / normalLength : glm::vec3(0,0,0);
+            glm::vec3 position = sum.position / hitWeight;
+            glm::vec3 local = sum.local / hitWeight;
+            glm::vec2 uv = sum.uv / hitWeight;
+            float aovs[] = {
+                albedo.x, albedo.y, albedo.z,
+                normal.x, normal.y, normal.z,
+                sum.depth / hitWeight,
+                position.x, position.y, position.z,
+                local.x, local.y, local.z,
+                uv.x, uv.y
+            };
+            for (int c = 0; c < (int)(sizeof(aovs) / sizeof(aovs[0])); c++) {
+                values[4 + c] = aovs[c];
+            }
+        }
+        values[count - 1] = statsBuffer[i].samples;
+
+        for (int c = 0; c < count; c++) {
+            channels[c].data[i] = values[c];
+        }
+    }
+}
+
+std::string Framebuffer::getAOVFilename(std::string filename)
+{
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return filename + "_aovs.exr";
+    std::string extension = filename.substr(dot);
+    if (extension == ".exr" || extension == ".EXR") return filename;
+    return filename.substr(0, dot) + "_aovs.exr";
+}
+
+bool Framebuffer::save(std::string filename)
+{
+    TRACE_ZONE("save image");
+    printf("Saving screenshot %s\n", filename.c_str());
+    if (aovs) {
+        std::vector<HDRChannel> channels;
+        getChannels(channels);
+        std::string aovFilename = getAOVFilename(filename);
+        bool success = write_exr_channels(aovFilename, channels, width, height);
+        // EXR files hold the image along with the AOVs.
+        if (aovFilename == filename) return success;
+        if (!success) return false;
+    }
+    if (is_hdr_filename(filename)) {
+        std::vector<float> rgb;
+        getColors(rgb);
+        return write_hdr(filename, &rgb[0], width, height);
+    }
+    updateImage();
+    return write_truecolor_tga(filename, &image[0], width, height);
+}
+
+bool Framebuffer::writeSamples(std::ostream& stream)
+{
+    int32_t size[2] = {width, height};
+    stream.write((const char*)size, sizeof(size));
+    stream.write((const char*)&sampleBuffer[0], sampleBuffer.size() * sizeof(Color));
+    stream.write((const char*)&statsBuffer[0], statsBuffer.size() * sizeof(PixelStats));
+    stream.write((const char*)&featureBuffer[0], featureBuffer.size() * sizeof(PixelFeatures));
+    return stream.good();
+}
+
+bool Framebuffer::readSamples(std::istream& stream)
+{
+    int32_t size[2];
+    stream.read((char*)size, sizeof(size));
+    if (!stream || size[0] != width || size[1] != height) return false;
+
+    std::vector<Color> samples(width*height);
+    std::vector<PixelStats> stats(width*height);
+    std::vector<PixelFeatures> features(width*height);
+    stream.read((char*)&samples[0], samples.size() * sizeof(Color));
+    stream.read((char*)&stats[0], stats.size() * sizeof(PixelStats));
+    stream.read((char*)&features[0], features.size() * sizeof(PixelFeatures));
+    if (!stream) return false;
+
+    sampleBuffer.swap(samples);
+    statsBuffer.swap(stats);
+    featureBuffer.swap(features);
+    updateImage();
+    return true;
+}
+
+void Framebuffer::packRows(int y, int rows, std::vector<char>& data)
+{
+    int first = y * width;
+    int n = rows * width;
+    data.resize(n * (sizeof(Color) + sizeof(PixelStats) + sizeof(PixelFeatures)));
+    char* p = &data[0];
+    memcpy(p, &sampleBuffer[first], n * sizeof(Color));
+    p += n * sizeof(Color);
+    memcpy(p, &statsBuffer[first], n * sizeof(PixelStats));
+    p += n * sizeof(PixelStats);
+    memcpy(p, &featureBuffer[first], n * sizeof(PixelFeatures));
+}
+
+bool Framebuffer::mergeRows(int y, int rows, const std::vector<char>& data)
+{
+    if (y < 0 || rows < 0 || y + rows > height) return false;
+    int first = y * width;
+    int n = rows * width;
+    if (data.size() != n * (sizeof(Color) + sizeof(PixelStats) + sizeof(PixelFeatures))) return false;
+
+    const Color* samples = (const Color*)&data[0];
+    const PixelStats* stats = (const PixelStats*)(samples + n);
+    const PixelFeatures* features = (const PixelFeatures*)(stats + n);
+
+    for (int i = 0; i < n; i++) {
+        Color& sample = sampleBuffer[first + i];
+        sample += samples[i];
+        statsBuffer[first + i].luminance2 += stats[i].luminance2;
+        statsBuffer[first + i].weight2 += stats[i].weight2;
+        statsBuffer[first + i].samples += stats[i].samples;
+        featureBuffer[first + i].albedo += features[i].albedo;
+        featureBuffer[first + i].normal += features[i].normal;
+        featureBuffer[first + i].depth += features[i].depth;
+        featureBuffer[first + i].position += features[i].position;
+        featureBuffer[first + i].local += features[i].local;
+        featureBuffer[first + i].uv += features[i].uv;
+        if (sample.a > 0) image[first + i] = colorToInt24(sample / sample.a);
+    }
+    return true;
+}
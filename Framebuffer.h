@@ -0,0 +1,121 @@
+/**
+ * Framebuffer.
+ *
+ * Accumulates weighted samples for each pixel of an image, along with the statistics used by adaptive sampling and
+ * the features used by the denoiser.  Each camera renders into its own framebuffer, so several views can be
+ * rendered in one process.  The framebuffer also keeps a 24bit image of the current result which is updated as
+ * samples are added.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "Color.h"
+#include "Utils.h"
+#include "Denoiser.h"
+#include "HDRWriter.h"
+
+// default resolution.
+const int SCREEN_WIDTH = 2560 / 4;
+const int SCREEN_HEIGHT = 1440 / 4;
+
+class Framebuffer
+{
+protected:
+
+    int width = 0;
+    int height = 0;
+
+    // 24bit image of the current result.
+	std::vector<uint32_t> image;
+
+    // stores acculated color, where the total weight is recorded in the alpha chanel.
+    // for example the color 10,5,1,10 has a color of (1.0, 0.5, 0.1) and 10 samples.
+    std::vector<Color> sampleBuffer;
+
+    // running sums used to estimate the variance of each pixels mean (see getError).
+    struct PixelStats {
+        float luminance2 = 0;   // weighted sum of squared sample luminance.
+        float weight2 = 0;      // sum of squared sample weights.
+        float samples = 0;      // number of samples taken.
+    };
+    std::vector<PixelStats> statsBuffer;
+
+    // accumulated first hit features used to guide the denoiser.  Like the sample buffer these are weighted sums,
+    // with the total weight of samples that hit a surface stored in the albedo's alpha channel.
+    std::vector<PixelFeatures> featureBuffer;
+
+    /** Writes the denoised sample buffer to the image. */
+    void updateDenoisedImage();
+
+    /** Runs the denoiser over the sample buffer. */
+    void getDenoisedColors(std::vector<Color>& output);
+
+public:
+
+    // if enabled the image (and saved files) are denoised.
+    bool denoise = false;
+    Denoiser denoiser;
+
+    // if enabled first hit features are collected and saved alongside the image as extra layers (AOVs).
+    bool aovs = false;
+
+    Framebuffer(int width = SCREEN_WIDTH, int height = SCREEN_HEIGHT);
+
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+
+    /** Returns the current image, one 24bit color per pixel. */
+    const uint32_t* getImage() { return &image[0]; }
+
+    /** Changes the resolution, this clears the buffers. */
+    void resize(int width, int height);
+
+    /** Returns if (x,y) is in bounds or not. */
+    bool inBounds(int x, int y);
+
+	void putPixel(int x, int y, Color col, bool shallow=false);
+    /** Adds a sample, which may be the average of several samples taken for the pixel. */
+    void addSample(int x, int y, Color col, float weight = 1.0, int samples = 1);
+    /** Adds first hit features for a sample, a depth < 0 indicates the sample hit the background. */
+    void addFeatures(int x, int y, PixelFeatures features, float weight = 1.0);
+    /** Clears the samples.  If shallow is true the image is left as it is until new samples are added. */
+	void clear(Color col = Color(0,0,0,1), bool shallow=false);
+    /** As clear, but only for rows [y, y+rows). */
+    void clearRows(int y, int rows, Color col = Color(0,0,0,1), bool shallow=false);
+    /** Returns estimated standard error of the pixels mean relative to its brightness. */
+    float getError(int x, int y);
+    /** Returns estimated variance of the pixels mean luminance. */
+    float getVariance(int x, int y);
+    /** Returns the number of samples the pixels mean is effectively built from. */
+    float getEffectiveSamples(int x, int y);
+    /** Returns the number of samples taken for the pixel, counting each of the samples averaged into one added. */
+    float getSamples(int x, int y);
+    /** Updates the image from the samples, denoising it if enabled. */
+    void updateImage();
+    /** Returns the mean color of each pixel as 3 linear floats (denoised if enabled), without clamping. */
+    void getColors(std::vector<float>& rgb);
+    /** Returns the image as named channels: the color (R,G,B) and the fraction of samples that hit a surface (A), then
+     * the AOVs albedo, normal (N), depth (Z), world position (P), local position, uv and sample count. */
+    void getChannels(std::vector<HDRChannel>& channels);
+    /** Returns the file the AOVs for an image are saved to.  EXR images hold the AOVs themselves, other formats get a
+     * separate EXR file next to them. */
+    static std::string getAOVFilename(std::string filename);
+    /** Updates the image and writes it to file.  Files ending in .pfm or .exr keep the full floating point colors,
+     * anything else is written as a 24bit TGA.  AOVs are written too if enabled.  Returns false on failure. */
+    bool save(std::string filename);
+
+    /** Writes the accumulated samples, statistics and features so rendering can be resumed later. */
+    bool writeSamples(std::ostream& stream);
+    /** Reads samples written by writeSamples, replacing the current ones.  Fails if the resolution does not match. */
+    bool readSamples(std::istream& stream);
+
+    /** Copies the accumulated samples of rows [y, y+rows) into data, so they can be sent to another framebuffer. */
+    void packRows(int y, int rows, std::vector<char>& data);
+    /** Adds samples packed by packRows to rows [y, y+rows).  Returns false if data is the wrong size. */
+    bool mergeRows(int y, int rows, const std::vector<char>& data);
+};
@@ -5,74 +5,74 @@ Date Feb 2018
 */
 
 #include "GFX.h"
+#include "Trace.h"
+
+#include <string.h>
+
+#ifdef __APPLE__
+	#include <GLUT/glut.h>
+#else
+	#include <GL/glut.h>
+	#include <GL/gl.h>
+#endif
+
+GFX::GFX(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    buffer = new uint32_t[width*height];
+}
 
 /** Returns if (x,y) is in screen bounds or not. */
-bool inBounds(int x, int y) {
-	return ((x >= 0) && (y >= 0) && (x < SCREEN_WIDTH) && (y < SCREEN_HEIGHT));
+bool GFX::inBounds(int x, int y) {
+	return ((x >= 0) && (y >= 0) && (x < width) && (y < height));
 }
 
-/** Place a pixel on the frame buffer.
- * If shallow is true then only the color buffer is updated, not the sample buffer.
- * This allows writing to the screen without destroying the sample buffer.
- */
-void GFX::putPixel(int x, int y, Color col, bool shallow)
+/** Place a pixel on the screen buffer. */
+void GFX::putPixel(int x, int y, Color col)
 {
     if (!inBounds(x,y)) return;
-    if (shallow) {
-        buffer[y*SCREEN_WIDTH + x] = colorToInt24(col);
-    } else {
-	    sampleBuffer[y*SCREEN_WIDTH+x] = Color(0,0,0,0);
-        addSample(x,y,col);
-    }
+    buffer[y*width + x] = colorToInt24(col);
 }
 
-
-/** Sets buffer to sample buffer. */
-void GFX::updateBuffer()
+void GFX::show(Framebuffer& framebuffer)
 {
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-		for (int x = 0; x < SCREEN_WIDTH; x++) {
-            {
-                buffer[y*SCREEN_WIDTH + x] = colorToInt24(sampleBuffer[y*SCREEN_WIDTH + x] / sampleBuffer[y*SCREEN_WIDTH + x].a);
-            }
-        }
+    TRACE_ZONE("show");
+    if (framebuffer.getWidth() == width && framebuffer.getHeight() == height) {
+        memcpy(buffer, framebuffer.getImage(), width * height * sizeof(uint32_t));
+        return;
     }
-}
 
-/** Adds a simple to the buffer, samples are averaged by weight. */
-void GFX::addSample(int x, int y, Color col, float weight)
-{
-	if (!inBounds(x,y) || weight == 0.0f) return;
-	col.a = 1.0f;
-    sampleBuffer[y*SCREEN_WIDTH + x] += (col*weight);
-	buffer[y*SCREEN_WIDTH + x] = colorToInt24(sampleBuffer[y*SCREEN_WIDTH + x] / sampleBuffer[y*SCREEN_WIDTH + x].a);
+    // the framebuffer doesn't match the screen, so just copy the part that fits.
+    const uint32_t* image = framebuffer.getImage();
+    for (int y = 0; y < height && y < framebuffer.getHeight(); y++) {
+        for (int x = 0; x < width && x < framebuffer.getWidth(); x++) {
+            buffer[y*width + x] = image[y*framebuffer.getWidth() + x];
+        }
+    }
 }
 
-void GFX::clear(Color col, bool shallow)
+void GFX::clear(Color col)
 {
-    col.a = 0.0;
 	uint32_t c = colorToInt24(col);
-	for (int y = 0; y < SCREEN_HEIGHT; y++) {
-		for (int x = 0; x < SCREEN_WIDTH; x++) {
-            if (!shallow)
-			    buffer[y*SCREEN_WIDTH + x] = c;
-            sampleBuffer[y*SCREEN_WIDTH + x] = col;
-		}
+	for (int i = 0; i < width*height; i++) {
+        buffer[i] = c;
 	}
 }
 
 /** Blit buffer to screen */
 void GFX::blit()
 {
+    TRACE_ZONE("blit");
 	//upload to GPU texture (slow, shoud use glTextSubImage2D
 	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 	//match projection to window resolution (could be in reshape callback)
 	glMatrixMode(GL_PROJECTION);
 	glPushMatrix();
-	glOrtho(0, SCREEN_WIDTH, 0, SCREEN_HEIGHT, -1, 1);
+	glOrtho(0, width, 0, height, -1, 1);
 	glMatrixMode(GL_MODELVIEW);
 	glPushMatrix();
 	glLoadIdentity();
@@ -85,9 +85,9 @@ void GFX::blit()
 
 	glBegin(GL_QUADS);
 	glTexCoord2i(0, 0); glVertex2i(0, 0);
-	glTexCoord2i(0, 1); glVertex2i(0, SCREEN_HEIGHT);
-	glTexCoord2i(1, 1); glVertex2i(SCREEN_WIDTH, SCREEN_HEIGHT);
-	glTexCoord2i(1, 0); glVertex2i(SCREEN_WIDTH, 0);
+	glTexCoord2i(0, 1); glVertex2i(0, height);
+	glTexCoord2i(1, 1); glVertex2i(width, height);
+	glTexCoord2i(1, 0); glVertex2i(width, 0);
 	glEnd();
 
 	glDisable(GL_TEXTURE_2D);
@@ -109,10 +109,10 @@ void GFX::init(void)
 	glBindTexture(GL_TEXTURE_2D, tex);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
 }
 
 // singleton GFX access;
-GFX gfx = GFX();
\ No newline at end of file
+GFX gfx = GFX();
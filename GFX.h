@@ -1,5 +1,7 @@
 /**
  * Very simple graphics library for blitting a buffer to the screen. 
+ *
+ * This is only the display path used by the viewer, images are rendered into a Framebuffer which is then shown here.
  **/
 
 #pragma once
@@ -8,39 +10,38 @@
 #include "Utils.h"
 #include <stdint.h>
 #include "TGAWriter.h"
-
-#ifdef __APPLE__
-	#include <GLUT/glut.h>
-#else
-	#include <GL/glut.h>
-	#include <GL/gl.h>
-#endif
-
-
-const int SCREEN_WIDTH = 2560 / 4;
-const int SCREEN_HEIGHT = 1440 / 4;
+#include "Framebuffer.h"
 
 class GFX
 {
 	
-	uint32_t* buffer = new uint32_t[SCREEN_HEIGHT*SCREEN_WIDTH];
+	uint32_t* buffer = NULL;
 
-    // stores acculated color, where the total weight is recorded in the alpha chanel.
-    // for example the color 10,5,1,10 has a color of (1.0, 0.5, 0.1) and 10 samples.
-    Color* sampleBuffer = new Color[SCREEN_HEIGHT*SCREEN_WIDTH];
+    int width = 0;
+    int height = 0;
 
-	GLuint tex;
+    // OpenGL texture used by blit.
+	unsigned int tex = 0;
 
 public:
-	void putPixel(int x, int y, Color col, bool shallow=false);    
-    void addSample(int x, int y, Color col, float weight = 1.0);
-	void clear(Color col = Color(0,0,0,1), bool shallow=false);
-    void updateBuffer();
+
+    GFX(int width = SCREEN_WIDTH, int height = SCREEN_HEIGHT);
+
+    int getWidth() { return width; }
+    int getHeight() { return height; }
+
+    /** Returns if (x,y) is in screen bounds or not. */
+    bool inBounds(int x, int y);
+
+    /** Copies the framebuffers current image to the screen buffer. */
+    void show(Framebuffer& framebuffer);
+
+	void putPixel(int x, int y, Color col);    
+	void clear(Color col = Color(0,0,0,1));
     void screenshot(std::string filename) {
         const char *cstr = filename.c_str();
-        updateBuffer();
         printf("Saving screenshot %s\n", cstr);
-        write_truecolor_tga(cstr, buffer, SCREEN_WIDTH, SCREEN_HEIGHT);
+        write_truecolor_tga(cstr, buffer, width, height);
     }
 	void blit();    
 	void init(void);
@@ -0,0 +1,167 @@
+#include "HDRWriter.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <fstream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/** Returns the lower case extension of filename, including the dot. */
+static string get_extension( const string& filename )
+{
+  size_t dot = filename.rfind( '.' );
+  if (dot == string::npos) return "";
+  string extension = filename.substr( dot );
+  for (size_t i = 0; i < extension.size(); i++) extension[ i ] = (char)tolower( extension[ i ] );
+  return extension;
+}
+
+bool is_hdr_filename( const string& filename )
+{
+  string extension = get_extension( filename );
+  return extension == ".pfm" || extension == ".exr";
+}
+
+bool write_hdr( const string& filename, const float* rgb, unsigned width, unsigned height )
+{
+  if (get_extension( filename ) == ".exr") return write_exr( filename, rgb, width, height );
+  return write_pfm( filename, rgb, width, height );
+}
+
+bool write_pfm( const string& filename, const float* rgb, unsigned width, unsigned height )
+{
+  ofstream file( filename.c_str(), ios::binary );
+  if (!file) return false;
+
+  // a negative scale marks the data as little endian.
+  char header[ 64 ];
+  snprintf( header, sizeof( header ), "PF\n%u %u\n-1.0\n", width, height );
+  file.write( header, strlen( header ) );
+
+  // PFM rows go from bottom to top.
+  for (int y = (int)height - 1; y >= 0; y--)
+    file.write( (const char*)&rgb[ (size_t)y * width * 3 ], width * 3 * sizeof( float ) );
+
+  file.close();
+  return !file.fail();
+}
+
+// ------------------------------------------------------------
+// OpenEXR
+// ------------------------------------------------------------
+
+/** Appends raw bytes of value to buffer (EXR is little endian, as are the machines we run on). */
+template <typename T>
+static void put( vector<char>& buffer, T value )
+{
+  const char* bytes = (const char*)&value;
+  buffer.insert( buffer.end(), bytes, bytes + sizeof( T ) );
+}
+
+static void put_string( vector<char>& buffer, const char* s )
+{
+  buffer.insert( buffer.end(), s, s + strlen( s ) + 1 );
+}
+
+/** Starts a header attribute, the value must follow. */
+static void put_attribute( vector<char>& buffer, const char* name, const char* type, int32_t size )
+{
+  put_string( buffer, name );
+  put_string( buffer, type );
+  put( buffer, size );
+}
+
+bool write_exr( const string& filename, const float* rgb, unsigned width, unsigned height )
+{
+  const char* names[ 3 ] = { "R", "G", "B" };
+  vector<HDRChannel> channels( 3 );
+  for (int c = 0; c < 3; c++)
+    {
+    channels[ c ].name = names[ c ];
+    channels[ c ].data.resize( (size_t)width * height );
+    for (size_t i = 0; i < (size_t)width * height; i++) channels[ c ].data[ i ] = rgb[ i * 3 + c ];
+    }
+  return write_exr_channels( filename, channels, width, height );
+}
+
+bool write_exr_channels( const string& filename, const vector<HDRChannel>& unsorted_channels, unsigned width, unsigned height )
+{
+  // channels must be stored in alphabetical order.
+  vector<const HDRChannel*> channels;
+  for (size_t c = 0; c < unsorted_channels.size(); c++)
+    {
+    if (unsorted_channels[ c ].data.size() != (size_t)width * height) return false;
+    channels.push_back( &unsorted_channels[ c ] );
+    }
+  sort( channels.begin(), channels.end(), []( const HDRChannel* a, const HDRChannel* b ) { return a->name < b->name; } );
+  int count = (int)channels.size();
+
+  ofstream file( filename.c_str(), ios::binary );
+  if (!file) return false;
+
+  vector<char> header;
+  put( header, (int32_t)20000630 );  // magic number
+  put( header, (int32_t)2 );         // version 2, single part scanline file
+
+  int32_t channel_list_size = 1;
+  for (int c = 0; c < count; c++) channel_list_size += (int32_t)channels[ c ]->name.size() + 1 + 16;
+  put_attribute( header, "channels", "chlist", channel_list_size );
+  for (int c = 0; c < count; c++)
+    {
+    put_string( header, channels[ c ]->name.c_str() );
+    put( header, (int32_t)2 );       // 32bit float
+    put( header, (int32_t)0 );       // linear flag and reserved bytes
+    put( header, (int32_t)1 );       // x sampling
+    put( header, (int32_t)1 );       // y sampling
+    }
+  header.push_back( 0 );
+
+  put_attribute( header, "compression", "compression", 1 );
+  header.push_back( 0 );             // no compression
+
+  int32_t window[ 4 ] = { 0, 0, (int32_t)width - 1, (int32_t)height - 1 };
+  put_attribute( header, "dataWindow", "box2i", 16 );
+  for (int i = 0; i < 4; i++) put( header, window[ i ] );
+  put_attribute( header, "displayWindow", "box2i", 16 );
+  for (int i = 0; i < 4; i++) put( header, window[ i ] );
+
+  put_attribute( header, "lineOrder", "lineOrder", 1 );
+  header.push_back( 0 );             // increasing y
+
+  put_attribute( header, "pixelAspectRatio", "float", 4 );
+  put( header, 1.0f );
+  put_attribute( header, "screenWindowCenter", "v2f", 8 );
+  put( header, 0.0f );
+  put( header, 0.0f );
+  put_attribute( header, "screenWindowWidth", "float", 4 );
+  put( header, 1.0f );
+  header.push_back( 0 );             // end of header
+
+  // without compression each chunk is a single scanline: its y, its size, then each channel in turn.
+  uint32_t line_size = width * count * sizeof( float );
+  uint64_t chunk_size = 8 + line_size;
+  uint64_t first_chunk = header.size() + (uint64_t)height * 8;
+  for (unsigned y = 0; y < height; y++)
+    put( header, (uint64_t)(first_chunk + y * chunk_size) );
+  file.write( &header[ 0 ], header.size() );
+
+  vector<char> line;
+  line.reserve( chunk_size );
+  for (unsigned y = 0; y < height; y++)
+    {
+    line.clear();
+    put( line, (int32_t)y );
+    put( line, (int32_t)line_size );
+    for (int c = 0; c < count; c++)
+      {
+      const float* row = &channels[ c ]->data[ (size_t)y * width ];
+      line.insert( line.end(), (const char*)row, (const char*)(row + width) );
+      }
+    file.write( &line[ 0 ], line.size() );
+    }
+
+  file.close();
+  return !file.fail();
+}
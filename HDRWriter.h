@@ -0,0 +1,38 @@
+#pragma once
+
+/**
+ * Writes floating point (high dynamic range) images to disk.
+ *
+ * Unlike the TGA writer these keep the full range of the rendered radiance, so images can be tone mapped or
+ * composited later.  Two formats are supported:
+ *   .pfm  Portable Float Map, the simplest float format there is.
+ *   .exr  OpenEXR, written as uncompressed scanlines of 32bit float R, G and B channels.
+ */
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** A named channel of an image, one float per pixel.  Names follow the EXR conventions, for example "R", "N.X" or
+ * "albedo.R" where the part before the dot is the layer. */
+struct HDRChannel
+{
+  string name;
+  vector<float> data;
+};
+
+// Images are given as 3 floats (linear r,g,b) per pixel, with rows from top to bottom.
+
+/** Returns if filename has the extension of one of the floating point formats. */
+bool is_hdr_filename( const string& filename );
+
+/** Writes the image in the format given by the filenames extension. */
+bool write_hdr( const string& filename, const float* rgb, unsigned width, unsigned height );
+
+bool write_pfm( const string& filename, const float* rgb, unsigned width, unsigned height );
+
+bool write_exr( const string& filename, const float* rgb, unsigned width, unsigned height );
+
+/** Writes any number of named channels to a single (multi-layer) EXR file. */
+bool write_exr_channels( const string& filename, const vector<HDRChannel>& channels, unsigned width, unsigned height );
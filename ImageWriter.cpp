@@ -0,0 +1,111 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Background image writer.
+-------------------------------------------------------------*/
+
+#include "ImageWriter.h"
+#include "TGAWriter.h"
+#include "HDRWriter.h"
+#include "Trace.h"
+
+#include <stdio.h>
+
+ImageWriter::ImageWriter(int maxPending)
+{
+    this->maxPending = maxPending > 0 ? maxPending : 1;
+    thread = std::thread(&ImageWriter::writerLoop, this);
+}
+
+ImageWriter::~ImageWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    thread.join();
+}
+
+void ImageWriter::write(std::string filename, int width, int height, const uint32_t* pixels, std::function<void(bool success)> done)
+{
+    PendingImage image;
+    image.filename = filename;
+    image.width = width;
+    image.height = height;
+    image.pixels.assign(pixels, pixels + width * height);
+    image.done = done;
+    enqueue(image);
+}
+
+void ImageWriter::writeHDR(std::string filename, int width, int height, const float* rgb, std::function<void(bool success)> done)
+{
+    PendingImage image;
+    image.filename = filename;
+    image.width = width;
+    image.height = height;
+    image.rgb.assign(rgb, rgb + width * height * 3);
+    image.done = done;
+    enqueue(image);
+}
+
+void ImageWriter::writeChannels(std::string filename, int width, int height, std::vector<HDRChannel>& channels, std::function<void(bool success)> done)
+{
+    PendingImage image;
+    image.filename = filename;
+    image.width = width;
+    image.height = height;
+    image.channels.swap(channels);
+    image.done = done;
+    enqueue(image);
+}
+
+void ImageWriter::enqueue(PendingImage& image)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return (int)queue.size() < maxPending; });
+    queue.push_back(std::move(image));
+    changed.notify_all();
+}
+
+void ImageWriter::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]() { return queue.empty() && !writing; });
+}
+
+void ImageWriter::writerLoop()
+{
+    setTraceThreadName("image writer");
+    while (true) {
+        PendingImage image;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            image = std::move(queue.front());
+            queue.pop_front();
+            writing = true;
+        }
+        changed.notify_all();
+
+        printf("Saving screenshot %s\n", image.filename.c_str());
+        TRACE_ZONE("write image");
+        bool success;
+        if (!image.channels.empty()) {
+            success = write_exr_channels(image.filename, image.channels, image.width, image.height);
+        } else if (!image.rgb.empty()) {
+            success = write_hdr(image.filename, &image.rgb[0], image.width, image.height);
+        } else {
+            success = write_truecolor_tga(image.filename, &image.pixels[0], image.width, image.height);
+        }
+        if (!success) printf("Failed to write %s.\n", image.filename.c_str());
+        if (image.done) image.done(success);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writing = false;
+        }
+        changed.notify_all();
+    }
+}
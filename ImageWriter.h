@@ -0,0 +1,72 @@
+/**
+ * Image writer.
+ *
+ * Writes images to disk on a background thread, so that rendering can carry on with the next frame while the last
+ * one is saved.  Images are copied when queued, and only a few are held at once: if the disk falls behind, queuing
+ * blocks until there is room rather than letting memory grow.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HDRWriter.h"
+
+class ImageWriter
+{
+protected:
+    struct PendingImage
+    {
+        std::string filename;
+        int width;
+        int height;
+        std::vector<uint32_t> pixels;
+        // floating point colors, used instead of pixels for HDR formats.
+        std::vector<float> rgb;
+        // named channels, used instead of pixels for multi-layer EXR files.
+        std::vector<HDRChannel> channels;
+        std::function<void(bool success)> done;
+    };
+
+    std::deque<PendingImage> queue;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+    int maxPending;
+    bool writing = false;
+    bool stopping = false;
+
+    void writerLoop();
+
+    /** Adds image to the queue, waiting for room if it is full. */
+    void enqueue(PendingImage& image);
+
+public:
+
+    /** Creates a writer that holds at most maxPending images waiting to be written. */
+    ImageWriter(int maxPending = 4);
+
+    /** Writes any images still queued before returning. */
+    ~ImageWriter();
+
+    /** Queues a 24bit image to be written as a TGA file.  done, if given, is called on the writer thread once the file
+     * has been written. */
+    void write(std::string filename, int width, int height, const uint32_t* pixels, std::function<void(bool success)> done = nullptr);
+
+    /** Queues a floating point image (3 floats per pixel) to be written as a PFM or EXR file, depending on the
+     * filenames extension. */
+    void writeHDR(std::string filename, int width, int height, const float* rgb, std::function<void(bool success)> done = nullptr);
+
+    /** Queues named channels to be written to a multi-layer EXR file.  The channels are moved into the queue. */
+    void writeChannels(std::string filename, int width, int height, std::vector<HDRChannel>& channels, std::function<void(bool success)> done = nullptr);
+
+    /** Waits until every queued image has been written. */
+    void flush();
+};
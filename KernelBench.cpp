@@ -0,0 +1,396 @@
+/*========================================================================
+* Ray tracer, intersection kernel microbenchmarks.
+*
+* Times the primitive intersection kernels in isolation on fixed batches of random rays, in nanoseconds per ray.
+* Kernels with more than one variant are checked against their first variant, which is the one the renderer uses, so
+* a faster variant can only be swapped in once it gives the same answers.
+*
+* Usage: KernelBench.exe [--rays <n>] [--repeats <n>] [--kernel <name>]
+*        The SIMD variants of a kernel are only run on CPUs that support them.
+*=========================================================================
+*/
+
+#include <chrono>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "Sphere.h"
+#include "Plane.h"
+#include "Cylinder.h"
+#include "TriangleBlock.h"
+#include "WideBVH.h"
+#include "Utils.h"
+
+using namespace std;
+
+/** A batch of rays in the local space of a primitive, along with points on its surface for the inside tests. */
+struct KernelBatch
+{
+    vector<Ray> rays;
+    vector<glm::vec3> points;
+};
+
+/** Fills results with the distance to the hit for each ray in batch, or -1 for a miss. */
+typedef function<void(KernelBatch& batch, vector<float>& results)> KernelFunction;
+
+struct KernelVariant
+{
+    string kernel;
+    string variant;
+    KernelFunction run;
+};
+
+// a fixed seed so every run, and every build, tests the same rays.
+static uint32_t randomState = 363;
+
+/** Returns a repeatable pseudo random number in [0,1). */
+static float nextRandom()
+{
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (randomState >> 8) * (1.0f / 16777216.0f);
+}
+
+static glm::vec3 randomInBox(float size)
+{
+    return glm::vec3(nextRandom() - 0.5f, nextRandom() - 0.5f, nextRandom() - 0.5f) * (2 * size);
+}
+
+/** Creates rays starting around the unit cube and aimed near its center, so roughly half of them hit a primitive
+ * of about unit size there. */
+static void createBatch(KernelBatch& batch, int rays)
+{
+    batch.rays.resize(rays);
+    batch.points.resize(rays);
+    for (int i = 0; i < rays; i++) {
+        glm::vec3 origin = randomInBox(4.0f);
+        glm::vec3 target = randomInBox(1.5f);
+        if (glm::length2(target - origin) < EPSILON) target += glm::vec3(1, 0, 0);
+        batch.rays[i] = Ray(origin, target - origin);
+        // points on the z = 0 plane, which is where the triangle for the inside test lies.
+        batch.points[i] = glm::vec3(randomInBox(1.5f).x, randomInBox(1.5f).y, 0);
+    }
+}
+
+/** Runs object's intersectObject on each ray, which is already in the object's local space. */
+static void intersectAll(SceneObject* object, KernelBatch& batch, vector<float>& results)
+{
+    for (int i = 0; i < (int)batch.rays.size(); i++) {
+        Ray& ray = batch.rays[i];
+        results[i] = object->intersectObject(&ray) ? ray.collision.t : -1;
+    }
+}
+
+// ------------------------------------------------------------
+// Reference versions of the kernels
+// ------------------------------------------------------------
+
+/** Moller-Trumbore ray triangle intersection, returns the distance to the hit or -1. */
+static float intersectTriangleMT(const Ray& ray, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3)
+{
+    glm::vec3 e1 = v2 - v1;
+    glm::vec3 e2 = v3 - v1;
+    glm::vec3 p = glm::cross(ray.dir, e2);
+    float det = glm::dot(e1, p);
+    if (fabs(det) < EPSILON) return -1;
+    float invDet = 1.0f / det;
+    glm::vec3 s = ray.pos - v1;
+    float u = glm::dot(s, p) * invDet;
+    if (u < 0 || u > 1) return -1;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(ray.dir, q) * invDet;
+    if (v < 0 || u + v > 1) return -1;
+    float t = glm::dot(e2, q) * invDet;
+    return (t < EPSILON || t > ray.length) ? -1 : t;
+}
+
+/** Returns if p (on the triangles plane) is inside the triangle, using barycentric coordinates. */
+static bool isInsideBarycentric(glm::vec3 p, glm::vec3 v1, glm::vec3 v2, glm::vec3 v3)
+{
+    glm::vec3 e1 = v2 - v1;
+    glm::vec3 e2 = v3 - v1;
+    glm::vec3 d = p - v1;
+    float d11 = glm::dot(e1, e1);
+    float d12 = glm::dot(e1, e2);
+    float d22 = glm::dot(e2, e2);
+    float d1 = glm::dot(d, e1);
+    float d2 = glm::dot(d, e2);
+    float denominator = d11 * d22 - d12 * d12;
+    float v = (d22 * d1 - d12 * d2) / denominator;
+    float w = (d11 * d2 - d12 * d1) / denominator;
+    return v >= 0 && w >= 0 && v + w <= 1;
+}
+
+/** Prepares ray for the BVH node tests. */
+static BVHRay createBVHRay(const Ray& ray)
+{
+    BVHRay bvhRay;
+    for (int axis = 0; axis < 3; axis++) {
+        bvhRay.origin[axis] = ray.pos[axis];
+        bvhRay.invDir[axis] = 1.0f / ray.dir[axis];
+    }
+    bvhRay.length = ray.length;
+    return bvhRay;
+}
+
+/** Fills node with N random boxes around the origin. */
+template <int N>
+static void createBVHNode(BVHNode<N>& node)
+{
+    for (int i = 0; i < N; i++) {
+        glm::vec3 center = randomInBox(1.0f);
+        glm::vec3 size = glm::abs(randomInBox(0.5f));
+        for (int axis = 0; axis < 3; axis++) {
+            node.boundsMin[axis][i] = center[axis] - size[axis];
+            node.boundsMax[axis][i] = center[axis] + size[axis];
+        }
+        node.child[i] = i;
+        node.count[i] = 0;
+    }
+    node.children = N;
+}
+
+/** Adds a kernel for each test the CPU supports of node, which must outlive the kernels.  Results are the mask of
+ * boxes hit, so any difference between the tests is a mismatch. */
+template <typename Node>
+static void addBVHNodeKernels(vector<KernelVariant>& kernels, string name, const Node& node)
+{
+    const vector<BVHNodeTestInfo<Node>>& tests = getBVHNodeTests<Node>();
+    for (int k = 0; k < (int)tests.size(); k++) {
+        if (!tests[k].supported) continue;
+        BVHNodeTest<Node> test = tests[k].test;
+        kernels.push_back({name, tests[k].name, [test, &node](KernelBatch& batch, vector<float>& results) {
+            float tNear[Node::WIDTH];
+            for (int i = 0; i < (int)batch.rays.size(); i++) {
+                int hits = test(node, createBVHRay(batch.rays[i]), tNear);
+                results[i] = hits ? (float)hits : -1;
+            }
+        }});
+    }
+}
+
+// ------------------------------------------------------------
+// Kernels
+// ------------------------------------------------------------
+
+static vector<KernelVariant> createKernels()
+{
+    vector<KernelVariant> kernels;
+
+    // primitives are created once and shared by the kernel functions.
+    static Sphere sphere(glm::vec3(0, 0, 0), 1.0f);
+    static Plane quad(glm::vec3(-1, -1, 0), glm::vec3(1, -1, 0), glm::vec3(1, 1, 0), glm::vec3(-1, 1, 0));
+    static glm::vec3 v1(-1, -1, 0), v2(1, -1, 0), v3(0, 1, 0);
+    static Triangle triangle(v1, v2, v3);
+    static Cylinder cylinder(glm::vec3(0, 0, 0), 1.0f, 1.0f);
+
+    kernels.push_back({"sphere", "Sphere::intersectObject", [](KernelBatch& batch, vector<float>& results) {
+        intersectAll(&sphere, batch, results);
+    }});
+    kernels.push_back({"sphere", "raySphereIntersection", [](KernelBatch& batch, vector<float>& results) {
+        for (int i = 0; i < (int)batch.rays.size(); i++) {
+            float t = raySphereIntersection(batch.rays[i].pos, batch.rays[i].dir, glm::vec3(0, 0, 0), 1.0f);
+            results[i] = t > 0 ? t : -1;
+        }
+    }});
+
+    kernels.push_back({"plane", "Plane::intersectObject", [](KernelBatch& batch, vector<float>& results) {
+        intersectAll(&quad, batch, results);
+    }});
+
+    kernels.push_back({"triangle", "Triangle::intersectObject", [](KernelBatch& batch, vector<float>& results) {
+        intersectAll(&triangle, batch, results);
+    }});
+    kernels.push_back({"triangle", "Moller-Trumbore", [](KernelBatch& batch, vector<float>& results) {
+        for (int i = 0; i < (int)batch.rays.size(); i++) {
+            results[i] = intersectTriangleMT(batch.rays[i], v1, v2, v3);
+        }
+    }});
+
+    // inside tests return 1 or -1, so they can be compared in the same way as the distances.
+    kernels.push_back({"triangle inside", "Triangle::isInside", [](KernelBatch& batch, vector<float>& results) {
+        for (int i = 0; i < (int)batch.points.size(); i++) {
+            results[i] = triangle.isInside(batch.points[i]) ? 1 : -1;
+        }
+    }});
+    kernels.push_back({"triangle inside", "barycentric", [](KernelBatch& batch, vector<float>& results) {
+        for (int i = 0; i < (int)batch.points.size(); i++) {
+            results[i] = isInsideBarycentric(batch.points[i], v1, v2, v3) ? 1 : -1;
+        }
+    }});
+
+    // a block of triangles scattered around the origin, first through the Triangle objects one at a time as a
+    // reference and then through each block kernel the CPU supports.
+    static vector<glm::vec3> blockVertices;
+    static vector<Triangle*> blockTriangles;
+    for (int i = 0; i < TRIANGLE_BLOCK_SIZE; i++) {
+        glm::vec3 center = randomInBox(1.0f);
+        for (int j = 0; j < 3; j++) {
+            blockVertices.push_back(center + randomInBox(0.5f));
+        }
+        blockTriangles.push_back(new Triangle(blockVertices[i*3+0], blockVertices[i*3+1], blockVertices[i*3+2]));
+    }
+    static TriangleBlock block(&blockVertices[0], TRIANGLE_BLOCK_SIZE);
+
+    kernels.push_back({"triangle block", "Triangle::intersectObject", [](KernelBatch& batch, vector<float>& results) {
+        for (int i = 0; i < (int)batch.rays.size(); i++) {
+            Ray& ray = batch.rays[i];
+            float length = ray.length;
+            results[i] = -1;
+            for (int j = 0; j < (int)blockTriangles.size(); j++) {
+                if (blockTriangles[j]->intersectObject(&ray)) {
+                    results[i] = ray.collision.t;
+                    ray.length = ray.collision.t;
+                }
+            }
+            ray.length = length;
+        }
+    }});
+    const vector<TriangleBlockKernelInfo>& blockKernels = getTriangleBlockKernels();
+    for (int k = 0; k < (int)blockKernels.size(); k++) {
+        if (!blockKernels[k].supported) continue;
+        TriangleBlockKernel blockKernel = blockKernels[k].kernel;
+        kernels.push_back({"triangle block", string("TriangleBlock ") + blockKernels[k].name,
+            [blockKernel](KernelBatch& batch, vector<float>& results) {
+            for (int i = 0; i < (int)batch.rays.size(); i++) {
+                float t;
+                results[i] = blockKernel(block.getData(), batch.rays[i], t) >= 0 ? t : -1;
+            }
+        }});
+    }
+
+    static BVHNode<4> node4;
+    static BVHNode<8> node8;
+    createBVHNode(node4);
+    createBVHNode(node8);
+    addBVHNodeKernels(kernels, "bvh4 node", node4);
+    addBVHNodeKernels(kernels, "bvh8 node", node8);
+
+    // the same boxes quantized, which are a little larger so may be hit by more rays than the originals.
+    static BVHQuantizedNode<4, uint8_t> node4q8;
+    static BVHQuantizedNode<8, uint8_t> node8q8;
+    static BVHQuantizedNode<8, uint16_t> node8q16;
+    quantizeBVHNode(node4q8, node4.boundsMin, node4.boundsMax, node4.children);
+    quantizeBVHNode(node8q8, node8.boundsMin, node8.boundsMax, node8.children);
+    quantizeBVHNode(node8q16, node8.boundsMin, node8.boundsMax, node8.children);
+    addBVHNodeKernels(kernels, "bvh4q8 node", node4q8);
+    addBVHNodeKernels(kernels, "bvh8q8 node", node8q8);
+    addBVHNodeKernels(kernels, "bvh8q16 node", node8q16);
+
+    kernels.push_back({"cylinder", "Cylinder::intersectObject", [](KernelBatch& batch, vector<float>& results) {
+        intersectAll(&cylinder, batch, results);
+    }});
+
+    return kernels;
+}
+
+/** Returns the number of results that disagree, either on whether there was a hit or on the distance to it. */
+static int countMismatches(const vector<float>& expected, const vector<float>& results)
+{
+    int mismatches = 0;
+    for (int i = 0; i < (int)expected.size(); i++) {
+        bool hitExpected = expected[i] >= 0;
+        bool hit = results[i] >= 0;
+        if (hitExpected != hit || (hit && fabs(results[i] - expected[i]) > 1e-3f * maxf(1.0f, expected[i]))) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+static void printUsage()
+{
+    printf("Usage: KernelBench.exe [options]\n");
+    printf("  --rays <n>            rays per batch (default 65536)\n");
+    printf("  --repeats <n>         times each kernel is run, the fastest is reported (default 20)\n");
+    printf("  --kernel <name>       only run kernels with this name, for example triangle\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int rays = 65536;
+    int repeats = 20;
+    string only;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--help") {
+            printUsage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Unknown option %s.\n", arg.c_str());
+            return -1;
+        }
+        string value = argv[++i];
+        if (arg == "--rays") {
+            rays = atoi(value.c_str());
+        } else if (arg == "--repeats") {
+            repeats = atoi(value.c_str());
+        } else if (arg == "--kernel") {
+            only = value;
+        } else {
+            fprintf(stderr, "Unknown option %s.\n", arg.c_str());
+            return -1;
+        }
+        if (rays <= 0 || repeats <= 0) {
+            fprintf(stderr, "Invalid value %s for %s.\n", value.c_str(), arg.c_str());
+            return -1;
+        }
+    }
+
+    KernelBatch batch;
+    createBatch(batch, rays);
+
+    vector<KernelVariant> kernels = createKernels();
+    vector<float> expected(rays);
+    vector<float> results(rays);
+    string lastKernel;
+    int failed = 0;
+
+    printf("%-16s %-26s %10s %8s %12s\n", "kernel", "variant", "ns/ray", "hit %", "mismatches");
+    for (int k = 0; k < (int)kernels.size(); k++) {
+        KernelVariant& kernel = kernels[k];
+        if (!only.empty() && kernel.kernel != only) continue;
+
+        // best of several runs, which is the least disturbed by everything else running on the machine.
+        double best = INFINITY;
+        for (int r = 0; r < repeats; r++) {
+            auto start = std::chrono::steady_clock::now();
+            kernel.run(batch, results);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (seconds < best) best = seconds;
+        }
+
+        int hits = 0;
+        for (int i = 0; i < rays; i++) {
+            if (results[i] >= 0) hits++;
+        }
+
+        // the first variant of each kernel is the reference the others are checked against.
+        string mismatchText = "-";
+        if (kernel.kernel != lastKernel) {
+            expected = results;
+            lastKernel = kernel.kernel;
+        } else {
+            int mismatches = countMismatches(expected, results);
+            mismatchText = to_string(mismatches);
+            if (mismatches > 0) failed++;
+        }
+
+        printf("%-16s %-26s %10.2f %8.1f %12s\n", kernel.kernel.c_str(), kernel.variant.c_str(), best * 1e9 / rays,
+            100.0 * hits / rays, mismatchText.c_str());
+    }
+
+    if (failed > 0) {
+        fprintf(stderr, "%d variants disagree with their reference.\n", failed);
+        return -1;
+    }
+    return 0;
+}
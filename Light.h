@@ -22,15 +22,16 @@ public:
         this->color = color;
     }
 
-    /** Samples the lights locations, a sample will be drawn from the lights volume. */
-    glm::vec3 sampleLocation() {
+    /** Samples the lights locations, a sample will be drawn from the lights volume.  u is three uniform random numbers 
+     * in [0,1] that pick the point. */
+    glm::vec3 sampleLocation(glm::vec3 u) {
         if (lightSize <= 0.0f) 
             return this->getLocation();
         else {       
             return this->getLocation() + glm::vec3(
-                ((randf()-0.5f)*lightSize),
-                ((randf()-0.5f)*lightSize),
-                ((randf()-0.5f)*lightSize)
+                ((u.x-0.5f)*lightSize),
+                ((u.y-0.5f)*lightSize),
+                ((u.z-0.5f)*lightSize)
             );
         }
     }
@@ -0,0 +1,187 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Light tree for sampling many emissive objects.
+-------------------------------------------------------------*/
+
+#include "LightTree.h"
+#include "ContainerObject.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <map>
+
+/** Walks the scene graph adding emissive objects to lights.  Containers that share a single material are treated as one
+ * object, as these are reported as the target when a ray hits them. */
+static void collectEmissiveObjects(SceneObject* object, glm::mat4x4 parentTransform, std::vector<EmissiveLight>& lights)
+{
+    glm::mat4x4 transform = parentTransform * object->getLocalTransform();
+
+    ContainerObject* container = dynamic_cast<ContainerObject*>(object);
+    if (container && !container->useContainerMaterial) {
+        const vector<SceneObject*>& children = container->getChildren();
+        for (int i = 0; i < (int)children.size(); i++) {
+            collectEmissiveObjects(children[i], transform, lights);
+        }
+        return;
+    }
+
+    // objects without bounds (such as infinite planes) can not be sampled.
+    float power = luminance(object->material->emisiveColor);
+    if (power <= 0 || object->getRadius() < 0) return;
+
+    // the bounding sphere grows with the largest scale of the transform.
+    float scale = maxf(glm::length(glm::vec3(transform[0])), maxf(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+
+    EmissiveLight light;
+    light.object = object;
+    light.location = glm::vec3(transform * glm::vec4(0,0,0,1));
+    light.radius = object->getRadius() * scale;
+    light.color = object->material->emisiveColor;
+    light.power = power * light.radius * light.radius;
+    lights.push_back(light);
+
+    object->isLightSource = true;
+}
+
+void LightTree::buildFromScene(SceneObject* root)
+{
+    TRACE_ZONE("build light tree");
+    std::vector<EmissiveLight> sceneLights = std::vector<EmissiveLight>();
+    collectEmissiveObjects(root, glm::mat4x4(1), sceneLights);
+    build(sceneLights);
+    printf("Found %d emissive lights.\n", size());
+}
+
+void LightTree::refitFromScene(SceneObject* root)
+{
+    std::vector<EmissiveLight> sceneLights = std::vector<EmissiveLight>();
+    collectEmissiveObjects(root, glm::mat4x4(1), sceneLights);
+
+    std::map<SceneObject*, EmissiveLight*> lightsByObject;
+    for (int i = 0; i < (int)sceneLights.size(); i++) {
+        lightsByObject[sceneLights[i].object] = &sceneLights[i];
+    }
+
+    bool changed = sceneLights.size() != lights.size();
+    for (int i = 0; i < (int)lights.size() && !changed; i++) {
+        auto found = lightsByObject.find(lights[i].object);
+        if (found == lightsByObject.end()) {
+            changed = true;
+        } else {
+            lights[i] = *found->second;
+        }
+    }
+
+    if (changed) {
+        build(sceneLights);
+        return;
+    }
+
+    // children are always stored after their parent, so walking backwards updates them first.
+    for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+        LightTreeNode& node = nodes[n];
+        if (node.left < 0) {
+            EmissiveLight& light = lights[node.light];
+            glm::vec3 extent = glm::vec3(light.radius, light.radius, light.radius);
+            node.boundsMin = light.location - extent;
+            node.boundsMax = light.location + extent;
+            node.power = light.power;
+        } else {
+            LightTreeNode& left = nodes[node.left];
+            LightTreeNode& right = nodes[node.right];
+            node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+            node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+            node.power = left.power + right.power;
+        }
+    }
+}
+
+void LightTree::build(std::vector<EmissiveLight>& lights)
+{
+    this->lights = lights;
+    nodes.clear();
+    if (lights.size() == 0) return;
+    nodes.reserve(lights.size() * 2);
+    buildNode(0, (int)lights.size());
+}
+
+int LightTree::buildNode(int start, int end)
+{
+    LightTreeNode node;
+    node.boundsMin = glm::vec3(+INFINITY, +INFINITY, +INFINITY);
+    node.boundsMax = glm::vec3(-INFINITY, -INFINITY, -INFINITY);
+    node.power = 0;
+
+    glm::vec3 centerMin = glm::vec3(+INFINITY, +INFINITY, +INFINITY);
+    glm::vec3 centerMax = glm::vec3(-INFINITY, -INFINITY, -INFINITY);
+
+    for (int i = start; i < end; i++) {
+        glm::vec3 extent = glm::vec3(lights[i].radius, lights[i].radius, lights[i].radius);
+        node.boundsMin = glm::min(node.boundsMin, lights[i].location - extent);
+        node.boundsMax = glm::max(node.boundsMax, lights[i].location + extent);
+        centerMin = glm::min(centerMin, lights[i].location);
+        centerMax = glm::max(centerMax, lights[i].location);
+        node.power += lights[i].power;
+    }
+
+    int index = (int)nodes.size();
+    nodes.push_back(node);
+
+    if (end - start == 1) {
+        nodes[index].light = start;
+        return index;
+    }
+
+    // split at the median along the longest axis.
+    glm::vec3 delta = centerMax - centerMin;
+    int dim = (delta.x > delta.y && delta.x > delta.z) ? 0 : (delta.y > delta.z ? 1 : 2);
+    int mid = (start + end) / 2;
+    std::nth_element(lights.begin() + start, lights.begin() + mid, lights.begin() + end,
+        [dim](const EmissiveLight& a, const EmissiveLight& b) { return a.location[dim] < b.location[dim]; });
+
+    int left = buildNode(start, mid);
+    int right = buildNode(mid, end);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+float LightTree::importance(LightTreeNode& node, glm::vec3 p)
+{
+    // power over distance squared, but don't let this blow up when we are inside the bounds.
+    glm::vec3 center = (node.boundsMin + node.boundsMax) * 0.5f;
+    float radius2 = glm::length2(node.boundsMax - node.boundsMin) * 0.25f;
+    float distance2 = glm::length2(p - center);
+    return node.power / maxf(distance2, radius2);
+}
+
+EmissiveLight* LightTree::sample(glm::vec3 p, float u, float& pmf)
+{
+    pmf = 0;
+    if (nodes.size() == 0) return NULL;
+
+    pmf = 1;
+    u = clipf(u, 0.0f, 0.99999f);
+    int n = 0;
+
+    while (nodes[n].left >= 0) {
+        float leftImportance = importance(nodes[nodes[n].left], p);
+        float rightImportance = importance(nodes[nodes[n].right], p);
+        float total = leftImportance + rightImportance;
+        float pLeft = (total > 0) ? leftImportance / total : 0.5f;
+
+        // reuse u for the next level by rescaling it.
+        if (u < pLeft) {
+            u = u / pLeft;
+            pmf *= pLeft;
+            n = nodes[n].left;
+        } else {
+            u = (u - pLeft) / (1.0f - pLeft);
+            pmf *= (1.0f - pLeft);
+            n = nodes[n].right;
+        }
+    }
+
+    return &lights[nodes[n].light];
+}
@@ -0,0 +1,87 @@
+/**
+ * Light tree.
+ *
+ * Emissive objects in the scene are collected into a list at load time and organised into a bounding volume
+ * hierarchy over their locations.  Each node records the total power of the lights below it, which lets us pick
+ * a light in proportion to how much it is likely to contribute at a point by walking a single path down the tree.
+ * This makes choosing a light O(log n) rather than looping over every light in the scene.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "SceneObject.h"
+#include "Color.h"
+
+/** An emissive object that can be sampled directly. */
+struct EmissiveLight
+{
+    // the object emitting light.  A ray sampling this light must hit this object to receive its light.
+    SceneObject* object;
+
+    // center and radius of the objects bounding sphere in world space.
+    glm::vec3 location;
+    float radius;
+
+    // emitted light.
+    Color color;
+
+    // rough estimate of the total light emitted, used to decide how often to sample this light.
+    float power;
+};
+
+struct LightTreeNode
+{
+    // world space bounds of all lights below this node.
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // total power of lights below this node.
+    float power;
+
+    // child nodes, or -1 if this is a leaf.
+    int left = -1;
+    int right = -1;
+
+    // index of light for leaf nodes.
+    int light = -1;
+};
+
+class LightTree
+{
+protected:
+    std::vector<EmissiveLight> lights = std::vector<EmissiveLight>();
+    std::vector<LightTreeNode> nodes = std::vector<LightTreeNode>();
+
+    /** Builds node for lights in [start, end), returns its index. */
+    int buildNode(int start, int end);
+
+    /** Returns estimate of how much light from this node will reach point p. */
+    float importance(LightTreeNode& node, glm::vec3 p);
+
+public:
+
+    /** Builds tree from given lights. */
+    void build(std::vector<EmissiveLight>& lights);
+
+    /** Number of lights in the tree. */
+    int size() { return (int)lights.size(); }
+
+    /** Collects emissive objects in the scene graph below root and builds the tree from them.  Objects that are added
+     * as lights are flagged with isLightSource. */
+    void buildFromScene(SceneObject* root);
+
+    /** Updates the light locations and node bounds after objects below root have moved, keeping the trees structure.
+     * The tree is rebuilt if the set of emissive objects has changed. */
+    void refitFromScene(SceneObject* root);
+
+    /**
+     * Picks a light to sample from point p.
+     * @param u uniform random number in [0,1]
+     * @param pmf set to the probability that this light was selected.
+     * @returns the light selected, or NULL if there are no lights.
+     */
+    EmissiveLight* sample(glm::vec3 p, float u, float& pmf);
+};
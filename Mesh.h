@@ -12,6 +12,8 @@
 #include "Plane.h"
 #include "Sphere.h"
 #include "Utils.h"
+#include "TriangleBlock.h"
+#include "Trace.h"
 
 class Mesh : public ContainerObject
 {
@@ -20,14 +22,16 @@ protected:
         
     // Sets this objects mesh.  Normals will be calculated using right hand rule. 
     // if subdivision is set the mesh will be recursively subdivided into sub objects (faster to render)
-    void setMesh(std::vector<glm::vec3>* vertices, bool subDivide=true) {
+    // the vertices are copied, so can be freed (or shared) afterwards.
+    void setMesh(const std::vector<glm::vec3>* vertices, bool subDivide=true) {
+        TRACE_ZONE("Mesh");
 
         // some debuging helpers.
         const bool SHOW_VERTICES = false;
         const bool SHOW_ORIGIN = false;
 
-        // maximum number of triangles per subdivision.
-        const int SUB_DIVISION_THRESHOLD = 4;
+        // maximum number of triangles per subdivision, which are tested together as one block.
+        const int SUB_DIVISION_THRESHOLD = TRIANGLE_BLOCK_SIZE;
 
         int triangles = vertices->size() / 3;
 
@@ -96,6 +100,8 @@ protected:
                 // we did not actually divide the mesh.  This is a problem, and it can happen in some cases.
                 // in this case we just give up and ignore subdivision.
                 //printf(">>>>>  Warning, failed to split mesh with %d triangles!\n", triangles);
+                delete leftHalf;
+                delete rightHalf;
                 setMesh(vertices, false);
                 return;
             }
@@ -116,6 +122,8 @@ protected:
             // create the two halves and center meshes
             Mesh* left = new Mesh(leftCenter, leftHalf);
             Mesh* right = new Mesh(rightCenter, rightHalf);
+            delete leftHalf;
+            delete rightHalf;
             
             add(left);
             add(right);
@@ -141,16 +149,6 @@ protected:
                 add(vertexSphere);
             }
 
-            Plane* triangle = new Triangle(
-                (*vertices)[f*3+0],
-                (*vertices)[f*3+1],
-                (*vertices)[f*3+2]            
-            );
-
-            if (!showDivision) {
-                add(triangle);  
-            }                                              
-
             for (int i = 0; i < 3; i++) {
 
                 float r = glm::length((*vertices)[f*3+i]);
@@ -158,6 +156,13 @@ protected:
             }                            
         }
 
+        // triangles are added in blocks, which the SIMD kernels test all at once.
+        if (!showDivision) {
+            for (int f = 0; f < faces; f += TRIANGLE_BLOCK_SIZE) {
+                add(new TriangleBlock(&(*vertices)[f*3], std::min(TRIANGLE_BLOCK_SIZE, faces - f)));
+            }
+        }
+
         if (showDivision) {
             Sphere* sphere = new Sphere(glm::vec3(0,0,0), boundingSphereRadius);
             sphere->material->diffuseColor.a = 0.25;
@@ -168,14 +173,51 @@ protected:
 
     }    
 
+    /** Adds the triangle blocks of this mesh and all its sub meshes, so that the BVH replaces the sphere hierarchy
+     * rather than sitting on top of it. */
+    void getBVHObjects(std::vector<BVHObject>& objects) override {
+        addBVHObjects(objects, glm::vec3(0, 0, 0));
+    }
+
+    void addBVHObjects(std::vector<BVHObject>& objects, glm::vec3 offset) {
+        for (int i = 0; i < (int)children.size(); i++) {
+            Mesh* subMesh = dynamic_cast<Mesh*>(children[i]);
+            if (subMesh) {
+                subMesh->addBVHObjects(objects, offset + subMesh->getLocation());
+                continue;
+            }
+            BVHObject object;
+            object.object = children[i];
+            object.offset = offset;
+            objects.push_back(object);
+        }
+    }
+
 public:
 
     bool showDivision = false;
 
-    /** Creates mesh from vertices.  Every triad of vertices is interpreted as a triangle. */
-    Mesh(glm::vec3 location, std::vector<glm::vec3>* vertices) : ContainerObject(location) {
+    void setAcceleration(Acceleration acceleration, std::vector<ContainerObject*>& builds) override {
+        // sub meshes are part of this meshes BVH, so unlike other containers they are left alone.
+        if (acceleration == this->acceleration) return;
+        this->acceleration = acceleration;
+        builds.push_back(this);
+    }
+
+    /** Creates mesh from vertices, multiplied by scale.  Every triad of vertices is interpreted as a triangle.
+     * The vertices are copied, so may be shared with other meshes (see ReadPLY). */
+    Mesh(glm::vec3 location, const std::vector<glm::vec3>* vertices, float scale = 1.0f) : ContainerObject(location) {
         useContainerMaterial = true;
-        setMesh(vertices);                
+        if (!vertices) return;
+        if (scale == 1.0f) {
+            setMesh(vertices);
+            return;
+        }
+        std::vector<glm::vec3> scaled(vertices->size());
+        for (int i = 0; i < (int)vertices->size(); i++) {
+            scaled[i] = (*vertices)[i] * scale;
+        }
+        setMesh(&scaled);
     }    
 
 };
\ No newline at end of file
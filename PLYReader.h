@@ -14,6 +14,10 @@
 #include <string>
 #include <sstream>
 #include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "Trace.h"
 
 using namespace std;
 
@@ -24,7 +28,8 @@ bool startsWith(string s, string prefix) {
 
 /** Load in a ply file, return vertices, where each triangle has 3 vertices. 
  * Returns NULL if there was an error. */
-vector<glm::vec3>* ReadPLY(const char* filename, float scale = 1.0f) {
+vector<glm::vec3>* ReadPLYFile(const char* filename) {
+    TRACE_ZONE("ReadPLY");
 
     string line;    
     ifstream file(filename);
@@ -33,7 +38,7 @@ vector<glm::vec3>* ReadPLY(const char* filename, float scale = 1.0f) {
     int faceCount;
 
     vector<glm::vec3>* verticesOut = new vector<glm::vec3>();
-    vector<glm::vec3>* vertices = new vector<glm::vec3>();
+    vector<glm::vec3> vertices;
     
     if (file.is_open()) {
         
@@ -63,7 +68,7 @@ vector<glm::vec3>* ReadPLY(const char* filename, float scale = 1.0f) {
             stringstream ss;                    
             ss<<line;
             ss>>p.x>>p.y>>p.z;
-            vertices->push_back(p);
+            vertices.push_back(p);
         }
 
         for (int f = 0; f < faceCount; f++) {
@@ -75,18 +80,33 @@ vector<glm::vec3>* ReadPLY(const char* filename, float scale = 1.0f) {
             if (degree != 3) {
                 cout << "Error, mesh must be triangle based but found face with " << degree << " vertices on line: \n" << line;
                 file.close();
+                delete verticesOut;
                 return NULL;
             }            
             // we just add the vertices together, no need to seperate out faces at the moment.            
-            verticesOut->push_back((*vertices)[a]*scale);
-            verticesOut->push_back((*vertices)[b]*scale);
-            verticesOut->push_back((*vertices)[c]*scale);            
+            verticesOut->push_back(vertices[a]);
+            verticesOut->push_back(vertices[b]);
+            verticesOut->push_back(vertices[c]);            
         }
         file.close();
         return verticesOut;
     } else {
         printf("Error, can not read PLY file %s", filename);
+        delete verticesOut;
         return NULL;
     }
 
+}
+
+/** Returns the vertices of a ply file as ReadPLYFile does, but only reads each file once, so that scenes using the
+ * same model (at any scale, see Mesh) share one copy of it.  The vertices are kept until the program exits. */
+const vector<glm::vec3>* ReadPLY(const char* filename) {
+    static map<string, vector<glm::vec3>*> loaded;
+    static mutex loadedMutex;
+
+    // held while reading, so two scenes loading the same file at once don't both read it.
+    lock_guard<mutex> lock(loadedMutex);
+    vector<glm::vec3>*& vertices = loaded[filename];
+    if (!vertices) vertices = ReadPLYFile(filename);
+    return vertices;
 }
\ No newline at end of file
@@ -30,6 +30,8 @@ bool Plane::isInside(glm::vec3 p)
 */
 bool Plane::intersectObject(Ray* ray)
 {	
+	RAY_COUNT_TESTS(ray, primitiveTests, 1);
+
 	glm::vec3 vdif = ray->pos - v1;
 	float vdotn = glm::dot(ray->dir, normal);
 	if (fabs(vdotn) < EPSILON) return false;
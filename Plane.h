@@ -57,6 +57,16 @@ public:
 	};
 
 	virtual bool isInside(glm::vec3 p);
+
+    bool getLocalBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) override {
+        if (!bounded) return false;
+        boundsMin = glm::min(glm::min(v1, v2), glm::min(v3, v4));
+        boundsMax = glm::max(glm::max(v1, v2), glm::max(v3, v4));
+        return true;
+    }
+
+    glm::vec3 getNormal() { return normal; }
+    glm::vec3 getTangent() { return tangent; }
 	
 	bool intersectObject(Ray* ray) override;
 
@@ -80,6 +90,12 @@ public:
         this->uvScale = 1.0f/glm::vec2(glm::length(v2-v1), glm::length(v3-v1));        
 	};
     
+    bool getLocalBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) override {
+        boundsMin = glm::min(glm::min(v1, v2), v3);
+        boundsMax = glm::max(glm::max(v1, v2), v3);
+        return true;
+    }
+
 	bool isInside(glm::vec3 p) override {
         
         float a1 = glm::dot(glm::cross(v2-v1,p-v1), normal);
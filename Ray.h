@@ -9,6 +9,29 @@
 
 class SceneObject;
 
+// RAY_COST counts the tests each ray makes, for the LM_COST heatmap.  RAY_STATS totals these counts, so needs them too.
+#if defined(RAY_STATS) && !defined(RAY_COST)
+#define RAY_COST
+#endif
+
+#ifdef RAY_COST
+/** Adds n to the rays counter (boundsTests or primitiveTests). */
+#define RAY_COUNT_TESTS(ray, counter, n) ((ray)->counter += (n))
+#else
+#define RAY_COUNT_TESTS(ray, counter, n)
+#endif
+
+/** What a ray is being traced for, used for statistics. */
+enum RayType
+{
+	RT_PRIMARY,
+	RT_SHADOW,
+	RT_GI,
+	RT_REFLECTION,
+	RT_REFRACTION,
+	RT_COUNT
+};
+
 /** Structure containing information about a ray / object intersection.
 * It is often more efficent to calculate these values at once than to
 * do them individually.  Especially is the object is a composite object. */
@@ -75,6 +98,18 @@ public:
     bool shadowTrace = false;
     // This is a global illuminaton ray trace.
     bool giRay = false;
+    // what the ray is being traced for.  Shadow and gi rays have their own flags above as they change how the ray is
+    // intersected, this is only used for counting.
+    RayType type = RT_PRIMARY;
+
+    // bounding sphere and primitive tests made while intersecting this ray, shown by the LM_COST lighting model.  Only
+    // counted when building with RAY_COST (or RAY_STATS), see RAY_COUNT_TESTS.
+    int boundsTests = 0;
+    int primitiveTests = 0;
+
+    // set once the ray has been intersected with the scene as part of a packet, so that its collision can be used
+    // without tracing it again.
+    bool intersected = false;
     
     Ray()
 	{
@@ -97,3 +132,15 @@ public:
         dir = glm::normalize(glm::vec3(transform * glm::vec4(dir,0)));
     }
 };
+
+// number of rays in a packet.  The rays taken part are given by a bitmask, so this is at most 32.
+const int RAY_PACKET_SIZE = 8;
+
+/** Rays that are traced together through the acceleration structures, such as the camera rays of neighbouring
+ * pixels.  Which of the rays take part is given by a bitmask passed along with the packet, so that the rays can
+ * split up without being copied. */
+struct RayPacket
+{
+	Ray* rays[RAY_PACKET_SIZE];
+	int count = 0;
+};
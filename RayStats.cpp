@@ -0,0 +1,130 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Per thread ray statistics.
+-------------------------------------------------------------*/
+
+#include "RayStats.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+static std::mutex statsMutex;
+
+// counters of the threads that are currently running.
+static std::vector<RayStats*> threadStats;
+
+// counts left behind by threads that have exited.
+static RayStats retiredStats;
+
+/** A threads counters, registered so they can be summed while the thread is alive. */
+struct ThreadRayStats
+{
+    RayStats stats;
+
+    ThreadRayStats()
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        threadStats.push_back(&stats);
+    }
+
+    ~ThreadRayStats()
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        retiredStats.add(stats);
+        threadStats.erase(std::find(threadStats.begin(), threadStats.end(), &stats));
+    }
+};
+
+uint64_t RayStats::totalRays() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < RT_COUNT; i++) {
+        total += rays[i];
+    }
+    return total;
+}
+
+void RayStats::add(const RayStats& other)
+{
+    for (int i = 0; i < RT_COUNT; i++) {
+        rays[i] += other.rays[i];
+#ifdef RAY_STATS
+        hits[i] += other.hits[i];
+        boundsTests[i] += other.boundsTests[i];
+        primitiveTests[i] += other.primitiveTests[i];
+#endif
+    }
+#ifdef RAY_STATS
+    for (int i = 0; i < RAY_STATS_DEPTHS; i++) {
+        depth[i] += other.depth[i];
+    }
+#endif
+}
+
+RayStats& threadRayStats()
+{
+    static thread_local ThreadRayStats local;
+    return local.stats;
+}
+
+RayStats getRayStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    RayStats total = retiredStats;
+    for (int i = 0; i < (int)threadStats.size(); i++) {
+        total.add(*threadStats[i]);
+    }
+    return total;
+}
+
+void resetRayStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    retiredStats = RayStats();
+    for (int i = 0; i < (int)threadStats.size(); i++) {
+        *threadStats[i] = RayStats();
+    }
+}
+
+const char* getRayTypeName(int type)
+{
+    switch (type) {
+        case RT_PRIMARY: return "primary";
+        case RT_SHADOW: return "shadow";
+        case RT_GI: return "gi";
+        case RT_REFLECTION: return "reflection";
+        case RT_REFRACTION: return "refraction";
+        default: return "unknown";
+    }
+}
+
+void printRayStats(const RayStats& stats)
+{
+#ifdef RAY_STATS
+    printf("%-12s %12s %8s %12s %12s\n", "rays", "count", "hit %", "bounds/ray", "prims/ray");
+#else
+    printf("%-12s %12s\n", "rays", "count");
+#endif
+    for (int type = 0; type < RT_COUNT; type++) {
+        if (stats.rays[type] == 0) continue;
+#ifdef RAY_STATS
+        double rays = (double)stats.rays[type];
+        printf("%-12s %12llu %8.1f %12.1f %12.1f\n", getRayTypeName(type), (unsigned long long)stats.rays[type],
+            100.0 * stats.hits[type] / rays, stats.boundsTests[type] / rays, stats.primitiveTests[type] / rays);
+#else
+        printf("%-12s %12llu\n", getRayTypeName(type), (unsigned long long)stats.rays[type]);
+#endif
+    }
+    printf("%-12s %12llu\n", "total", (unsigned long long)stats.totalRays());
+
+#ifdef RAY_STATS
+    printf("camera rays by bounce:");
+    for (int i = 0; i < RAY_STATS_DEPTHS; i++) {
+        printf(" %llu%s", (unsigned long long)stats.depth[i], i + 1 == RAY_STATS_DEPTHS ? "+" : "");
+    }
+    printf("\n");
+#endif
+}
@@ -0,0 +1,66 @@
+/**
+ * Ray statistics.
+ *
+ * Counts the rays traced by each thread, by type.  Each thread counts into its own block of counters so tracing never
+ * waits on a lock, and the blocks are added together when the totals are read.  Reading and resetting the counters
+ * is only exact when nothing is rendering.
+ *
+ * Building with RAY_STATS defined also counts the hits, bounding sphere tests and primitive tests made by each type of
+ * ray, and the number of camera rays at each bounce.  The tests are counted on each ray (see RAY_COUNT_TESTS) in the
+ * innermost intersection loops, so without RAY_STATS (or RAY_COST, which counts them just for the cost heatmap) they
+ * are compiled out completely.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "Ray.h"
+
+// bounces counted separately in RayStats::depth, deeper bounces are added to the last one.
+const int RAY_STATS_DEPTHS = 10;
+
+#ifdef RAY_STATS
+/** Adds one to the calling threads counter[index]. */
+#define RAY_STAT(counter, index) (threadRayStats().counter[index]++)
+#else
+#define RAY_STAT(counter, index)
+#endif
+
+struct RayStats
+{
+    // rays traced against the scene, by type.
+    uint64_t rays[RT_COUNT] = {};
+
+#ifdef RAY_STATS
+    // rays that hit something, by type.
+    uint64_t hits[RT_COUNT] = {};
+    // bounding sphere tests made by each type of ray.
+    uint64_t boundsTests[RT_COUNT] = {};
+    // sphere, plane, triangle and cylinder tests made by each type of ray.
+    uint64_t primitiveTests[RT_COUNT] = {};
+    // rays traced from the camera by bounce (not including shadow rays).
+    uint64_t depth[RAY_STATS_DEPTHS] = {};
+#endif
+
+    /** Total number of rays of all types. */
+    uint64_t totalRays() const;
+
+    /** Adds other's counts to these. */
+    void add(const RayStats& other);
+};
+
+/** Returns the calling threads counters. */
+RayStats& threadRayStats();
+
+/** Returns the counts summed over every thread, including threads that have since exited. */
+RayStats getRayStats();
+
+/** Sets every threads counters to zero. */
+void resetRayStats();
+
+/** Returns a short lower case name for the ray type, for example "shadow". */
+const char* getRayTypeName(int type);
+
+/** Prints a table of the counts, with the tests made per ray when they are being counted. */
+void printRayStats(const RayStats& stats);
@@ -2,36 +2,33 @@
 * COSC 363  Computer Graphics (2018)
 * Ray tracer 
 * See Lab07.pdf for details.
+* This is the interactive front end, see RenderCLI.cpp for rendering without a display.
 *=========================================================================
 */
 
-// make sure GFX loads first
 #include "GFX.h"
 
+#ifdef __APPLE__
+	#include <GLUT/glut.h>
+#else
+	#include <GL/glut.h>
+#endif
+
 #include <stdio.h>
 
 #include <iostream>
 #include <cmath>
 #include <vector>
 #include <sstream>
+#include <chrono>
 
 #include <glm/glm.hpp>
 
-#include "SceneObject.h"
-#include "ContainerObject.h"
-#include "Ray.h"
-#include "Sphere.h"
-#include "Plane.h"
-#include "Cylinder.h"
-#include "Cube.h"
 #include "Scene.h"
-#include "Light.h"
-#include "Mesh.h"
-
-#include "ExampleScenes.h"
+#include "SceneLibrary.h"
 
 #include "Camera.h"
-#include "PLYReader.h"
+#include "Trace.h"
 #include "time.h"
 
 #include "math.h"
@@ -57,6 +54,10 @@ vector<Scene*> scenes = vector<Scene*>();
 
 bool DOUBLE_RENDER = true;
 bool AUTO_RENDER = true;
+bool DENOISE = false;
+
+// acceleration structure used by every scene, cycled with 'b'.
+Acceleration ACCELERATION = ACCEL_SPHERES;
 
 enum RUN_MODE {RM_MANUAL, RM_RENDER_AND_EXIT};
 
@@ -96,9 +97,12 @@ void activateScene(int sceneNumber)
     
     currentScene = scenes[sceneNumber];
     if (!currentScene->isLoaded()) {
-        currentScene->load();
+        currentScene->load(ACCELERATION);
+    } else {
+        currentScene->setAcceleration(ACCELERATION);
     }
     camera = currentScene->camera;
+    camera->framebuffer.denoise = DENOISE;
 
     // stick to quick updates in animated mode.
     DOUBLE_RENDER = !currentScene->isAnimated;
@@ -109,7 +113,7 @@ void redraw()
 {
     render_mode = RM_LQ;
     camera->reset();
-    gfx.clear();
+    camera->framebuffer.clear();
     passes = 0;
 }
 
@@ -123,6 +127,22 @@ void specialKeyboard(int key, int x, int y)
         case GLUT_KEY_F5: camera->lightingModel = LM_LOCAL; break;    
         case GLUT_KEY_F6: camera->lightingModel = LM_NORMAL; break;    
         case GLUT_KEY_F7: camera->lightingModel = LM_UV; break;    
+        case GLUT_KEY_F8: camera->lightingModel = LM_PATH; break;    
+        case GLUT_KEY_F10: 
+#ifdef RAY_COST
+            // pressing again toggles counting shadow rays.
+            if (camera->lightingModel == LM_COST) camera->costShadowRays = !camera->costShadowRays;
+            camera->lightingModel = LM_COST;
+            printf("Cost heatmap%s: black 0 tests, blue 4, cyan 16, green 64, yellow 256, red %d, white more.\n",
+                camera->costShadowRays ? " with shadow rays" : "", COST_HEATMAP_MAX);
+#else
+            printf("The cost heatmap needs a build with RAY_COST or RAY_STATS defined.\n");
+#endif
+            break;
+        case GLUT_KEY_F9: 
+            camera->samplerType = (SamplerType)((camera->samplerType + 1) % 3);
+            printf("Sampler %d\n", camera->samplerType);
+            break;
     }
     redraw();
 }
@@ -147,7 +167,17 @@ void keyboard(unsigned char key, int x, int y)
         case 'c': camera->move(0, 0, -1); break;
         case 'q': camera->rotate(+0.1f,0); break;
         case 'e': camera->rotate(-0.1f,0); break;
-        case 'p': gfx.screenshot("Screenshot.tga");
+        case 'n': 
+            DENOISE = !DENOISE; 
+            camera->framebuffer.denoise = DENOISE;
+            printf("Denoiser %s.\n", DENOISE ? "on" : "off");
+            break;
+        case 'b':
+            ACCELERATION = (Acceleration)((ACCELERATION + 1) % ACCEL_COUNT);
+            currentScene->setAcceleration(ACCELERATION);
+            printf("Acceleration %s.\n", getAccelerationName(ACCELERATION));
+            break;
+        case 'p': camera->framebuffer.save("Screenshot.tga");
         case ' ': 
             // force render, but also print locaiton.
             printf("Camera at:");
@@ -162,7 +192,7 @@ void keyboard(unsigned char key, int x, int y)
     
     if (AUTO_RENDER) {
         // auto render draws all the time, but camera needs reseting on movement
-        gfx.clear(Color(0,0,0,0),true);
+        camera->framebuffer.clear(Color(0,0,0,0),true);
         camera->reset();
         render_mode = RM_LQ;
     } else {
@@ -188,45 +218,61 @@ void update(void)
 		return;
 	}
     
-	clock_t t;
-	t = clock();
+	// wall clock time, clock() would add up the time spent on every thread.
+	auto t = std::chrono::steady_clock::now();
 	int pixelsRendered = 0;
 	switch (render_mode) {
 		case RM_LQ:
             camera->superSample = LQ_RAYS;
             camera->GI_SAMPLES = 4; // super quick render...
+            camera->PATH_SAMPLES = 1;
             camera->lqMode = true;
 			pixelsRendered = camera->render(currentScene, 5 * 1000, false);
 			if (pixelsRendered == 0) {
                 // update on frame finish.
-                currentScene->update();
+                if (currentScene->isAnimated) {
+                    currentScene->update();
+                    currentScene->refit();
+                }
                 if (DOUBLE_RENDER) {                    
 				    render_mode = RM_HQ;
 				    camera->reset();
                 } else if (AUTO_RENDER) {
                     camera->reset();
-                    gfx.clear(Color(0,0,0,0), true);
+                    camera->framebuffer.clear(Color(0,0,0,0), true);
                 }
 			}
 			break;
 		case RM_HQ:
             camera->superSample = HQ_RAYS;
             camera->GI_SAMPLES = 64;
+            camera->PATH_SAMPLES = 16;
             camera->lqMode = false;
 			pixelsRendered = camera->render(currentScene, 5 * 100, false);
 			if (pixelsRendered == 0) {
                 passes++;
-                printf(">>>> Pass %d\n", passes);
+                printf(">>>> Pass %d (%d pixels sampled)\n", passes, camera->getNoisyPixels());
+#ifdef RAY_STATS
+                printRayStats(getRayStats());
+                resetRayStats();
+#endif
+                bool converged = camera->isConverged();
+                if (DENOISE) camera->framebuffer.updateImage();
                 if (mode == RM_RENDER_AND_EXIT) {
-                    gfx.screenshot(currentScene->name+"_"+std::to_string(passes)+".tga");                    
-                    if (passes >= requiredPasses) exit;
+                    camera->framebuffer.save(currentScene->name+"_"+std::to_string(passes)+".tga");                    
+                    if (passes >= requiredPasses || converged) exit(0);
+                }
+                if (converged) {
+                    // every pixel is below the error threshold, so there is nothing more to do until something changes.
+                    printf("Image converged after %d passes.\n", passes);
+                    render_mode = RM_NONE;
                 }
                 camera->reset();				
 			}
 			break;
 	}
 	
-	float timeTaken = float(clock() - t) / CLOCKS_PER_SEC;	
+	float timeTaken = std::chrono::duration<float>(std::chrono::steady_clock::now() - t).count();	
 	totalTimeTaken += timeTaken;
     totalPixelsRendered += pixelsRendered;
     float pixelsPerSecond = (totalTimeTaken == 0) ? -1 : totalPixelsRendered / totalTimeTaken;
@@ -240,8 +286,43 @@ void update(void)
 	lastFrameTime = currentTime;
 }
 
+/** Draws the cost heatmaps colour scale along the bottom of the screen, with a tick at each power of 4. */
+void drawCostLegend()
+{
+    const int LEGEND_WIDTH = 256;
+    const int LEGEND_HEIGHT = 8;
+    int top = gfx.getHeight() - LEGEND_HEIGHT - 4;
+    int nextTick = 1;
+    for (int x = 0; x < LEGEND_WIDTH; x++) {
+        float tests = pow(1.0f + COST_HEATMAP_MAX, (float)x / (LEGEND_WIDTH - 1)) - 1.0f;
+        bool tick = tests >= nextTick;
+        if (tick) nextTick *= 4;
+        for (int y = 0; y < LEGEND_HEIGHT; y++) {
+            gfx.putPixel(4 + x, top + y, Camera::getCostColor(tests));
+        }
+        if (tick) {
+            gfx.putPixel(4 + x, top - 1, Color(1,1,1,1));
+            gfx.putPixel(4 + x, top - 2, Color(1,1,1,1));
+        }
+    }
+}
+
 void display(void)
 {
+    gfx.show(camera->framebuffer);
+
+    if (camera->lightingModel == LM_COST) {
+        drawCostLegend();
+    }
+
+    if (render_mode == RM_HQ) {
+        // show where we are up to.
+        int x = camera->getPixelOn() % camera->framebuffer.getWidth();
+        int y = camera->getPixelOn() / camera->framebuffer.getWidth();
+        gfx.putPixel(x, y+1, Color(0,0,0,1));            
+        gfx.putPixel(x, y+2, Color(1,1,1,1));                
+    }
+
 	gfx.blit();
 }
 
@@ -252,23 +333,36 @@ void initialize()
 
     printf("Loading scenes.\n");
     
-    scenes.push_back(new TestScene()); // this is realy just here to pad out scene '0'.
-    scenes.push_back(new BasicScene());        
-    scenes.push_back(new CornellBoxScene());        
-    scenes.push_back(new AnimatedScene());        
-    scenes.push_back(new MaterialSpheresScene());        
-    scenes.push_back(new DragonScene());        
-    scenes.push_back(new ManyDragonsScene());        
-    scenes.push_back(new AreaLightScene());        
-    scenes.push_back(new MillionCubes());        
-    
-    
+    for (int i = 0; i < getSceneCount(); i++) {
+        scenes.push_back(createScene(i));
+    }
+
     activateScene(initialScene);
 
 }
 
 int main(int argc, char *argv[]) {
 
+    // optional timeline trace, can go anywhere in the arguments.
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--trace") {
+            setTraceThreadName("main");
+            startTrace(argv[i + 1]);
+            atexit([]() { stopTrace(); });
+            for (int j = i; j + 2 < argc; j++) {
+                argv[j] = argv[j + 2];
+            }
+            argc -= 2;
+            break;
+        }
+    }
+
+    // optional denoise flag after the scene number.
+    if (argc == 3 && std::string(argv[2]) == "--denoise") {
+        DENOISE = true;
+        argc--;
+    }
+
     switch (argc) {
         case 1: 
             // standard            
@@ -0,0 +1,212 @@
+/*========================================================================
+* Ray tracer, command line front end.
+*
+* Renders a scene straight to file using all cores, without opening a window (or linking against OpenGL).
+*
+* Usage: RenderCLI.exe <scene> [options], run with --help for the options.
+*        RenderCLI.exe --batch <file> [--jobs n] renders every job listed in file.
+*        RenderCLI.exe <scene> [options] --serve <port> coordinates a render across workers started with
+*        RenderCLI.exe --worker <host:port>.
+*        RenderCLI.exe --benchmark [options] renders each example scene with fixed settings and reports timings.
+*=========================================================================
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "SceneLibrary.h"
+#include "RenderJob.h"
+#include "DistributedRender.h"
+#include "Benchmark.h"
+#include "Trace.h"
+
+using namespace std;
+
+static void printUsage()
+{
+    printf("Usage: RenderCLI.exe <scene> [options]\n");
+    printRenderJobOptions();
+    printf("  --list                list the scenes\n");
+    printf("  --trace <file>        write a timeline of loading and rendering to file (Chrome trace JSON), works\n");
+    printf("                        with every mode\n");
+    printf("\n");
+    printf("Usage: RenderCLI.exe --batch <file> [--jobs <n>]\n");
+    printf("  --batch <file>        render the jobs in file, one job per line using the options above\n");
+    printf("  --jobs <n>            number of jobs to render at once (default 2)\n");
+    printf("\n");
+    printf("Usage: RenderCLI.exe <scene> [options] --serve <port>\n");
+    printf("       RenderCLI.exe --worker <host:port>\n");
+    printf("  --serve <port>        render by handing out rows to workers that connect to port\n");
+    printf("  --worker <host:port>  render rows for the coordinator at host:port until its job is done\n");
+    printf("\n");
+    printf("Usage: RenderCLI.exe --benchmark [options] [--scenes <a,b,...>] [--json <file>]\n");
+    printf("  --benchmark           render each scene at 256x192, 2 passes of 8 samples, unless options say otherwise\n");
+    printf("  --scenes <a,b,...>    scenes to benchmark (default all scenes that need no extra files)\n");
+    printf("  --json <file>         file to write the results to (default benchmark.json)\n");
+}
+
+/** Splits a comma separated list. */
+static vector<string> splitList(string list)
+{
+    vector<string> items;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+/** Renders the benchmark scenes with the job options in args, and writes the results to jsonFile. */
+static int runBenchmarks(vector<string>& args, vector<string> scenes, string jsonFile)
+{
+    if (scenes.empty()) scenes = getBenchmarkScenes();
+
+    // job options are checked against the first scene, the others are swapped in as they are rendered.
+    RenderJob job;
+    setupBenchmarkJob(job);
+    args.insert(args.begin(), scenes[0]);
+    string error;
+    if (!parseRenderJob(args, job, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return -1;
+    }
+
+    vector<BenchmarkResult> results;
+    if (!runBenchmark(scenes, job, results)) return -1;
+    if (!writeBenchmarkJSON(jsonFile, job, results)) return -1;
+    printf("Wrote results to %s.\n", jsonFile.c_str());
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    vector<string> args;
+    string batchFile;
+    int concurrentJobs = 2;
+    int servePort = 0;
+    string coordinator;
+    bool benchmark = false;
+    vector<string> benchmarkScenes;
+    string jsonFile = "benchmark.json";
+    string traceFile;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "--help") {
+            printUsage();
+            return 0;
+        }
+        if (arg == "--list") {
+            for (int j = 0; j < getSceneCount(); j++) {
+                printf("%d %s\n", j, getSceneName(j).c_str());
+            }
+            return 0;
+        }
+        if (arg == "--benchmark") {
+            benchmark = true;
+            continue;
+        }
+        if ((arg == "--batch" || arg == "--jobs" || arg == "--serve" || arg == "--worker" || arg == "--scenes" ||
+            arg == "--json" || arg == "--trace") && i + 1 < argc) {
+            string value = argv[++i];
+            if (arg == "--batch") {
+                batchFile = value;
+            } else if (arg == "--scenes") {
+                benchmarkScenes = splitList(value);
+            } else if (arg == "--json") {
+                jsonFile = value;
+            } else if (arg == "--trace") {
+                traceFile = value;
+            } else if (arg == "--worker") {
+                coordinator = value;
+            } else if (arg == "--serve") {
+                servePort = atoi(value.c_str());
+                if (servePort <= 0 || servePort > 65535) {
+                    fprintf(stderr, "Invalid value %s for --serve.\n", value.c_str());
+                    return -1;
+                }
+            } else {
+                concurrentJobs = atoi(value.c_str());
+                if (concurrentJobs <= 0) {
+                    fprintf(stderr, "Invalid value %s for --jobs.\n", value.c_str());
+                    return -1;
+                }
+            }
+            continue;
+        }
+        args.push_back(arg);
+    }
+
+    if (!traceFile.empty()) {
+        setTraceThreadName("main");
+        startTrace(traceFile);
+        atexit([]() { stopTrace(); });
+    }
+
+    if (!coordinator.empty()) {
+        size_t colon = coordinator.rfind(':');
+        int port = (colon == string::npos) ? 0 : atoi(coordinator.c_str() + colon + 1);
+        if (port <= 0) {
+            fprintf(stderr, "Invalid value %s for --worker, expected host:port.\n", coordinator.c_str());
+            return -1;
+        }
+        return runRenderWorker(coordinator.substr(0, colon), port) ? 0 : -1;
+    }
+
+    if (benchmark) {
+        return runBenchmarks(args, benchmarkScenes, jsonFile);
+    }
+
+    if (!batchFile.empty()) {
+        if (!args.empty()) {
+            fprintf(stderr, "Unexpected argument %s, job options go in the batch file.\n", args[0].c_str());
+            return -1;
+        }
+        vector<RenderJob> jobs;
+        if (!loadRenderJobs(batchFile, jobs)) return -1;
+
+        printf("Rendering %d jobs from %s, %d at a time.\n", (int)jobs.size(), batchFile.c_str(), concurrentJobs);
+        int failed = renderBatch(jobs, concurrentJobs);
+        if (failed > 0) {
+            fprintf(stderr, "%d jobs failed.\n", failed);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (args.empty()) {
+        printUsage();
+        return -1;
+    }
+
+    RenderJob job;
+    string error;
+    if (!parseRenderJob(args, job, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return -1;
+    }
+
+    int sceneNumber = findScene(job.scene);
+    printf("Rendering scene %s (%dx%d) to %s.\n", getSceneName(sceneNumber).c_str(), job.width, job.height, job.output.c_str());
+
+    Scene* scene = createScene(sceneNumber);
+    scene->load(job.acceleration);
+
+    if (servePort > 0) {
+        if (job.frames > 0) {
+            fprintf(stderr, "Animations can not be rendered with --serve.\n");
+            return -1;
+        }
+        return renderDistributed(scene, scene->camera, job, args, servePort) >= 0 ? 0 : -1;
+    }
+
+    renderJob(scene, scene->camera, job);
+
+    return 0;
+}
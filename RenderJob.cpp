@@ -0,0 +1,656 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Renders a scene to file without a display.
+-------------------------------------------------------------*/
+
+#include "RenderJob.h"
+#include "SceneLibrary.h"
+#include "ImageWriter.h"
+#include "HDRWriter.h"
+#include "Trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+void printRenderJobOptions()
+{
+    printf("  <scene>               scene name or number, see --list\n");
+    printf("  --output <file>       output file, .pfm or .exr for floating point (default render.tga)\n");
+    printf("  --width <pixels>      image width (default %d)\n", SCREEN_WIDTH);
+    printf("  --height <pixels>     image height (default %d)\n", SCREEN_HEIGHT);
+    printf("  --lighting <model>    direct, gi, path, uv, depth, normal, world, local or cost (default from scene)\n");
+    printf("  --cost-shadows        include shadow rays in the cost heatmap\n");
+    printf("  --passes <n>          maximum number of passes (default 16)\n");
+    printf("  --samples <n>         samples per pixel per pass (GI or path samples)\n");
+    printf("  --time <seconds>      stop after the pass that exceeds this time\n");
+    printf("  --sampler <type>      random, sobol or bluenoise (default sobol)\n");
+    printf("  --threads <n>         number of threads (default all cores)\n");
+    printf("  --accel <type>        spheres, bvh4, bvh8, bvh4q16, bvh8q16, bvh4q8 or bvh8q8 (default spheres)\n");
+    printf("  --no-packets          trace camera and shadow rays one at a time rather than in packets\n");
+    printf("  --wavefront           path trace a bounce at a time with sorted rays (path lighting only)\n");
+    printf("  --camera <x,y,z>      camera location (default from scene)\n");
+    printf("  --rotation <x,y,z>    camera rotation (default from scene)\n");
+    printf("  --denoise             denoise the final image\n");
+    printf("  --aovs                also write albedo, normal, depth, position, uv and sample count layers\n");
+    printf("  --frames <n>          render an animation of n frames to a numbered image sequence\n");
+    printf("  --checkpoint <secs>   seconds between checkpoints, 0 to disable (default 60)\n");
+    printf("  --resume              continue from the outputs checkpoint if there is one\n");
+}
+
+// names of the lighting models, in the same order as LightingModel.
+static const char* LIGHTING_MODEL_NAMES[] = {"direct", "gi", "uv", "depth", "normal", "world", "local", "path", "cost"};
+static const int LIGHTING_MODELS = sizeof(LIGHTING_MODEL_NAMES) / sizeof(LIGHTING_MODEL_NAMES[0]);
+
+static int parseLightingModel(std::string name)
+{
+    for (int i = 0; i < LIGHTING_MODELS; i++) {
+        if (name == LIGHTING_MODEL_NAMES[i]) return i;
+    }
+    return -1;
+}
+
+const char* getLightingModelName(int lightingModel)
+{
+    if (lightingModel < 0 || lightingModel >= LIGHTING_MODELS) return "unknown";
+    return LIGHTING_MODEL_NAMES[lightingModel];
+}
+
+static int parseSamplerType(std::string name)
+{
+    if (name == "random") return ST_RANDOM;
+    if (name == "sobol") return ST_SOBOL;
+    if (name == "bluenoise") return ST_BLUE_NOISE;
+    return -1;
+}
+
+/** Parses a positive integer, returns -1 if invalid. */
+static int parseInt(std::string s)
+{
+    char* end;
+    long value = strtol(s.c_str(), &end, 10);
+    if (s.empty() || *end != '\0' || value < 0) return -1;
+    return (int)value;
+}
+
+/** Parses a vector in the form x,y,z. */
+static bool parseVec3(std::string s, glm::vec3& v)
+{
+    char extra;
+    return sscanf(s.c_str(), "%f,%f,%f%c", &v.x, &v.y, &v.z, &extra) == 3;
+}
+
+bool parseRenderJob(std::vector<std::string>& args, RenderJob& job, std::string& error)
+{
+    bool haveScene = false;
+
+    for (int i = 0; i < (int)args.size(); i++) {
+        std::string arg = args[i];
+
+        if (arg == "--denoise") {
+            job.denoise = true;
+            continue;
+        }
+        if (arg == "--aovs") {
+            job.aovs = true;
+            continue;
+        }
+        if (arg == "--resume") {
+            job.resume = true;
+            continue;
+        }
+        if (arg == "--cost-shadows") {
+            job.costShadowRays = true;
+            continue;
+        }
+        if (arg == "--no-packets") {
+            job.rayPackets = false;
+            continue;
+        }
+        if (arg == "--wavefront") {
+            job.wavefront = true;
+            continue;
+        }
+
+        if (arg.compare(0, 2, "--") != 0) {
+            if (haveScene) {
+                error = "Unexpected argument " + arg + ".";
+                return false;
+            }
+            job.scene = arg;
+            haveScene = true;
+            continue;
+        }
+
+        // everything else takes a value.
+        if (i + 1 >= (int)args.size()) {
+            error = "Missing value for " + arg + ".";
+            return false;
+        }
+        std::string value = args[++i];
+        bool valid = true;
+
+        if (arg == "--output") {
+            job.output = value;
+        } else if (arg == "--width") {
+            job.width = parseInt(value);
+            valid = job.width > 0;
+        } else if (arg == "--height") {
+            job.height = parseInt(value);
+            valid = job.height > 0;
+        } else if (arg == "--lighting") {
+            job.lightingModel = parseLightingModel(value);
+            valid = job.lightingModel >= 0;
+        } else if (arg == "--passes") {
+            job.passes = parseInt(value);
+            valid = job.passes > 0;
+        } else if (arg == "--samples") {
+            job.samples = parseInt(value);
+            valid = job.samples > 0;
+        } else if (arg == "--time") {
+            job.timeLimit = (float)atof(value.c_str());
+            valid = job.timeLimit > 0;
+        } else if (arg == "--frames") {
+            job.frames = parseInt(value);
+            valid = job.frames > 0;
+        } else if (arg == "--checkpoint") {
+            job.checkpointInterval = (float)atof(value.c_str());
+            valid = job.checkpointInterval >= 0;
+        } else if (arg == "--sampler") {
+            int samplerType = parseSamplerType(value);
+            job.samplerType = (SamplerType)samplerType;
+            valid = samplerType >= 0;
+        } else if (arg == "--accel") {
+            int acceleration = parseAcceleration(value);
+            job.acceleration = (Acceleration)acceleration;
+            valid = acceleration >= 0;
+        } else if (arg == "--threads") {
+            job.threads = parseInt(value);
+            valid = job.threads >= 0;
+        } else if (arg == "--camera") {
+            job.setCameraLocation = valid = parseVec3(value, job.cameraLocation);
+        } else if (arg == "--rotation") {
+            job.setCameraRotation = valid = parseVec3(value, job.cameraRotation);
+        } else {
+            error = "Unknown option " + arg + ".";
+            return false;
+        }
+
+        if (!valid) {
+            error = "Invalid value " + value + " for " + arg + ".";
+            return false;
+        }
+    }
+
+    if (!haveScene) {
+        error = "No scene given.";
+        return false;
+    }
+
+    if (findScene(job.scene) < 0) {
+        error = "Unknown scene " + job.scene + ", use --list to see the scenes.";
+        return false;
+    }
+
+#ifndef RAY_COST
+    if (job.lightingModel == LM_COST) {
+        error = "The cost heatmap needs the tests each ray makes, build with -DRAY_COST or -DRAY_STATS to count them.";
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+bool loadRenderJobs(std::string filename, std::vector<RenderJob>& jobs)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        printf("Error, can not read job file %s.\n", filename.c_str());
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (getline(file, line)) {
+        lineNumber++;
+
+        std::vector<std::string> args;
+        std::stringstream ss(line);
+        std::string arg;
+        while (ss >> arg) args.push_back(arg);
+
+        if (args.empty() || args[0][0] == '#') continue;
+
+        RenderJob job;
+        std::string error;
+        if (!parseRenderJob(args, job, error)) {
+            printf("Error in %s line %d: %s\n", filename.c_str(), lineNumber, error.c_str());
+            return false;
+        }
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+// ------------------------------------------------------------
+// Checkpoints
+// ------------------------------------------------------------
+
+static const char CHECKPOINT_MAGIC[4] = {'R', 'T', 'C', 'P'};
+static const int32_t CHECKPOINT_VERSION = 3;
+
+/** Settings that must match for the samples of a checkpoint to be combined with new ones. */
+struct CheckpointSettings
+{
+    char scene[64];
+    int32_t acceleration;
+    float cameraLocation[3];
+    float cameraRotation[3];
+    int32_t lightingModel;
+    int32_t samplerType;
+    // samples per pixel in each pass, for each lighting model that has its own count.
+    int32_t superSample;
+    int32_t giSamples;
+    int32_t pathSamples;
+};
+
+struct CheckpointHeader
+{
+    char magic[4];
+    int32_t version;
+    // passes completed by the job, and the cameras pass index after the last of them.
+    int32_t passes;
+    int32_t passIndex;
+    // render time so far, so time limits carry over.
+    float elapsed;
+    CheckpointSettings settings;
+};
+
+static void getCheckpointSettings(CheckpointSettings& settings, Scene* scene, Camera* camera, RenderJob& job)
+{
+    // zeroed so the settings can be compared byte for byte.
+    memset(&settings, 0, sizeof(settings));
+    strncpy(settings.scene, scene->name.c_str(), sizeof(settings.scene) - 1);
+    settings.acceleration = job.acceleration;
+    glm::vec3 location = camera->getLocation();
+    glm::vec3 rotation = camera->getRotation();
+    for (int i = 0; i < 3; i++) {
+        settings.cameraLocation[i] = location[i];
+        settings.cameraRotation[i] = rotation[i];
+    }
+    settings.lightingModel = camera->lightingModel;
+    settings.samplerType = camera->samplerType;
+    settings.superSample = camera->superSample;
+    settings.giSamples = camera->GI_SAMPLES;
+    settings.pathSamples = camera->PATH_SAMPLES;
+}
+
+/** Writes a checkpoint of a render between passes.  The checkpoint is written to a temporary file first so an
+ * interrupted write does not destroy the previous checkpoint. */
+static bool saveCheckpoint(std::string filename, Scene* scene, Camera* camera, RenderJob& job, int passes,
+    float elapsed)
+{
+    TRACE_ZONE("checkpoint");
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, 4);
+    header.version = CHECKPOINT_VERSION;
+    header.passes = passes;
+    header.passIndex = camera->getPassIndex();
+    header.elapsed = elapsed;
+    getCheckpointSettings(header.settings, scene, camera, job);
+
+    std::string tempFilename = filename + ".tmp";
+    {
+        std::ofstream file(tempFilename, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        if (!camera->framebuffer.writeSamples(file)) {
+            printf("Failed to write checkpoint %s.\n", tempFilename.c_str());
+            return false;
+        }
+    }
+
+    // rename replaces the old checkpoint in one step, except on Windows where it has to be removed first.
+#ifdef _WIN32
+    remove(filename.c_str());
+#endif
+    return rename(tempFilename.c_str(), filename.c_str()) == 0;
+}
+
+/** Loads a checkpoint into camera.  Returns false, leaving the camera as it was, if the checkpoint is missing or was
+ * rendered with different settings (scene, acceleration, camera transform, lighting model or samples). */
+static bool loadCheckpoint(std::string filename, Scene* scene, Camera* camera, RenderJob& job, int& passes,
+    float& elapsed)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        printf("No checkpoint found at %s.\n", filename.c_str());
+        return false;
+    }
+
+    CheckpointHeader header;
+    file.read((char*)&header, sizeof(header));
+    if (!file || memcmp(header.magic, CHECKPOINT_MAGIC, 4) != 0 || header.version != CHECKPOINT_VERSION) {
+        printf("Checkpoint %s is not valid.\n", filename.c_str());
+        return false;
+    }
+    CheckpointSettings settings;
+    getCheckpointSettings(settings, scene, camera, job);
+    if (memcmp(&header.settings, &settings, sizeof(settings)) != 0) {
+        printf("Checkpoint %s was rendered with different settings.\n", filename.c_str());
+        return false;
+    }
+    if (!camera->framebuffer.readSamples(file)) {
+        printf("Checkpoint %s does not match the resolution, or is incomplete.\n", filename.c_str());
+        camera->framebuffer.clear();
+        return false;
+    }
+
+    passes = header.passes;
+    elapsed = header.elapsed;
+    camera->setPassIndex(header.passIndex);
+    return true;
+}
+
+// ------------------------------------------------------------
+// Rendering
+// ------------------------------------------------------------
+
+void setupRenderCamera(Camera* camera, RenderJob& job)
+{
+    camera->framebuffer.resize(job.width, job.height);
+    camera->framebuffer.denoise = job.denoise;
+    camera->framebuffer.aovs = job.aovs;
+
+    // same settings as the viewers high quality mode.
+    camera->lqMode = false;
+    camera->superSample = 1;
+    camera->GI_SAMPLES = 64;
+    camera->PATH_SAMPLES = 16;
+    camera->samplerType = job.samplerType;
+    camera->threads = job.threads;
+    camera->rayPackets = job.rayPackets;
+    camera->wavefront = job.wavefront;
+    if (job.lightingModel >= 0) {
+        camera->lightingModel = (LightingModel)job.lightingModel;
+    }
+    camera->costShadowRays = job.costShadowRays;
+    if (job.samples > 0) {
+        switch (camera->lightingModel) {
+            case LM_GI: camera->GI_SAMPLES = job.samples; break;
+            case LM_PATH: camera->PATH_SAMPLES = job.samples; break;
+            default: camera->superSample = job.samples; break;
+        }
+    }
+    if (job.setCameraLocation) camera->setLocation(job.cameraLocation);
+    if (job.setCameraRotation) camera->setRotation(job.cameraRotation);
+}
+
+/** Renders the passes of a single image into cameras framebuffer, checkpointing to <output>.checkpoint as it goes.
+ * finished is set to false if the time limit stopped the render early, in which case the checkpoint is kept. */
+static int renderImage(Scene* scene, Camera* camera, RenderJob& job, std::string output, PassRenderer renderPass, bool& finished)
+{
+    camera->reset();
+
+    const char* name = output.c_str();
+    std::string checkpointFile = output + ".checkpoint";
+    int passes = 0;
+    float previousTime = 0;
+
+    if (job.resume) {
+        if (loadCheckpoint(checkpointFile, scene, camera, job, passes, previousTime)) {
+            printf("%s resuming after pass %d (%.1fs).\n", name, passes, previousTime);
+            camera->reset();
+        } else {
+            printf("%s starting from the beginning.\n", name);
+        }
+    }
+
+#ifdef RAY_STATS
+    // counts are per image, renders running alongside this one (in a batch) will be counted too.
+    resetRayStats();
+#endif
+
+    auto startTime = std::chrono::steady_clock::now();
+    float lastCheckpoint = previousTime;
+    finished = true;
+    while (passes < job.passes) {
+        TRACE_ZONE("pass");
+        int sampledPixels;
+        if (renderPass) {
+            sampledPixels = renderPass(scene, camera);
+        } else {
+            camera->render(scene, -1, false);
+            sampledPixels = camera->getNoisyPixels();
+        }
+        passes++;
+
+        float elapsed = previousTime + std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+        printf(">>>> %s pass %d (%d pixels sampled, %.1fs)\n", name, passes, sampledPixels, elapsed);
+
+        if (camera->ADAPTIVE_ERROR_THRESHOLD > 0 && sampledPixels == 0) {
+            printf("%s converged after %d passes.\n", name, passes);
+            break;
+        }
+        if (job.timeLimit > 0 && elapsed >= job.timeLimit) {
+            printf("%s reached time limit after %d passes.\n", name, passes);
+            // keep a checkpoint so the render can be continued with a longer time limit.
+            if (job.checkpointInterval > 0) saveCheckpoint(checkpointFile, scene, camera, job, passes, elapsed);
+            finished = false;
+            break;
+        }
+        if (job.checkpointInterval > 0 && passes < job.passes && elapsed - lastCheckpoint >= job.checkpointInterval) {
+            if (saveCheckpoint(checkpointFile, scene, camera, job, passes, elapsed)) {
+                printf("%s checkpointed after pass %d.\n", name, passes);
+            }
+            lastCheckpoint = elapsed;
+        }
+        camera->reset();
+    }
+
+#ifdef RAY_STATS
+    printRayStats(getRayStats());
+#endif
+
+    return passes;
+}
+
+std::string addFilenameSuffix(std::string filename, std::string suffix)
+{
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return filename + suffix;
+    return filename.substr(0, dot) + suffix + filename.substr(dot);
+}
+
+/** Returns the file name for a frame of an animation, for example render.tga becomes render_0001.tga. */
+static std::string getFrameFilename(std::string output, int frame)
+{
+    char number[16];
+    snprintf(number, sizeof(number), "_%04d", frame);
+    return addFilenameSuffix(output, number);
+}
+
+/** Renders job.frames frames, updating the scene between them.  Frames are written on a background thread while the
+ * next frame renders. */
+static int renderAnimation(Scene* scene, Camera* camera, RenderJob& job, PassRenderer renderPass)
+{
+    ImageWriter writer;
+    Framebuffer& framebuffer = camera->framebuffer;
+    auto startTime = std::chrono::steady_clock::now();
+    int passes = 0;
+
+    for (int frame = 0; frame < job.frames; frame++) {
+        if (frame > 0) {
+            scene->update();
+            scene->refit();
+        }
+
+        std::string output = getFrameFilename(job.output, frame);
+        std::string checkpointFile = output + ".checkpoint";
+
+        // frames completed before the render was interrupted are already on disk.
+        if (job.resume && std::ifstream(output).good() && !std::ifstream(checkpointFile).good()) {
+            printf("%s already rendered.\n", output.c_str());
+            continue;
+        }
+
+        framebuffer.clear();
+        bool finished;
+        passes += renderImage(scene, camera, job, output, renderPass, finished);
+
+        std::function<void(bool)> done = [=](bool success) {
+            if (success && finished) remove(checkpointFile.c_str());
+        };
+
+        // EXR files hold the image along with the AOVs.
+        bool imageInAOVs = framebuffer.aovs && Framebuffer::getAOVFilename(output) == output;
+        if (framebuffer.aovs) {
+            std::vector<HDRChannel> channels;
+            framebuffer.getChannels(channels);
+            writer.writeChannels(Framebuffer::getAOVFilename(output), framebuffer.getWidth(), framebuffer.getHeight(),
+                channels, imageInAOVs ? done : nullptr);
+        }
+        if (imageInAOVs) {
+            // already written.
+        } else if (is_hdr_filename(output)) {
+            std::vector<float> rgb;
+            framebuffer.getColors(rgb);
+            writer.writeHDR(output, framebuffer.getWidth(), framebuffer.getHeight(), &rgb[0], done);
+        } else {
+            framebuffer.updateImage();
+            writer.write(output, framebuffer.getWidth(), framebuffer.getHeight(), framebuffer.getImage(), done);
+        }
+    }
+
+    writer.flush();
+    float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+    printf("%s rendered %d frames in %.1fs.\n", job.output.c_str(), job.frames, elapsed);
+    return passes;
+}
+
+int renderJob(Scene* scene, Camera* camera, RenderJob& job, PassRenderer renderPass)
+{
+    setupRenderCamera(camera, job);
+
+    if (job.frames > 0) {
+        return renderAnimation(scene, camera, job, renderPass);
+    }
+
+    bool finished;
+    int passes = renderImage(scene, camera, job, job.output, renderPass, finished);
+
+    if (!camera->framebuffer.save(job.output)) {
+        printf("Failed to write %s.\n", job.output.c_str());
+    } else if (finished) {
+        remove((job.output + ".checkpoint").c_str());
+    }
+    return passes;
+}
+
+/** A scene shared by the jobs of a batch that render it with the same acceleration. */
+struct BatchScene
+{
+    // set by the first job to need the scene, which loads it.
+    std::shared_future<Scene*> scene;
+
+    // jobs that have not finished with the scene yet, the last one deletes it.
+    int jobsLeft = 0;
+};
+
+int renderBatch(std::vector<RenderJob>& jobs, int concurrentJobs)
+{
+    // scenes are loaded the first time a job needs them, then shared by jobs using the same acceleration.  The map
+    // only holds each scene's future, so different scenes load at the same time and jobs needing a scene that is
+    // still loading wait for it.  Jobs are counted up front so each scene is freed as soon as its last job is done.
+    std::map<std::pair<int, int>, BatchScene> scenes;
+    std::mutex sceneMutex;
+    for (int i = 0; i < (int)jobs.size(); i++) {
+        if (jobs[i].frames > 0) continue;
+        scenes[std::make_pair(findScene(jobs[i].scene), (int)jobs[i].acceleration)].jobsLeft++;
+    }
+
+    std::mutex jobMutex;
+    int nextJob = 0;
+    int failed = 0;
+
+    auto worker = [&]() {
+        while (true) {
+            int jobIndex;
+            {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                if (nextJob >= (int)jobs.size()) return;
+                jobIndex = nextJob++;
+            }
+            RenderJob& job = jobs[jobIndex];
+
+            int sceneNumber = findScene(job.scene);
+            std::pair<int, int> key = std::make_pair(sceneNumber, (int)job.acceleration);
+            Scene* scene = NULL;
+            if (job.frames > 0) {
+                // animations move the scenes objects, so they can't share the scene (or its meshes) with other
+                // jobs.  Each loads its own copy, which is deleted once the job is done.
+                scene = createScene(sceneNumber);
+                if (scene) scene->load(job.acceleration);
+            } else {
+                std::promise<Scene*> loaded;
+                std::shared_future<Scene*> future;
+                bool loadHere = false;
+                {
+                    std::lock_guard<std::mutex> lock(sceneMutex);
+                    BatchScene& shared = scenes[key];
+                    if (!shared.scene.valid()) {
+                        shared.scene = loaded.get_future().share();
+                        loadHere = true;
+                    }
+                    future = shared.scene;
+                }
+                if (loadHere) {
+                    Scene* newScene = createScene(sceneNumber);
+                    if (newScene) newScene->load(job.acceleration);
+                    loaded.set_value(newScene);
+                }
+                scene = future.get();
+            }
+
+            if (scene) {
+                printf("Starting job %d of %d: %s -> %s\n", jobIndex + 1, (int)jobs.size(), job.scene.c_str(), job.output.c_str());
+
+                // jobs may share a scene so each needs its own camera (and framebuffer).
+                Camera camera = *scene->camera;
+                renderJob(scene, &camera, job);
+            } else {
+                std::lock_guard<std::mutex> lock(jobMutex);
+                failed++;
+            }
+
+            if (job.frames > 0) {
+                delete scene;
+            } else {
+                std::lock_guard<std::mutex> lock(sceneMutex);
+                if (--scenes[key].jobsLeft == 0) delete scene;
+            }
+        }
+    };
+
+    if (concurrentJobs < 1) concurrentJobs = 1;
+    std::vector<std::thread> threads;
+    for (int i = 1; i < concurrentJobs && i < (int)jobs.size(); i++) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (int i = 0; i < (int)threads.size(); i++) {
+        threads[i].join();
+    }
+
+    return failed;
+}
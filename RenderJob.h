@@ -0,0 +1,119 @@
+/**
+ * Render jobs.
+ *
+ * A render job describes a single high quality render of a scene to an image file.  This is the engine side of
+ * the command line renderer, and does not require a display.
+ *
+ * Jobs can also be rendered as a batch, in which case scenes are loaded once and shared between all jobs that use
+ * them, and all jobs share the global thread pool.
+ *
+ * Long renders write checkpoints between passes.  A checkpoint holds the accumulated samples along with the pass
+ * number, which is all the samplers need to carry on from where they left off, and the settings the samples were
+ * rendered with so that they are not combined with samples of a different render.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Sampler.h"
+
+struct RenderJob
+{
+    // scene name or number (see SceneLibrary).
+    std::string scene = "Cornell";
+
+    // file to write the image to.
+    std::string output = "render.tga";
+
+    // resolution of the image.
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+
+    // lighting model to use, -1 keeps the scene cameras own lighting model.
+    int lightingModel = -1;
+
+    // maximum number of passes to render.  Rendering stops early if the image converges.
+    int passes = 16;
+
+    // samples per pixel per pass (GI samples or path samples depending on the lighting model), 0 uses the defaults.
+    int samples = 0;
+
+    // stop after the pass that exceeds this many seconds, 0 for no limit.  For animations this applies to each frame.
+    float timeLimit = 0;
+
+    // number of frames of animation to render, with the scene updated between frames.  Frames are written to a
+    // numbered sequence based on output.  0 renders a single image.
+    int frames = 0;
+
+    // seconds between writing checkpoints of the render to <output>.checkpoint, 0 disables checkpoints.
+    float checkpointInterval = 60;
+
+    // continue from the jobs checkpoint if there is one.
+    bool resume = false;
+
+    bool denoise = false;
+
+    // count shadow rays in the cost heatmap (LM_COST).
+    bool costShadowRays = false;
+
+    // write the first hit AOVs as well as the image, see Framebuffer::getChannels.
+    bool aovs = false;
+
+    SamplerType samplerType = ST_SOBOL;
+
+    // how the scene finds the objects a ray may hit.
+    Acceleration acceleration = ACCEL_SPHERES;
+
+    // trace camera rays and point light shadow rays in packets, see Camera::rayPackets.
+    bool rayPackets = true;
+
+    // path trace a bounce at a time, see Camera::wavefront.
+    bool wavefront = false;
+
+    // maximum number of threads from the thread pool to use, 0 uses all of them.
+    int threads = 0;
+
+    // camera placement, used instead of the scenes camera position if set.
+    bool setCameraLocation = false;
+    glm::vec3 cameraLocation;
+    bool setCameraRotation = false;
+    glm::vec3 cameraRotation;
+};
+
+/** Prints the options accepted by parseRenderJob. */
+void printRenderJobOptions();
+
+/** Returns the name used for a lighting model on the command line, for example "gi". */
+const char* getLightingModelName(int lightingModel);
+
+/** Parses a job from command line style arguments, the first argument that is not an option is the scene.  Returns
+ * false and sets error if the arguments are invalid. */
+bool parseRenderJob(std::vector<std::string>& args, RenderJob& job, std::string& error);
+
+/** Reads jobs from a file, one job per line in the same format as the command line.  Blank lines and lines 
+ * starting with '#' are ignored.  Returns false if the file could not be read or has an invalid job. */
+bool loadRenderJobs(std::string filename, std::vector<RenderJob>& jobs);
+
+/** Renders one complete pass into the cameras framebuffer, returning the number of pixels sampled. */
+typedef std::function<int(Scene* scene, Camera* camera)> PassRenderer;
+
+/** Inserts suffix before the extension of filename, for example render.tga with suffix _1 becomes render_1.tga. */
+std::string addFilenameSuffix(std::string filename, std::string suffix);
+
+/** Applies the jobs resolution and quality settings to camera. */
+void setupRenderCamera(Camera* camera, RenderJob& job);
+
+/** Renders a loaded scene with the settings in job into cameras framebuffer, then writes the result to the jobs 
+ * output file.  While rendering the accumulated samples are periodically checkpointed so that an interrupted render
+ * can be resumed.  Passes are rendered by the camera itself unless renderPass is given.  Returns the number of passes
+ * rendered. */
+int renderJob(Scene* scene, Camera* camera, RenderJob& job, PassRenderer renderPass = nullptr);
+
+/** Renders a list of jobs, with up to concurrentJobs jobs rendering at once.  Each scene is loaded only once and
+ * each job renders with its own copy of the scenes camera.  Returns the number of jobs that failed. */
+int renderBatch(std::vector<RenderJob>& jobs, int concurrentJobs = 2);
@@ -0,0 +1,242 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Random and low discrepancy samplers.
+-------------------------------------------------------------*/
+
+#include "Sampler.h"
+#include "Utils.h"
+
+#include <vector>
+#include <math.h>
+
+// ------------------------------------------------------------
+// Helpers
+// ------------------------------------------------------------
+
+/** Integer hash with good avalanche (lowbias32). */
+static uint32_t hashInt(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t reverseBits(uint32_t x)
+{
+    x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+    x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+    x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+    x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+/** Owen scrambles the bits of x (most significant bit first).  Each bit is flipped based on the bits above it. */
+static uint32_t owenScramble(uint32_t x, uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cU;
+    x ^= x * 0xb82f1e52U;
+    x ^= x * 0xc7afe638U;
+    x ^= x * 0x8d22f6e6U;
+    return reverseBits(x);
+}
+
+/** First two dimensions of the Sobol sequence as 32bit fractions. */
+static uint32_t sobol0(uint32_t index)
+{
+    return reverseBits(index);
+}
+
+static uint32_t sobol1(uint32_t index)
+{
+    uint32_t result = 0;
+    for (uint32_t v = 1U << 31; index; index >>= 1, v ^= v >> 1) {
+        if (index & 1) result ^= v;
+    }
+    return result;
+}
+
+/** Converts 32bit fraction to float in [0,1). */
+static float toUnitFloat(uint32_t x)
+{
+    float f = x * (1.0f / 4294967296.0f);
+    return f < 0.99999994f ? f : 0.99999994f;
+}
+
+// ------------------------------------------------------------
+// Random
+// ------------------------------------------------------------
+
+void RandomSampler::startSample(int x, int y, int sampleIndex)
+{
+    Sampler::startSample(x, y, sampleIndex);
+    sampleSeed = hashInt(hashInt((uint32_t)x * 0x8da6b343U ^ (uint32_t)y * 0xd8163841U) ^ (uint32_t)sampleIndex);
+}
+
+float RandomSampler::get1D()
+{
+    uint32_t bits = hashInt(sampleSeed ^ hashInt((uint32_t)dimension));
+    dimension++;
+    return clipf((bits >> 8) / 16777216.0f, 0.0f, 0.99999994f);
+}
+
+// ------------------------------------------------------------
+// Sobol
+// ------------------------------------------------------------
+
+void SobolSampler::startSample(int x, int y, int sampleIndex)
+{
+    Sampler::startSample(x, y, sampleIndex);
+    pixelSeed = hashInt((uint32_t)x * 0x8da6b343U ^ (uint32_t)y * 0xd8163841U);
+}
+
+float SobolSampler::get1D()
+{
+    uint32_t seed = hashInt(pixelSeed ^ hashInt((uint32_t)dimension));
+    dimension++;
+    uint32_t index = owenScramble((uint32_t)sampleIndex, seed);
+    return toUnitFloat(owenScramble(sobol0(index), hashInt(seed)));
+}
+
+glm::vec2 SobolSampler::get2D()
+{
+    // each pair of dimensions is a 2D Sobol point set, shuffled and scrambled independently of the other pairs.
+    if (dimension & 1) dimension++;
+    uint32_t seed = hashInt(pixelSeed ^ hashInt((uint32_t)dimension));
+    dimension += 2;
+    uint32_t index = owenScramble((uint32_t)sampleIndex, seed);
+    return glm::vec2(
+        toUnitFloat(owenScramble(sobol0(index), hashInt(seed ^ 0xa511e9b3U))),
+        toUnitFloat(owenScramble(sobol1(index), hashInt(seed ^ 0x63d83595U)))
+    );
+}
+
+// ------------------------------------------------------------
+// Blue noise
+// ------------------------------------------------------------
+
+const int BLUE_NOISE_SIZE = 64;
+
+/** Generates a tileable blue noise mask using the void and cluster method (Ulichney 1993).  Each pixel gets a unique
+ * rank, and any threshold of the ranks gives evenly spaced points. */
+static std::vector<float> generateBlueNoise()
+{
+    const int N = BLUE_NOISE_SIZE;
+    const int n = N * N;
+    const float SIGMA = 1.5f;
+
+    // gaussian weight for each toroidal offset.
+    std::vector<float> kernel(n);
+    for (int dy = 0; dy < N; dy++) {
+        for (int dx = 0; dx < N; dx++) {
+            int wx = dx < N / 2 ? dx : N - dx;
+            int wy = dy < N / 2 ? dy : N - dy;
+            kernel[dy * N + dx] = exp(-(wx * wx + wy * wy) / (2 * SIGMA * SIGMA));
+        }
+    }
+
+    std::vector<bool> pattern(n, false);
+    std::vector<float> energy(n, 0.0f);
+    std::vector<int> rank(n, -1);
+
+    auto update = [&](int p, float sign) {
+        int px = p % N;
+        int py = p / N;
+        for (int y = 0; y < N; y++) {
+            for (int x = 0; x < N; x++) {
+                energy[y * N + x] += sign * kernel[((y - py + N) % N) * N + ((x - px + N) % N)];
+            }
+        }
+    };
+
+    // tightest cluster is the set pixel with most energy, largest void the unset pixel with least.
+    auto tightestCluster = [&]() {
+        int best = -1;
+        for (int i = 0; i < n; i++) if (pattern[i] && (best < 0 || energy[i] > energy[best])) best = i;
+        return best;
+    };
+    auto largestVoid = [&]() {
+        int best = -1;
+        for (int i = 0; i < n; i++) if (!pattern[i] && (best < 0 || energy[i] < energy[best])) best = i;
+        return best;
+    };
+
+    // start with a random pattern, then move points from clusters into voids until it stops changing.
+    uint32_t state = 12345;
+    int initialPoints = n / 10;
+    for (int placed = 0; placed < initialPoints;) {
+        state = hashInt(state);
+        int p = state % n;
+        if (pattern[p]) continue;
+        pattern[p] = true;
+        update(p, +1);
+        placed++;
+    }
+    for (int i = 0; i < n; i++) {
+        int cluster = tightestCluster();
+        pattern[cluster] = false;
+        update(cluster, -1);
+        int gap = largestVoid();
+        pattern[gap] = true;
+        update(gap, +1);
+        if (gap == cluster) break;
+    }
+
+    // rank the initial points by removing clusters, then rank the rest by filling voids.
+    std::vector<bool> initialPattern = pattern;
+    std::vector<float> initialEnergy = energy;
+    for (int r = initialPoints - 1; r >= 0; r--) {
+        int cluster = tightestCluster();
+        pattern[cluster] = false;
+        update(cluster, -1);
+        rank[cluster] = r;
+    }
+    pattern = initialPattern;
+    energy = initialEnergy;
+    for (int r = initialPoints; r < n; r++) {
+        int gap = largestVoid();
+        pattern[gap] = true;
+        update(gap, +1);
+        rank[gap] = r;
+    }
+
+    std::vector<float> mask(n);
+    for (int i = 0; i < n; i++) {
+        mask[i] = (rank[i] + 0.5f) / n;
+    }
+    return mask;
+}
+
+/** Returns blue noise value for pixel, the mask is shifted for each dimension so dimensions are not correlated. */
+static float blueNoise(int x, int y, int dimension)
+{
+    static const std::vector<float> mask = generateBlueNoise();
+    x = (x + dimension * 23) % BLUE_NOISE_SIZE;
+    y = (y + dimension * 41) % BLUE_NOISE_SIZE;
+    return mask[y * BLUE_NOISE_SIZE + x];
+}
+
+float BlueNoiseSampler::get1D()
+{
+    // golden ratio additive recurrence.
+    double value = blueNoise(x, y, dimension) + sampleIndex * 0.6180339887498949;
+    dimension++;
+    return toUnitFloat((uint32_t)((value - floor(value)) * 4294967296.0));
+}
+
+glm::vec2 BlueNoiseSampler::get2D()
+{
+    // the R2 sequence, the 2D generalisation of the golden ratio sequence.
+    double u = blueNoise(x, y, dimension) + sampleIndex * 0.7548776662466927;
+    double v = blueNoise(x, y, dimension + 1) + sampleIndex * 0.5698402909980532;
+    dimension += 2;
+    return glm::vec2(
+        toUnitFloat((uint32_t)((u - floor(u)) * 4294967296.0)),
+        toUnitFloat((uint32_t)((v - floor(v)) * 4294967296.0))
+    );
+}
@@ -0,0 +1,106 @@
+/**
+ * Samplers.
+ *
+ * A sampler supplies the random numbers used while rendering a pixel sample (jitter, lens, light and bounce
+ * directions).  Each random number is a 'dimension' of the sample.  Independent random numbers converge slowly, so
+ * the low discrepancy samplers here spread the samples of each dimension evenly over the samples taken for a pixel.
+ *
+ * Dimensions are laid out as follows:
+ *   0,1   pixel jitter
+ *   2,3   lens (defocus)
+ *   then DIMENSIONS_PER_BOUNCE dimensions for each bounce of a path, so the same event on the same bounce
+ *   always draws from the same dimensions.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+
+enum SamplerType {
+    // independent uniform random numbers.
+    ST_RANDOM,
+    // Owen scrambled Sobol, padded with independently scrambled 2D Sobol points for higher dimensions.
+    ST_SOBOL,
+    // low discrepancy sequence offset per pixel by a blue noise mask, so the remaining error looks like blue noise.
+    ST_BLUE_NOISE
+};
+
+class Sampler
+{
+protected:
+    int x = 0;
+    int y = 0;
+    int sampleIndex = 0;
+    int dimension = 0;
+
+public:
+
+    // number of dimensions used before the first bounce.
+    static const int CAMERA_DIMENSIONS = 4;
+
+    // number of dimensions reserved for each bounce.
+    static const int DIMENSIONS_PER_BOUNCE = 12;
+
+    /** Starts a new sample.  sampleIndex is the number of this sample within the pixel. */
+    virtual void startSample(int x, int y, int sampleIndex)
+    {
+        this->x = x;
+        this->y = y;
+        this->sampleIndex = sampleIndex;
+        this->dimension = 0;
+    }
+
+    /** Skips the dimensions used by the camera ray, for samples whose camera ray has already been made. */
+    void skipCamera()
+    {
+        dimension = CAMERA_DIMENSIONS;
+    }
+
+    /** Moves to the first dimension reserved for given bounce. */
+    void startBounce(int bounce)
+    {
+        dimension = CAMERA_DIMENSIONS + bounce * DIMENSIONS_PER_BOUNCE;
+    }
+
+    /** Returns the next dimension, a number in [0,1). */
+    virtual float get1D() = 0;
+
+    /** Returns the next two dimensions. */
+    virtual glm::vec2 get2D()
+    {
+        float u = get1D();
+        float v = get1D();
+        return glm::vec2(u, v);
+    }
+
+    virtual ~Sampler() {}
+};
+
+/** Independent random numbers.  These are hashed from the pixel, sample index and dimension rather than drawn from a
+ * generator, so like the other samplers a pass can be reproduced from its sample indices alone. */
+class RandomSampler : public Sampler
+{
+    uint32_t sampleSeed = 0;
+public:
+    void startSample(int x, int y, int sampleIndex) override;
+    float get1D() override;
+};
+
+/** Owen scrambled Sobol (see Burley 2020, Practical Hash-based Owen Scrambling). */
+class SobolSampler : public Sampler
+{
+    uint32_t pixelSeed = 0;
+public:
+    void startSample(int x, int y, int sampleIndex) override;
+    float get1D() override;
+    glm::vec2 get2D() override;
+};
+
+/** Additive recurrence sequences, offset per pixel and per dimension by a blue noise mask. */
+class BlueNoiseSampler : public Sampler
+{
+public:
+    float get1D() override;
+    glm::vec2 get2D() override;
+};
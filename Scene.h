@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <chrono>
 #include <glm/glm.hpp>
 #include <vector>
 
 #include "Camera.h"
 #include "Light.h"
 #include "ContainerObject.h"
+#include "LightTree.h"
+#include "Trace.h"
 
 //* Scene containing lights and objects. */
 class Scene : public ContainerObject
@@ -29,6 +32,9 @@ public:
     /** List of lights in the scene. */
     std::vector<Light*> lights = std::vector<Light*>();
 
+    /** Emissive objects in the scene, collected when the scene is loaded. */
+    LightTree emissiveLights;
+
     // our camera
     Camera* camera;
 
@@ -36,6 +42,13 @@ public:
         camera = new Camera();                        
     }
 
+    ~Scene() {
+        delete camera;
+        for (int i = 0; i < (int)lights.size(); i++) {
+            delete lights[i];
+        }
+    }
+
     void add(SceneObject* object) override {
         // override so that if we add a light it gets added as a light instead of as a normal object.
         if (dynamic_cast<Light*>(object)) {
@@ -45,11 +58,25 @@ public:
         }   
     } 
 
-    // loads the scene.
-    void load() {
-        printf("<loading scene>\n");
-        loadScene();
-        _isLoaded = true;
+    // loads the scene, then builds the acceleration structure.
+    void load(Acceleration acceleration = ACCEL_SPHERES) {
+        {
+            TRACE_ZONE("load scene");
+            printf("<loading scene>\n");
+            loadScene();
+            emissiveLights.buildFromScene(this);
+            _isLoaded = true;
+        }
+        setAcceleration(acceleration);
+    }
+
+    void setAcceleration(Acceleration acceleration) {
+        if (acceleration == this->acceleration) return;
+        TRACE_ZONE("build acceleration");
+        auto start = std::chrono::steady_clock::now();
+        ContainerObject::setAcceleration(acceleration);
+        float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+        printf("Built %s acceleration in %.2fs.\n", getAccelerationName(acceleration), seconds);
     }
 
     // descendants to overwrite.
@@ -58,4 +85,11 @@ public:
     // updates the scene.
     virtual void update() {};        
 
+    // updates the bounds of the scenes objects and lights after update has moved them.
+    void refit() override {
+        TRACE_ZONE("refit scene");
+        ContainerObject::refit();
+        emissiveLights.refitFromScene(this);
+    }
+
 };
\ No newline at end of file
@@ -0,0 +1,64 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Library of example scenes.
+-------------------------------------------------------------*/
+
+#include "SceneLibrary.h"
+
+#include "Cube.h"
+#include "Cylinder.h"
+#include "ExampleScenes.h"
+
+#include <stdlib.h>
+
+struct SceneEntry
+{
+    const char* name;
+    Scene* (*create)();
+};
+
+template <class T> static Scene* createSceneOfType() { return new T(); }
+
+// scene '0' is realy just here to pad out the list.
+static const SceneEntry SCENES[] = {
+    {"Test", createSceneOfType<TestScene>},
+    {"Basic", createSceneOfType<BasicScene>},
+    {"Cornell", createSceneOfType<CornellBoxScene>},
+    {"Animated", createSceneOfType<AnimatedScene>},
+    {"MaterialSpheres", createSceneOfType<MaterialSpheresScene>},
+    {"Dragon", createSceneOfType<DragonScene>},
+    {"ManyDragons", createSceneOfType<ManyDragonsScene>},
+    {"AreaLight", createSceneOfType<AreaLightScene>},
+    {"MillionCubes", createSceneOfType<MillionCubes>},
+};
+
+int getSceneCount()
+{
+    return sizeof(SCENES) / sizeof(SCENES[0]);
+}
+
+std::string getSceneName(int sceneNumber)
+{
+    if (sceneNumber < 0 || sceneNumber >= getSceneCount()) return "";
+    return SCENES[sceneNumber].name;
+}
+
+int findScene(std::string scene)
+{
+    for (int i = 0; i < getSceneCount(); i++) {
+        if (scene == SCENES[i].name) return i;
+    }
+
+    // otherwise try it as a number.
+    char* end;
+    long sceneNumber = strtol(scene.c_str(), &end, 10);
+    if (scene.empty() || *end != '\0' || sceneNumber < 0 || sceneNumber >= getSceneCount()) return -1;
+    return (int)sceneNumber;
+}
+
+Scene* createScene(int sceneNumber)
+{
+    if (sceneNumber < 0 || sceneNumber >= getSceneCount()) return NULL;
+    return SCENES[sceneNumber].create();
+}
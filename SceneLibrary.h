@@ -0,0 +1,24 @@
+/**
+ * Scene library.
+ *
+ * The example scenes that can be rendered by the front ends (the viewer and the command line renderer).  Scenes are
+ * identified either by their number or by their name.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "Scene.h"
+
+/** Number of scenes in the library. */
+int getSceneCount();
+
+/** Returns the name of scene with given number. */
+std::string getSceneName(int sceneNumber);
+
+/** Returns the number of the scene with given name or number, or -1 if there is no such scene. */
+int findScene(std::string scene);
+
+/** Creates (but does not load) scene with given number.  Returns NULL if the number is invalid. */
+Scene* createScene(int sceneNumber);
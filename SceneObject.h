@@ -15,6 +15,25 @@
 #include "Ray.h"
 #include "Utils.h"
 #include <glm/glm.hpp>
+#include <vector>
+
+/** How containers find which of their objects a ray may hit. */
+enum Acceleration
+{
+    // each object is tested against its bounding sphere, with meshes and clusters forming a hierarchy of spheres.
+    ACCEL_SPHERES,
+    // a bounding volume hierarchy of boxes with 4 or 8 children per node, see WideBVH.
+    ACCEL_BVH4,
+    ACCEL_BVH8,
+    // as above, with the boxes quantized to 16 or 8 bits.
+    ACCEL_BVH4_Q16,
+    ACCEL_BVH8_Q16,
+    ACCEL_BVH4_Q8,
+    ACCEL_BVH8_Q8,
+    ACCEL_COUNT
+};
+
+class ContainerObject;
 
 class SceneObject
 {
@@ -52,6 +71,43 @@ protected:
     // inverse local transformation matrix. 
     glm::mat4x4 localTransformInv = glm::mat4x4(1);
 
+    /** Transforms ray from parent space into local space. */
+    void toLocalRay(Ray* ray) {
+        if (simpleTransform) {            
+            ray->pos -= location;
+        } else {
+            ray->transform(localTransformInv);
+        }
+    }
+
+    /** Finishes an intersection made in local space, transforming the collision back into parent space. */
+    void toParentCollision(Ray* ray, bool didIntersect) {
+
+        if (didIntersect && (ray->collision.uv.x == 0) && ray->collision.target->material->needsUV()) {
+            // fetch uv only if required.
+			ray->collision.uv = ray->collision.target->getUV(ray->collision.local);
+        }
+
+		if (didIntersect) {
+			// if we intersected the object, make sure to ignore any objects more distant from this point.
+			ray->length = ray->collision.t;
+
+			if (simpleTransform) {
+				ray->collision.location += location;
+				ray->pos += location;
+			}
+			else {
+				// transform world coords                    
+				ray->collision.location = toParent(glm::vec4(ray->collision.location, 1));
+
+				//note: this is not the proper transform.  It should be something to do with the inverse transpose,
+				//if the objects scale is set to non uniform this this will be wrong.
+				ray->collision.normal = glm::normalize(toParent(glm::vec4(ray->collision.normal, 0)));
+				ray->collision.tangent = glm::normalize(toParent(glm::vec4(ray->collision.tangent, 0)));
+			}
+		}
+    }
+
 public:
 
     inline void setLocation(glm::vec3 location) {
@@ -93,6 +149,9 @@ public:
     
     // if this object should cast shadows or not.
     bool castsShadows = true;        
+
+    // set if this object is in the scenes emissive light list, in which case its light is gathered by sampling it directly.
+    bool isLightSource = false;
     
 	SceneObject(glm::vec3 location = glm::vec3()) {
         this->setLocation(location);
@@ -113,37 +172,11 @@ public:
 		glm::vec3 oldDir = ray->dir;
 		glm::vec3 oldPos = ray->pos;
         
-        if (simpleTransform) {            
-            ray->pos -= location;
-        } else {
-            ray->transform(localTransformInv);
-        }
+        toLocalRay(ray);
 
         bool didIntersect = intersectObject(ray);
 
-        if (didIntersect && (ray->collision.uv.x == 0) && ray->collision.target->material->needsUV()) {
-            // fetch uv only if required.
-			ray->collision.uv = ray->collision.target->getUV(ray->collision.local);
-        }
-
-		if (didIntersect) {
-			// if we intersected the object, make sure to ignore any objects more distant from this point.
-			ray->length = ray->collision.t;
-
-			if (simpleTransform) {
-				ray->collision.location += location;
-				ray->pos += location;
-			}
-			else {
-				// transform world coords                    
-				ray->collision.location = toParent(glm::vec4(ray->collision.location, 1));
-
-				//note: this is not the proper transform.  It should be something to do with the inverse transpose,
-				//if the objects scale is set to non uniform this this will be wrong.
-				ray->collision.normal = glm::normalize(toParent(glm::vec4(ray->collision.normal, 0)));
-				ray->collision.tangent = glm::normalize(toParent(glm::vec4(ray->collision.tangent, 0)));
-			}
-		}
+        toParentCollision(ray, didIntersect);
 
 		// get ray back				
 		ray->dir = oldDir;
@@ -153,11 +186,47 @@ public:
   
     }
 
+    /** Intersects the rays of packet selected by mask with object, returning a mask of the rays that hit it.  This
+     * gives the same results as intersecting each ray in turn, but lets containers trace the rays together. */
+    int intersectPacket(RayPacket& packet, int mask) {
+
+        glm::vec3 oldDir[RAY_PACKET_SIZE];
+        glm::vec3 oldPos[RAY_PACKET_SIZE];
+
+        for (int i = 0; i < packet.count; i++) {
+            if (!(mask & (1 << i))) continue;
+            oldDir[i] = packet.rays[i]->dir;
+            oldPos[i] = packet.rays[i]->pos;
+            toLocalRay(packet.rays[i]);
+        }
+
+        int hits = intersectObjectPacket(packet, mask);
+
+        for (int i = 0; i < packet.count; i++) {
+            if (!(mask & (1 << i))) continue;
+            toParentCollision(packet.rays[i], (hits & (1 << i)) != 0);
+            packet.rays[i]->dir = oldDir[i];
+            packet.rays[i]->pos = oldPos[i];
+        }
+
+        return hits;
+    }
+
     /** This should be overridden for each class. */
     virtual bool intersectObject(Ray* ray) {
 		return false;
     }    
 
+    /** Intersects the rays of packet selected by mask, which are in local space.  Defaults to intersecting them one
+     * at a time, objects with a hierarchy to share between the rays override this. */
+    virtual int intersectObjectPacket(RayPacket& packet, int mask) {
+        int hits = 0;
+        for (int i = 0; i < packet.count; i++) {
+            if ((mask & (1 << i)) && intersectObject(packet.rays[i])) hits |= 1 << i;
+        }
+        return hits;
+    }
+
 	virtual ~SceneObject() {}    
 
     /** returns uv coords of pos (in local space) */
@@ -173,6 +242,39 @@ public:
         return glm::vec3(localTransform * p);
     }
     
+    /** Gets the box bounding this object in local space, returns false if the object is unbounded.  Defaults to the
+     * box around the bounding sphere. */
+    virtual bool getLocalBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) {
+        if (boundingSphereRadius < 0) return false;
+        boundsMin = glm::vec3(-boundingSphereRadius);
+        boundsMax = glm::vec3(+boundingSphereRadius);
+        return true;
+    }
+
+    /** Gets the box bounding this object in its parents space, returns false if the object is unbounded. */
+    bool getBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) {
+        glm::vec3 localMin, localMax;
+        if (!getLocalBounds(localMin, localMax)) return false;
+        if (simpleTransform) {
+            boundsMin = localMin + location;
+            boundsMax = localMax + location;
+            return true;
+        }
+        boundsMin = glm::vec3(+INFINITY);
+        boundsMax = glm::vec3(-INFINITY);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner = glm::vec3(i & 1 ? localMax.x : localMin.x, i & 2 ? localMax.y : localMin.y, i & 4 ? localMax.z : localMin.z);
+            corner = toParent(glm::vec4(corner, 1));
+            boundsMin = glm::min(boundsMin, corner);
+            boundsMax = glm::max(boundsMax, corner);
+        }
+        return true;
+    }
+
+    /** Sets the acceleration structure of any containers within this object, adding those that need theirs built
+     * to builds (children before their parents) rather than building them, so that they can be built together. */
+    virtual void setAcceleration(Acceleration acceleration, std::vector<ContainerObject*>& builds) {}
+
     /** Tests if ray intersects this objects sphere bounding box.  Objects without bounding spheres will always pass this test. 
      * Ray should be in local space.  */
     bool sphereBoundsTest(Ray ray) {
@@ -0,0 +1,160 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Blocking TCP sockets.
+-------------------------------------------------------------*/
+
+#include "Socket.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#define closeHandle closesocket
+#define MSG_NOSIGNAL 0
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define closeHandle ::close
+#endif
+
+/** Winsock needs starting before first use. */
+static void startNetworking()
+{
+#ifdef _WIN32
+    static bool started = false;
+    if (!started) {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+        started = true;
+    }
+#endif
+}
+
+bool Socket::listen(int port)
+{
+    startNetworking();
+    close();
+
+    handle = (int)socket(AF_INET, SOCK_STREAM, 0);
+    if (handle < 0) return false;
+
+    // allow the port to be reused straight away when the coordinator is restarted.
+    int yes = 1;
+    setsockopt(handle, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((uint16_t)port);
+
+    if (bind(handle, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(handle, 16) != 0) {
+        printf("Error, can not listen on port %d.\n", port);
+        close();
+        return false;
+    }
+    return true;
+}
+
+Socket Socket::accept(int timeoutMs)
+{
+    fd_set handles;
+    FD_ZERO(&handles);
+    FD_SET(handle, &handles);
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    if (select(handle + 1, &handles, NULL, NULL, &timeout) <= 0) return Socket();
+
+    int connection = (int)::accept(handle, NULL, NULL);
+    if (connection < 0) return Socket();
+
+    // messages are small and we always wait for the reply, so don't delay sending them.
+    int yes = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+    return Socket(connection);
+}
+
+bool Socket::connect(std::string host, int port)
+{
+    startNetworking();
+    close();
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        printf("Error, can not find host %s.\n", host.c_str());
+        return false;
+    }
+
+    handle = (int)socket(AF_INET, SOCK_STREAM, 0);
+    bool connected = handle >= 0 && ::connect(handle, result->ai_addr, (socklen_t)result->ai_addrlen) == 0;
+    freeaddrinfo(result);
+
+    if (!connected) {
+        close();
+        return false;
+    }
+
+    int yes = 1;
+    setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+    return true;
+}
+
+void Socket::close()
+{
+    if (handle >= 0) {
+        closeHandle(handle);
+        handle = -1;
+    }
+}
+
+bool Socket::sendBytes(const void* data, int size)
+{
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        int sent = (int)send(handle, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool Socket::receiveBytes(void* data, int size)
+{
+    char* bytes = (char*)data;
+    while (size > 0) {
+        int received = (int)recv(handle, bytes, size, 0);
+        if (received <= 0) return false;
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+bool Socket::sendBlock(const std::vector<char>& data)
+{
+    return sendInt((int32_t)data.size()) && (data.empty() || sendBytes(&data[0], (int)data.size()));
+}
+
+bool Socket::receiveBlock(std::vector<char>& data, int maxSize)
+{
+    int32_t size;
+    if (!receiveInt(size) || size < 0 || size > maxSize) return false;
+    data.resize(size);
+    return size == 0 || receiveBytes(&data[0], size);
+}
@@ -0,0 +1,48 @@
+/**
+ * Socket.
+ *
+ * A minimal blocking TCP connection, just enough to send messages between the render coordinator and its workers.
+ * Integers are sent in the machines native byte order, so all machines taking part must share the same byte order.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Socket
+{
+protected:
+    int handle = -1;
+
+public:
+
+    Socket() {}
+    explicit Socket(int handle) : handle(handle) {}
+
+    bool isOpen() { return handle >= 0; }
+
+    /** Starts listening for connections on given port (on all interfaces).  Returns false on failure. */
+    bool listen(int port);
+
+    /** Waits up to timeoutMs for a connection.  Returns a closed socket if none arrived. */
+    Socket accept(int timeoutMs);
+
+    /** Connects to host:port.  Returns false on failure. */
+    bool connect(std::string host, int port);
+
+    void close();
+
+    /** Sends or receives exactly size bytes.  Returns false if the connection was lost. */
+    bool sendBytes(const void* data, int size);
+    bool receiveBytes(void* data, int size);
+
+    bool sendInt(int32_t value) { return sendBytes(&value, sizeof(value)); }
+    bool receiveInt(int32_t& value) { return receiveBytes(&value, sizeof(value)); }
+
+    /** Sends a block of bytes prefixed by its length. */
+    bool sendBlock(const std::vector<char>& data);
+    /** Receives a block sent by sendBlock, blocks larger than maxSize are refused. */
+    bool receiveBlock(std::vector<char>& data, int maxSize = 256*1024*1024);
+};
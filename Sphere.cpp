@@ -13,6 +13,8 @@
 */
 bool Sphere::intersectObject(Ray* ray)
 {    
+    RAY_COUNT_TESTS(ray, primitiveTests, 1);
+
     glm::vec3 vdif = ray->pos;
     float b = glm::dot(ray->dir, vdif);
     float len2 = glm::dot(vdif, vdif);
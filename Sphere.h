@@ -30,11 +30,13 @@ public:
 	Sphere(): SceneObject() 
 	{		
         this->radius = 1;
+        this->boundingSphereRadius = 1;
 	};
 
     Sphere(glm::vec3 location, float radius) : SceneObject(location)
 	{	
         this->radius = radius;
+        this->boundingSphereRadius = radius;
 	};
 
 	bool intersectObject(Ray* ray) override;
@@ -1,5 +1,7 @@
 #include "TGAWriter.h"
 
+#include <vector>
+
 bool write_truecolor_tga( const string& filename, uint32_t* data, unsigned width, unsigned height )
 {
   ofstream tgafile( filename.c_str(), ios::binary );
@@ -16,14 +18,17 @@ bool write_truecolor_tga( const string& filename, uint32_t* data, unsigned width
 
   tgafile.write( (const char*)header, 18 );
 
-  // The image data is stored bottom-to-top, left-to-right
-  for (int y = 0; y < height; y++)
-  for (int x = 0; x < width; x++)
+  // The image data is stored bottom-to-top, left-to-right.  It is converted into one buffer and written in a
+  // single call, as putting it a byte at a time is very slow for large images.
+  vector<char> pixels( (size_t)width * height * 3 );
+  char* p = pixels.empty() ? NULL : &pixels[0];
+  for (unsigned i = 0; i < width * height; i++)
     {
-    tgafile.put( (char)(data[ (y * width) + x ] >> 16 & 0xFF));
-    tgafile.put( (char)(data[ (y * width) + x ] >> 8 & 0xFF));
-    tgafile.put( (char)(data[ (y * width) + x ] >> 0 & 0xFF));
+    *p++ = (char)(data[ i ] >> 16 & 0xFF);
+    *p++ = (char)(data[ i ] >> 8 & 0xFF);
+    *p++ = (char)(data[ i ] >> 0 & 0xFF);
     }
+  if (!pixels.empty()) tgafile.write( &pixels[0], pixels.size() );
 
   // The file footer. This part is totally optional.
   static const char footer[ 26 ] =
@@ -34,5 +39,5 @@ bool write_truecolor_tga( const string& filename, uint32_t* data, unsigned width
   tgafile.write( footer, 26 );
 
   tgafile.close();
-  return true;
+  return !tgafile.fail();
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include <glm/glm.hpp>
 
 #include "picoPNG.h"
+#include "Trace.h"
 
 enum TextureClip {TC_WRAP, TC_CLAMP};
 enum TextureSampler {TS_NEAREST, TS_BILINEAR};
@@ -74,6 +75,7 @@ public:
      * @param isNormalMap If true texture will be treated as a normal map.
      */
     BitmapTexture(const char* filename, bool isNormalMap = false) : Texture2D() {
+        TRACE_ZONE("decode texture");
         this->isNormalMap = isNormalMap;
         loadFile(buffer, filename);        
         int error = decodePNG(image, width, height, buffer.empty() ? 0 : &buffer[0], (unsigned long)buffer.size());
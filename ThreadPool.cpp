@@ -0,0 +1,116 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Thread pool shared between render jobs.
+-------------------------------------------------------------*/
+
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(int threads)
+{
+    if (threads <= 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 8;
+    }
+
+    // the thread calling parallelFor also does work, so we need one less worker.
+    for (int i = 0; i < threads - 1; i++) {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i + 1));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (int i = 0; i < (int)workers.size(); i++) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::workerLoop(int index)
+{
+    setTraceThreadName("worker " + std::to_string(index));
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+/** State shared by the threads working on one parallel loop. */
+struct ParallelLoopState
+{
+    std::function<void(int, int)> functor;
+    int n;
+    int chunkSize;
+    std::atomic<int> next;
+    std::atomic<int> chunksRemaining;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    /** Works on chunks until there are none left. */
+    void work()
+    {
+        while (true) {
+            int start = next.fetch_add(chunkSize);
+            if (start >= n) return;
+            functor(start, std::min(start + chunkSize, n));
+            if (--chunksRemaining == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+void ThreadPool::parallelFor(int n, int chunkSize, std::function<void(int start, int end)> functor, int maxThreads)
+{
+    if (n <= 0) return;
+    if (chunkSize <= 0) chunkSize = 1;
+
+    auto loop = std::make_shared<ParallelLoopState>();
+    loop->functor = functor;
+    loop->n = n;
+    loop->chunkSize = chunkSize;
+    loop->next = 0;
+    int chunks = (n + chunkSize - 1) / chunkSize;
+    loop->chunksRemaining = chunks;
+
+    // no point waking more helpers than there are chunks for.
+    int threads = (maxThreads > 0) ? std::min(maxThreads, size()) : size();
+    int helpers = std::min(threads, chunks) - 1;
+    if (helpers > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < helpers; i++) {
+            tasks.push_back([loop]() { loop->work(); });
+        }
+    }
+    if (helpers == 1) taskAvailable.notify_one(); else if (helpers > 1) taskAvailable.notify_all();
+
+    loop->work();
+
+    // wait for the helpers to finish the chunks they picked up.
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->finished.wait(lock, [&loop]() { return loop->chunksRemaining == 0; });
+}
+
+ThreadPool& ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,47 @@
+/**
+ * Thread pool.
+ *
+ * A fixed set of worker threads shared by everything that renders in the process.  Work is submitted as a parallel
+ * loop, which is split into chunks that are handed out to whichever thread is free.  Several loops (for example from
+ * render jobs running at the same time) can be in flight at once and share the workers between them.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+protected:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable taskAvailable;
+    bool stopping = false;
+
+    void workerLoop(int index);
+
+public:
+
+    /** Creates pool with given number of threads, 0 uses one per core. */
+    ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    /** Number of threads work is shared between (the workers plus the calling thread). */
+    int size() { return (int)workers.size() + 1; }
+
+    /**
+     * Calls functor(start, end) over [0, n) in chunks of chunkSize, and returns once every chunk is done.  The calling
+     * thread works on the loop too, so it is safe to call this from within a pool thread.
+     * @param maxThreads limits the number of threads working on this loop, 0 for no limit.
+     */
+    void parallelFor(int n, int chunkSize, std::function<void(int start, int end)> functor, int maxThreads = 0);
+
+    /** Returns the pool shared by the whole process. */
+    static ThreadPool& global();
+};
@@ -0,0 +1,140 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Timeline tracing, written in the Chrome trace event format.
+-------------------------------------------------------------*/
+
+#include "Trace.h"
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+std::atomic<bool> traceEnabled(false);
+
+struct TraceEvent
+{
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+/** The zones recorded by one thread.  Each thread only ever appends to its own track, the lock is there so the
+ * track can be written out while the thread carries on. */
+struct ThreadTrack
+{
+    int id;
+    std::string name;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+};
+
+static std::mutex traceMutex;
+static std::string traceFilename;
+static std::chrono::steady_clock::time_point traceStart = std::chrono::steady_clock::now();
+
+// tracks of every thread that has recorded a zone or been named.  Tracks outlive their threads so their zones can
+// still be written, and are never freed.
+static std::vector<ThreadTrack*> tracks;
+
+static ThreadTrack& getThreadTrack()
+{
+    static thread_local ThreadTrack* track = NULL;
+    if (!track) {
+        track = new ThreadTrack();
+        std::lock_guard<std::mutex> lock(traceMutex);
+        track->id = (int)tracks.size() + 1;
+        track->name = "thread " + std::to_string(track->id);
+        tracks.push_back(track);
+    }
+    return *track;
+}
+
+/** Writes s as a JSON string. */
+static void writeString(FILE* file, std::string s)
+{
+    fputc('"', file);
+    for (int i = 0; i < (int)s.size(); i++) {
+        if (s[i] == '"' || s[i] == '\\') fputc('\\', file);
+        fputc(s[i], file);
+    }
+    fputc('"', file);
+}
+
+void startTrace(std::string filename)
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    for (int i = 0; i < (int)tracks.size(); i++) {
+        std::lock_guard<std::mutex> trackLock(tracks[i]->mutex);
+        tracks[i]->events.clear();
+    }
+    traceFilename = filename;
+    traceStart = std::chrono::steady_clock::now();
+    traceEnabled = true;
+}
+
+bool stopTrace()
+{
+    if (!traceEnabled.exchange(false)) return false;
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+    FILE* file = fopen(traceFilename.c_str(), "w");
+    if (!file) {
+        printf("Error, can not write trace %s.\n", traceFilename.c_str());
+        return false;
+    }
+
+    int zones = 0;
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (int i = 0; i < (int)tracks.size(); i++) {
+        ThreadTrack* track = tracks[i];
+        std::lock_guard<std::mutex> trackLock(track->mutex);
+
+        fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ",
+            i > 0 ? ",\n" : "", track->id);
+        writeString(file, track->name);
+        fprintf(file, "}}");
+        fprintf(file, ",\n{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"sort_index\": %d}}",
+            track->id, track->id);
+
+        for (int j = 0; j < (int)track->events.size(); j++) {
+            TraceEvent& event = track->events[j];
+            fprintf(file, ",\n{\"name\": ");
+            writeString(file, event.name);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %lld}",
+                track->id, (long long)event.start, (long long)(event.end - event.start));
+        }
+        zones += (int)track->events.size();
+    }
+    fprintf(file, "\n]}\n");
+
+    bool success = !ferror(file);
+    fclose(file);
+    if (success) {
+        printf("Wrote %d zones from %d threads to %s.\n", zones, (int)tracks.size(), traceFilename.c_str());
+    } else {
+        printf("Error, can not write trace %s.\n", traceFilename.c_str());
+    }
+    return success;
+}
+
+void setTraceThreadName(std::string name)
+{
+    ThreadTrack& track = getThreadTrack();
+    std::lock_guard<std::mutex> lock(track.mutex);
+    track.name = name;
+}
+
+int64_t getTraceTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - traceStart).count();
+}
+
+void addTraceZone(const char* name, int64_t start, int64_t end)
+{
+    ThreadTrack& track = getThreadTrack();
+    TraceEvent event = {name, start, end};
+    std::lock_guard<std::mutex> lock(track.mutex);
+    track.events.push_back(event);
+}
@@ -0,0 +1,60 @@
+/**
+ * Timeline tracing.
+ *
+ * Records named zones of time on each thread and writes them as a Chrome trace (JSON) with a track per thread, which
+ * can be opened in chrome://tracing or https://ui.perfetto.dev.  A zone is marked by putting TRACE_ZONE("name") at the
+ * top of a scope, and lasts until the end of that scope.  Tracing is off until startTrace is called, and while it is
+ * off a zone costs a single flag check.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+extern std::atomic<bool> traceEnabled;
+
+/** Starts recording zones, which are written to filename by stopTrace. */
+void startTrace(std::string filename);
+
+/** Stops recording and writes the zones recorded since startTrace.  Zones still open on other threads are left out.
+ * Returns false if tracing was not started or the file could not be written. */
+bool stopTrace();
+
+/** Returns if zones are being recorded. */
+inline bool isTracing() { return traceEnabled.load(std::memory_order_relaxed); }
+
+/** Names the calling threads track in the trace, for example "worker 1". */
+void setTraceThreadName(std::string name);
+
+/** Returns the time since startTrace in microseconds. */
+int64_t getTraceTime();
+
+/** Adds a finished zone to the calling threads track.  name must stay valid until the trace is written. */
+void addTraceZone(const char* name, int64_t start, int64_t end);
+
+/** Records the time from its construction to its destruction as a zone. */
+class TraceZone
+{
+    const char* name;
+    int64_t start = 0;
+
+public:
+    TraceZone(const char* name)
+    {
+        this->name = isTracing() ? name : NULL;
+        if (this->name) start = getTraceTime();
+    }
+
+    ~TraceZone()
+    {
+        if (name) addTraceZone(name, start, getTraceTime());
+    }
+};
+
+#define TRACE_ZONE_JOIN2(a, b) a##b
+#define TRACE_ZONE_JOIN(a, b) TRACE_ZONE_JOIN2(a, b)
+
+/** Records the rest of the enclosing scope as a zone called name, which should be a string literal. */
+#define TRACE_ZONE(name) TraceZone TRACE_ZONE_JOIN(traceZone, __LINE__)(name)
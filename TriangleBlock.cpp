@@ -0,0 +1,258 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Triangle blocks, and the kernels that intersect them.
+-------------------------------------------------------------*/
+
+#include "TriangleBlock.h"
+
+#include <string.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// ------------------------------------------------------------
+// Kernels
+// ------------------------------------------------------------
+
+static int intersectScalar(const TriangleBlockData& block, const Ray& ray, float& t)
+{
+    int nearest = -1;
+    float tMax = ray.length;
+
+    for (int i = 0; i < block.count; i++) {
+        glm::vec3 v1 = glm::vec3(block.v1[0][i], block.v1[1][i], block.v1[2][i]);
+        glm::vec3 e1 = glm::vec3(block.e1[0][i], block.e1[1][i], block.e1[2][i]);
+        glm::vec3 e2 = glm::vec3(block.e2[0][i], block.e2[1][i], block.e2[2][i]);
+
+        glm::vec3 p = glm::cross(ray.dir, e2);
+        float det = glm::dot(e1, p);
+        if (det == 0) continue;
+        float invDet = 1.0f / det;
+
+        glm::vec3 s = ray.pos - v1;
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0 || u > 1) continue;
+
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(ray.dir, q) * invDet;
+        if (v < 0 || u + v > 1) continue;
+
+        float d = glm::dot(e2, q) * invDet;
+        if (d < EPSILON || d >= tMax) continue;
+        tMax = d;
+        nearest = i;
+    }
+
+    t = tMax;
+    return nearest;
+}
+
+#ifdef SIMD_X86
+
+static int intersectSSE(const TriangleBlockData& block, const Ray& ray, float& t)
+{
+    int nearest = -1;
+    float tMax = ray.length;
+
+    __m128 ox = _mm_set1_ps(ray.pos.x), oy = _mm_set1_ps(ray.pos.y), oz = _mm_set1_ps(ray.pos.z);
+    __m128 dx = _mm_set1_ps(ray.dir.x), dy = _mm_set1_ps(ray.dir.y), dz = _mm_set1_ps(ray.dir.z);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 epsilon = _mm_set1_ps(EPSILON);
+
+    for (int base = 0; base < block.count; base += 4) {
+        __m128 e1x = _mm_loadu_ps(&block.e1[0][base]), e1y = _mm_loadu_ps(&block.e1[1][base]), e1z = _mm_loadu_ps(&block.e1[2][base]);
+        __m128 e2x = _mm_loadu_ps(&block.e2[0][base]), e2y = _mm_loadu_ps(&block.e2[1][base]), e2z = _mm_loadu_ps(&block.e2[2][base]);
+
+        // p = dir x e2
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 invDet = _mm_div_ps(one, det);
+
+        // s = pos - v1
+        __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(&block.v1[0][base]));
+        __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(&block.v1[1][base]));
+        __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(&block.v1[2][base]));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+        // q = s x e1
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+        __m128 d = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+        __m128 mask = _mm_cmpneq_ps(det, zero);
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(d, epsilon));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(d, _mm_set1_ps(tMax)));
+
+        int hits = _mm_movemask_ps(mask);
+        if (hits == 0) continue;
+
+        alignas(16) float distances[4];
+        _mm_store_ps(distances, d);
+        for (int lane = 0; lane < 4; lane++) {
+            if ((hits & (1 << lane)) && distances[lane] < tMax) {
+                tMax = distances[lane];
+                nearest = base + lane;
+            }
+        }
+    }
+
+    t = tMax;
+    return nearest;
+}
+
+TARGET_AVX static int intersectAVX(const TriangleBlockData& block, const Ray& ray, float& t)
+{
+    __m256 ox = _mm256_set1_ps(ray.pos.x), oy = _mm256_set1_ps(ray.pos.y), oz = _mm256_set1_ps(ray.pos.z);
+    __m256 dx = _mm256_set1_ps(ray.dir.x), dy = _mm256_set1_ps(ray.dir.y), dz = _mm256_set1_ps(ray.dir.z);
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 e1x = _mm256_loadu_ps(block.e1[0]), e1y = _mm256_loadu_ps(block.e1[1]), e1z = _mm256_loadu_ps(block.e1[2]);
+    __m256 e2x = _mm256_loadu_ps(block.e2[0]), e2y = _mm256_loadu_ps(block.e2[1]), e2z = _mm256_loadu_ps(block.e2[2]);
+
+    // p = dir x e2
+    __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+    __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+    __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    __m256 invDet = _mm256_div_ps(one, det);
+
+    // s = pos - v1
+    __m256 sx = _mm256_sub_ps(ox, _mm256_loadu_ps(block.v1[0]));
+    __m256 sy = _mm256_sub_ps(oy, _mm256_loadu_ps(block.v1[1]));
+    __m256 sz = _mm256_sub_ps(oz, _mm256_loadu_ps(block.v1[2]));
+    __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), invDet);
+
+    // q = s x e1
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+    __m256 d = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+
+    __m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_OQ);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(d, _mm256_set1_ps(EPSILON), _CMP_GE_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(d, _mm256_set1_ps(ray.length), _CMP_LT_OQ));
+
+    int nearest = -1;
+    float tMax = ray.length;
+
+    int hits = _mm256_movemask_ps(mask);
+    if (hits != 0) {
+        alignas(32) float distances[8];
+        _mm256_store_ps(distances, d);
+        for (int lane = 0; lane < 8; lane++) {
+            if ((hits & (1 << lane)) && distances[lane] < tMax) {
+                tMax = distances[lane];
+                nearest = lane;
+            }
+        }
+    }
+
+    t = tMax;
+    return nearest;
+}
+
+#endif
+
+// ------------------------------------------------------------
+// Dispatch
+// ------------------------------------------------------------
+
+const std::vector<TriangleBlockKernelInfo>& getTriangleBlockKernels()
+{
+    static std::vector<TriangleBlockKernelInfo> kernels;
+    if (kernels.empty()) {
+        kernels.push_back({"scalar", 1, true, intersectScalar});
+#ifdef SIMD_X86
+        // SSE2 is part of every x86-64 CPU, and assumed on 32 bit builds.
+        kernels.push_back({"sse", 4, true, intersectSSE});
+        kernels.push_back({"avx", 8, cpuSupportsAVX(), intersectAVX});
+#endif
+    }
+    return kernels;
+}
+
+const TriangleBlockKernelInfo& getTriangleBlockKernel()
+{
+    static int selected = -1;
+    if (selected < 0) {
+        const std::vector<TriangleBlockKernelInfo>& kernels = getTriangleBlockKernels();
+        for (int i = 0; i < (int)kernels.size(); i++) {
+            if (kernels[i].supported) selected = i;
+        }
+    }
+    return getTriangleBlockKernels()[selected];
+}
+
+// picked once before the scene is loaded, rather than looked up on every intersection.
+static TriangleBlockKernel blockKernel = getTriangleBlockKernel().kernel;
+
+// ------------------------------------------------------------
+// TriangleBlock
+// ------------------------------------------------------------
+
+TriangleBlock::TriangleBlock(const glm::vec3* vertices, int count) : SceneObject()
+{
+    memset(&data, 0, sizeof(data));
+    data.count = count;
+
+    for (int i = 0; i < count; i++) {
+        glm::vec3 v1 = vertices[i*3+0];
+        glm::vec3 v2 = vertices[i*3+1];
+        glm::vec3 v3 = vertices[i*3+2];
+        for (int axis = 0; axis < 3; axis++) {
+            data.v1[axis][i] = v1[axis];
+            data.e1[axis][i] = v2[axis] - v1[axis];
+            data.e2[axis][i] = v3[axis] - v1[axis];
+        }
+        triangles[i] = new Triangle(v1, v2, v3);
+    }
+}
+
+TriangleBlock::~TriangleBlock()
+{
+    for (int i = 0; i < data.count; i++) {
+        delete triangles[i];
+    }
+}
+
+bool TriangleBlock::getLocalBounds(glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+    boundsMin = glm::vec3(+INFINITY);
+    boundsMax = glm::vec3(-INFINITY);
+    for (int i = 0; i < data.count; i++) {
+        glm::vec3 v1 = glm::vec3(data.v1[0][i], data.v1[1][i], data.v1[2][i]);
+        glm::vec3 e1 = glm::vec3(data.e1[0][i], data.e1[1][i], data.e1[2][i]);
+        glm::vec3 e2 = glm::vec3(data.e2[0][i], data.e2[1][i], data.e2[2][i]);
+        boundsMin = glm::min(boundsMin, glm::min(v1, glm::min(v1 + e1, v1 + e2)));
+        boundsMax = glm::max(boundsMax, glm::max(v1, glm::max(v1 + e1, v1 + e2)));
+    }
+    return true;
+}
+
+bool TriangleBlock::intersectObject(Ray* ray)
+{
+    RAY_COUNT_TESTS(ray, primitiveTests, data.count);
+
+    float t;
+    int index = blockKernel(data, *ray, t);
+    if (index < 0) return false;
+
+    Triangle* triangle = triangles[index];
+    ray->collision = RayIntersectionResult(triangle, t, ray->pos + ray->dir * t, triangle->getNormal(), triangle->getTangent());
+    return true;
+}
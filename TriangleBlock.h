@@ -0,0 +1,77 @@
+/**
+ * Triangle blocks.
+ *
+ * Mesh leaves store their triangles in blocks of up to 8, laid out as structure of arrays (all the x's of the first
+ * vertex together, then all the y's and so on) so that a SIMD kernel can test a ray against every triangle in the
+ * block at once with Moller-Trumbore.  The kernel is picked when the program starts, using the widest instruction
+ * set the CPU supports: AVX tests 8 triangles per instruction, SSE 4, and the scalar kernel loops over them.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "SceneObject.h"
+#include "Plane.h"
+
+const int TRIANGLE_BLOCK_SIZE = 8;
+
+/** Up to TRIANGLE_BLOCK_SIZE triangles, in the layout the kernels read. */
+struct TriangleBlockData
+{
+    // first vertex and the two edges from it, per axis.  Unused lanes are degenerate (all zero) and never hit.
+    // blocks are allocated with new, which does not promise more than 16 byte alignment, so the kernels use
+    // unaligned loads.
+    float v1[3][TRIANGLE_BLOCK_SIZE];
+    float e1[3][TRIANGLE_BLOCK_SIZE];
+    float e2[3][TRIANGLE_BLOCK_SIZE];
+
+    // number of triangles in use.
+    int count;
+};
+
+/** Intersects ray with the triangles in block, returning the index of the nearest triangle hit at a distance in
+ * [EPSILON, ray.length], and that distance in t.  Returns -1 if no triangle was hit. */
+typedef int (*TriangleBlockKernel)(const TriangleBlockData& block, const Ray& ray, float& t);
+
+struct TriangleBlockKernelInfo
+{
+    const char* name;
+
+    // triangles tested per instruction.
+    int width;
+
+    // if the CPU can run this kernel.
+    bool supported;
+
+    TriangleBlockKernel kernel;
+};
+
+/** Returns the kernels built into this program, narrowest first, including those the CPU can not run. */
+const std::vector<TriangleBlockKernelInfo>& getTriangleBlockKernels();
+
+/** Returns the kernel used to render, which is the widest one the CPU supports. */
+const TriangleBlockKernelInfo& getTriangleBlockKernel();
+
+/** Scene object made of a block of triangles. */
+class TriangleBlock : public SceneObject
+{
+protected:
+    TriangleBlockData data;
+
+    // the triangles themselves, which hits are reported against so they can be shaded as usual.
+    Triangle* triangles[TRIANGLE_BLOCK_SIZE];
+
+public:
+    /** Creates a block from count (at most TRIANGLE_BLOCK_SIZE) triangles, every triad of vertices is a triangle. */
+    TriangleBlock(const glm::vec3* vertices, int count);
+
+    ~TriangleBlock();
+
+    bool intersectObject(Ray* ray) override;
+
+    bool getLocalBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) override;
+
+    const TriangleBlockData& getData() { return data; }
+};
@@ -1,5 +1,12 @@
 #include "Utils.h"
 
+#include <atomic>
+#include <random>
+
+#if defined(SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace glm {
 
     /** Returns squared length of vector */
@@ -16,6 +23,22 @@ namespace glm {
     
 }
 
+bool cpuSupportsAVX()
+{
+#if defined(SIMD_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // the OS must also save the AVX registers on a context switch.
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#elif defined(SIMD_X86) && defined(__GNUC__)
+    return __builtin_cpu_supports("avx");
+#else
+    return false;
+#endif
+}
+
 /** Loads a file from disk into at std::vector */
 void loadFile(std::vector<unsigned char>& buffer, const std::string& filename) 
 {
@@ -55,7 +78,10 @@ int clipi(int x, int a, int b)
 }
 
 float randf() {
-    return static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+    // rand() is not thread safe, so each thread gets its own generator with its own seed.
+    static std::atomic<unsigned> seedCounter(1);
+    static thread_local std::minstd_rand generator(seedCounter++);
+    return static_cast <float> (generator() - generator.min()) / static_cast <float> (generator.max() - generator.min());
 }
 
 float frac(float f)
@@ -63,6 +89,11 @@ float frac(float f)
     return f - int(f);
 }
 
+float luminance(Color color)
+{
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
 /** Convert color to 24bit form. */
 int colorToInt24(Color color)
 {
@@ -72,11 +103,11 @@ int colorToInt24(Color color)
     return (_r)+(_g << 8) + (_b << 16);
 }
 
-glm::vec3 defocus(glm::vec3 v, float r)
+glm::vec3 defocus(glm::vec3 v, float r, float u1, float u2)
 {    
     v = glm::normalize(v);    
-    float theta = randf()*2*PI;
-    float phi = randf()*r;
+    float theta = u1*2*PI;
+    float phi = u2*r;
 
     glm::mat4x4 rotationMatrix = glm::mat4x4(1);
 
@@ -89,6 +120,41 @@ glm::vec3 defocus(glm::vec3 v, float r)
     return glm::vec3(rotationMatrix * glm::vec4(v, 0));
 }
 
+/** Finds two vectors that together with normal form an orthonormal basis. */
+static void buildBasis(glm::vec3 normal, glm::vec3& tangent, glm::vec3& bitangent)
+{
+    tangent = (fabs(normal.x) > 0.9f) ? glm::vec3(0,1,0) : glm::vec3(1,0,0);
+    tangent = glm::normalize(glm::cross(normal, tangent));
+    bitangent = glm::cross(normal, tangent);
+}
+
+glm::vec3 sampleHemisphereCosine(glm::vec3 normal, float u1, float u2)
+{
+    // sample a disk uniformly then project up onto the hemisphere (Malley's method).
+    float r = sqrt(u1);
+    float theta = 2 * PI * u2;
+    float x = r * cos(theta);
+    float y = r * sin(theta);
+    float z = sqrt(maxf(0.0f, 1.0f - u1));
+
+    glm::vec3 tangent, bitangent;
+    buildBasis(normal, tangent, bitangent);
+
+    return glm::normalize(x * tangent + y * bitangent + z * normal);
+}
+
+glm::vec3 sampleCone(glm::vec3 axis, float cosThetaMax, float u1, float u2)
+{
+    float cosTheta = 1.0f - u1 * (1.0f - cosThetaMax);
+    float sinTheta = sqrt(maxf(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2 * PI * u2;
+
+    glm::vec3 tangent, bitangent;
+    buildBasis(axis, tangent, bitangent);
+
+    return glm::normalize(sinTheta * cos(phi) * tangent + sinTheta * sin(phi) * bitangent + cosTheta * axis);
+}
+
 glm::vec3 distort(glm::vec3 v, float d)
 {        
     return glm::normalize(v + glm::vec3(randf()*d, randf()*d, randf()*d));    
@@ -104,6 +170,45 @@ glm::mat4x4 EulerRotationMatrix(glm::vec3 rotation)
     return rotationMatrix;
 }   
 
+/** Spreads the low 10 bits of x out so there are two zero bits between each. */
+static uint32_t expandBits(uint32_t x)
+{
+    x = (x * 0x00010001u) & 0xFF0000FFu;
+    x = (x * 0x00000101u) & 0x0F00F00Fu;
+    x = (x * 0x00000011u) & 0xC30C30C3u;
+    x = (x * 0x00000005u) & 0x49249249u;
+    return x;
+}
+
+uint32_t mortonCode(glm::vec3 p)
+{
+    uint32_t x = (uint32_t)clipf(p.x * 1024.0f, 0.0f, 1023.0f);
+    uint32_t y = (uint32_t)clipf(p.y * 1024.0f, 0.0f, 1023.0f);
+    uint32_t z = (uint32_t)clipf(p.z * 1024.0f, 0.0f, 1023.0f);
+    return (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+}
+
+/** Spreads the low 21 bits of x out so there are two zero bits between each. */
+static uint64_t expandBits64(uint64_t x)
+{
+    x &= 0x1FFFFFull;
+    x = (x | x << 32) & 0x1F00000000FFFFull;
+    x = (x | x << 16) & 0x1F0000FF0000FFull;
+    x = (x | x << 8) & 0x100F00F00F00F00Full;
+    x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+uint64_t mortonCode64(glm::vec3 p)
+{
+    const float SCALE = (float)(1 << 21);
+    uint64_t x = (uint64_t)clipf(p.x * SCALE, 0.0f, SCALE - 1);
+    uint64_t y = (uint64_t)clipf(p.y * SCALE, 0.0f, SCALE - 1);
+    uint64_t z = (uint64_t)clipf(p.z * SCALE, 0.0f, SCALE - 1);
+    return (expandBits64(x) << 2) | (expandBits64(y) << 1) | expandBits64(z);
+}
+
 float raySphereIntersection(glm::vec3 rayPos, glm::vec3 rayDir, glm::vec3 sphereLocation, float radius)
 {    
     glm::vec3 vdif = rayPos - sphereLocation;
@@ -3,6 +3,7 @@
 /** Some extentions to the GLM library */
 
 #include <glm/glm.hpp>
+#include <stdint.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Color.h"
 #include <vector>
@@ -22,6 +23,22 @@ const float EPSILON = 0.00001;
 // math doesn't always have this defined for some reason.
 #define PI 3.141592654f
 
+// x86 builds have the SSE and AVX kernels, other builds fall back to scalar code.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+#endif
+
+// marks a function to be compiled for AVX on its own, so the rest of the program still runs on CPUs without it.
+// Such functions must only be called when cpuSupportsAVX() is true.
+#if defined(__GNUC__)
+#define TARGET_AVX __attribute__((target("avx")))
+#else
+#define TARGET_AVX
+#endif
+
+/** Returns if the CPU, and the operating system, support AVX instructions. */
+bool cpuSupportsAVX();
+
 
 /** Loads a file from disk into at std::vector */
 void loadFile(std::vector<unsigned char>& buffer, const std::string& filename);
@@ -41,18 +58,36 @@ float frac(float f);
 /** Returns max of a,b */
 float maxf(float a, float b);
 
+/** Returns perceptual brightness of a color. */
+float luminance(Color color);
+
 /** Convert color to 24bit form. */
 int colorToInt24(Color color);
 
 /** Returns a rotation matrix for given euler angles (in degrees) */
 glm::mat4x4 EulerRotationMatrix(glm::vec3 rotation);
 
-/** Randomly rotate vector r radians from it's current location. */
-glm::vec3 defocus(glm::vec3 v, float r);
+/** Randomly rotate vector r radians from it's current location.  u1, u2 are uniform random numbers in [0,1]. */
+glm::vec3 defocus(glm::vec3 v, float r, float u1, float u2);
+
+/** Returns a direction on the hemisphere around normal with a cosine weighted distribution, using the two uniform
+ * random numbers u1, u2 in [0,1]. The pdf of the returned direction is cos(theta)/pi. */
+glm::vec3 sampleHemisphereCosine(glm::vec3 normal, float u1, float u2);
+
+/** Returns a direction uniformly distributed over the cone around axis with given cos of half angle.
+ * The pdf of the returned direction is 1/(2pi(1-cosThetaMax)). */
+glm::vec3 sampleCone(glm::vec3 axis, float cosThetaMax, float u1, float u2);
 
 /** Similar to defocus, in that is rotates v a little bit, but much quicker.  d here is in units, so use small values. */
 glm::vec3 distort(glm::vec3 v, float d);
 
+/** Returns the 30 bit Morton code of p, a point in the unit cube, made by interleaving 10 bits from each axis.  Points
+ * near each other along the Z order curve this traces have codes near each other. */
+uint32_t mortonCode(glm::vec3 p);
+
+/** As mortonCode, but 63 bits long with 21 bits from each axis. */
+uint64_t mortonCode64(glm::vec3 p);
+
 /** Returns distance ray must travel before it hits sphere, or 0 if ray does not intersect sphere. */
 float raySphereIntersection(glm::vec3 rayPos, glm::vec3 rayDir, glm::vec3 sphereLocation, float radius);
 
@@ -0,0 +1,1658 @@
+/*----------------------------------------------------------
+* COSC363  Ray Tracer
+*
+*  Wide bounding volume hierarchy, and the node tests.
+-------------------------------------------------------------*/
+
+#include "WideBVH.h"
+#include "ThreadPool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <limits>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <string.h>
+
+#ifdef SIMD_X86
+#include <immintrin.h>
+#endif
+
+// maximum number of objects in a leaf.  Nodes test many children at once so small leaves work best.
+const int BVH_MAX_LEAF_OBJECTS = 2;
+
+// number of bins object centers are sorted into along each axis when looking for the best split.
+const int BVH_SAH_BINS = 16;
+
+// nodes over at least this many objects bin them on the thread pool.
+const int BVH_PARALLEL_BIN_OBJECTS = 65536;
+
+// subtrees over fewer objects than this are each built by one thread, once the nodes above them are done.
+const int BVH_SUBTREE_OBJECTS = 4096;
+
+// cost of visiting a node relative to testing an object, for the surface area heuristic.
+const float BVH_SAH_NODE_COST = 1.2f;
+
+// linear builds use 63 bit rather than 30 bit Morton codes for at least this many objects.
+const int BVH_LONG_MORTON_OBJECTS = 65536;
+
+// keys per task when making and sorting Morton codes.
+const int BVH_SORT_CHUNK_KEYS = 16384;
+
+// maximum number of subtrees a treelet is rearranged over.  The best layout is searched over every subset of them.
+const int BVH_TREELET_LEAVES = 7;
+
+// nodes waiting to be visited, which is at most (N-1) per level of the tree plus one.
+const int BVH_STACK_SIZE = 256;
+
+// packets with fewer rays left than this finish the subtree they are in one ray at a time.
+const int BVH_PACKET_MIN_RAYS = RAY_PACKET_SIZE / 4;
+
+struct AccelerationInfo
+{
+    const char* name;
+    int width;
+    int bits;
+};
+
+// in the order of Acceleration.
+static const AccelerationInfo ACCELERATIONS[] = {
+    {"spheres", 0, 0},
+    {"bvh4", 4, 0},
+    {"bvh8", 8, 0},
+    {"bvh4q16", 4, 16},
+    {"bvh8q16", 8, 16},
+    {"bvh4q8", 4, 8},
+    {"bvh8q8", 8, 8},
+};
+
+const char* getAccelerationName(int acceleration)
+{
+    if (acceleration < 0 || acceleration >= ACCEL_COUNT) return "unknown";
+    return ACCELERATIONS[acceleration].name;
+}
+
+int parseAcceleration(std::string name)
+{
+    for (int i = 0; i < ACCEL_COUNT; i++) {
+        if (name == ACCELERATIONS[i].name) return i;
+    }
+    return -1;
+}
+
+int getAccelerationWidth(int acceleration)
+{
+    if (acceleration < 0 || acceleration >= ACCEL_COUNT) return 0;
+    return ACCELERATIONS[acceleration].width;
+}
+
+int getAccelerationBits(int acceleration)
+{
+    if (acceleration < 0 || acceleration >= ACCEL_COUNT) return 0;
+    return ACCELERATIONS[acceleration].bits;
+}
+
+/** Returns 2^exponent, for exponents from -126 to 127. */
+static inline float exponentToScale(int exponent)
+{
+    uint32_t bits = (uint32_t)(exponent + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// ------------------------------------------------------------
+// Node tests
+// ------------------------------------------------------------
+
+template <int N>
+static int testBoxesScalar(const BVHNode<N>& node, const BVHRay& ray, float* tNear)
+{
+    int hits = 0;
+    for (int i = 0; i < N; i++) {
+        float tMin = 0;
+        float tMax = ray.length;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (node.boundsMin[axis][i] - ray.origin[axis]) * ray.invDir[axis];
+            float t1 = (node.boundsMax[axis][i] - ray.origin[axis]) * ray.invDir[axis];
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        tNear[i] = tMin;
+        if (tMin <= tMax) hits |= 1 << i;
+    }
+    return hits;
+}
+
+/** Scale and offset which turn a quantized nodes planes along each axis into distances along ray, as a plane at q
+ * steps is (origin + q * scale - ray origin) * invDir = q * a + b along the ray. */
+template <int N, typename Q>
+static inline void getQuantizedPlanes(const BVHQuantizedNode<N, Q>& node, const BVHRay& ray, float* a, float* b)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        a[axis] = exponentToScale(node.exponent[axis]) * ray.invDir[axis];
+        b[axis] = (node.origin[axis] - ray.origin[axis]) * ray.invDir[axis];
+    }
+}
+
+template <int N, typename Q>
+static int testQuantizedBoxesScalar(const BVHQuantizedNode<N, Q>& node, const BVHRay& ray, float* tNear)
+{
+    float a[3], b[3];
+    getQuantizedPlanes(node, ray, a, b);
+
+    int hits = 0;
+    for (int i = 0; i < N; i++) {
+        float tMin = 0;
+        float tMax = ray.length;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = node.boundsMin[axis][i] * a[axis] + b[axis];
+            float t1 = node.boundsMax[axis][i] * a[axis] + b[axis];
+            tMin = std::max(tMin, std::min(t0, t1));
+            tMax = std::min(tMax, std::max(t0, t1));
+        }
+        tNear[i] = tMin;
+        if (tMin <= tMax) hits |= 1 << i;
+    }
+    return hits;
+}
+
+#ifdef SIMD_X86
+
+/** Slab test of ray against the 4 boxes starting at lane of node. */
+template <int N>
+static inline int testBoxGroupSSE(const BVHNode<N>& node, int lane, const BVHRay& ray, float* tNear)
+{
+    __m128 tMin = _mm_setzero_ps();
+    __m128 tMax = _mm_set1_ps(ray.length);
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 origin = _mm_set1_ps(ray.origin[axis]);
+        __m128 invDir = _mm_set1_ps(ray.invDir[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.boundsMin[axis][lane]), origin), invDir);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.boundsMax[axis][lane]), origin), invDir);
+        tMin = _mm_max_ps(tMin, _mm_min_ps(t0, t1));
+        tMax = _mm_min_ps(tMax, _mm_max_ps(t0, t1));
+    }
+    _mm_storeu_ps(&tNear[lane], tMin);
+    return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) << lane;
+}
+
+static int testBoxes4SSE(const BVHNode<4>& node, const BVHRay& ray, float* tNear)
+{
+    return testBoxGroupSSE(node, 0, ray, tNear);
+}
+
+static int testBoxes8SSE(const BVHNode<8>& node, const BVHRay& ray, float* tNear)
+{
+    return testBoxGroupSSE(node, 0, ray, tNear) | testBoxGroupSSE(node, 4, ray, tNear);
+}
+
+TARGET_AVX static int testBoxes8AVX(const BVHNode<8>& node, const BVHRay& ray, float* tNear)
+{
+    __m256 tMin = _mm256_setzero_ps();
+    __m256 tMax = _mm256_set1_ps(ray.length);
+    for (int axis = 0; axis < 3; axis++) {
+        __m256 origin = _mm256_set1_ps(ray.origin[axis]);
+        __m256 invDir = _mm256_set1_ps(ray.invDir[axis]);
+        __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.boundsMin[axis]), origin), invDir);
+        __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.boundsMax[axis]), origin), invDir);
+        tMin = _mm256_max_ps(tMin, _mm256_min_ps(t0, t1));
+        tMax = _mm256_min_ps(tMax, _mm256_max_ps(t0, t1));
+    }
+    _mm256_storeu_ps(tNear, tMin);
+    return _mm256_movemask_ps(_mm256_cmp_ps(tMin, tMax, _CMP_LE_OQ));
+}
+
+/** Loads 4 quantized coordinates as 32 bit integers. */
+static inline __m128i loadQuantized4(const uint8_t* q)
+{
+    int32_t packed;
+    memcpy(&packed, q, sizeof(packed));
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+}
+
+static inline __m128i loadQuantized4(const uint16_t* q)
+{
+    return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)q), _mm_setzero_si128());
+}
+
+/** As testBoxGroupSSE, for a quantized node with planes from getQuantizedPlanes. */
+template <int N, typename Q>
+static inline int testQuantizedBoxGroupSSE(const BVHQuantizedNode<N, Q>& node, int lane, const BVHRay& ray,
+    const float* a, const float* b, float* tNear)
+{
+    __m128 tMin = _mm_setzero_ps();
+    __m128 tMax = _mm_set1_ps(ray.length);
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 scale = _mm_set1_ps(a[axis]);
+        __m128 offset = _mm_set1_ps(b[axis]);
+        __m128 q0 = _mm_cvtepi32_ps(loadQuantized4(&node.boundsMin[axis][lane]));
+        __m128 q1 = _mm_cvtepi32_ps(loadQuantized4(&node.boundsMax[axis][lane]));
+        __m128 t0 = _mm_add_ps(_mm_mul_ps(q0, scale), offset);
+        __m128 t1 = _mm_add_ps(_mm_mul_ps(q1, scale), offset);
+        tMin = _mm_max_ps(tMin, _mm_min_ps(t0, t1));
+        tMax = _mm_min_ps(tMax, _mm_max_ps(t0, t1));
+    }
+    _mm_storeu_ps(&tNear[lane], tMin);
+    return _mm_movemask_ps(_mm_cmple_ps(tMin, tMax)) << lane;
+}
+
+template <typename Q>
+static int testQuantizedBoxes4SSE(const BVHQuantizedNode<4, Q>& node, const BVHRay& ray, float* tNear)
+{
+    float a[3], b[3];
+    getQuantizedPlanes(node, ray, a, b);
+    return testQuantizedBoxGroupSSE(node, 0, ray, a, b, tNear);
+}
+
+template <typename Q>
+static int testQuantizedBoxes8SSE(const BVHQuantizedNode<8, Q>& node, const BVHRay& ray, float* tNear)
+{
+    float a[3], b[3];
+    getQuantizedPlanes(node, ray, a, b);
+    return testQuantizedBoxGroupSSE(node, 0, ray, a, b, tNear) | testQuantizedBoxGroupSSE(node, 4, ray, a, b, tNear);
+}
+
+/** Widens 8 16 bit coordinates to two sets of 4 32 bit integers. */
+static inline void widenQuantized8(__m128i packed, __m128i& low, __m128i& high)
+{
+    __m128i zero = _mm_setzero_si128();
+    low = _mm_unpacklo_epi16(packed, zero);
+    high = _mm_unpackhi_epi16(packed, zero);
+}
+
+/** Loads 8 quantized coordinates as floats. */
+TARGET_AVX static inline __m256 loadQuantized8(const uint8_t* q)
+{
+    __m128i low, high;
+    widenQuantized8(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)q), _mm_setzero_si128()), low, high);
+    return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+TARGET_AVX static inline __m256 loadQuantized8(const uint16_t* q)
+{
+    __m128i low, high;
+    widenQuantized8(_mm_loadu_si128((const __m128i*)q), low, high);
+    return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+template <typename Q>
+TARGET_AVX static int testQuantizedBoxes8AVX(const BVHQuantizedNode<8, Q>& node, const BVHRay& ray, float* tNear)
+{
+    float a[3], b[3];
+    getQuantizedPlanes(node, ray, a, b);
+
+    __m256 tMin = _mm256_setzero_ps();
+    __m256 tMax = _mm256_set1_ps(ray.length);
+    for (int axis = 0; axis < 3; axis++) {
+        __m256 scale = _mm256_set1_ps(a[axis]);
+        __m256 offset = _mm256_set1_ps(b[axis]);
+        __m256 t0 = _mm256_add_ps(_mm256_mul_ps(loadQuantized8(node.boundsMin[axis]), scale), offset);
+        __m256 t1 = _mm256_add_ps(_mm256_mul_ps(loadQuantized8(node.boundsMax[axis]), scale), offset);
+        tMin = _mm256_max_ps(tMin, _mm256_min_ps(t0, t1));
+        tMax = _mm256_min_ps(tMax, _mm256_max_ps(t0, t1));
+    }
+    _mm256_storeu_ps(tNear, tMin);
+    return _mm256_movemask_ps(_mm256_cmp_ps(tMin, tMax, _CMP_LE_OQ));
+}
+
+#endif
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHNode<4>>>& getBVHNodeTests()
+{
+    static std::vector<BVHNodeTestInfo<BVHNode<4>>> tests;
+    if (tests.empty()) {
+        tests.push_back({"scalar", true, testBoxesScalar<4>});
+#ifdef SIMD_X86
+        tests.push_back({"sse", true, testBoxes4SSE});
+#endif
+    }
+    return tests;
+}
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHNode<8>>>& getBVHNodeTests()
+{
+    static std::vector<BVHNodeTestInfo<BVHNode<8>>> tests;
+    if (tests.empty()) {
+        tests.push_back({"scalar", true, testBoxesScalar<8>});
+#ifdef SIMD_X86
+        tests.push_back({"sse", true, testBoxes8SSE});
+        tests.push_back({"avx", cpuSupportsAVX(), testBoxes8AVX});
+#endif
+    }
+    return tests;
+}
+
+template <typename Q>
+static const std::vector<BVHNodeTestInfo<BVHQuantizedNode<4, Q>>>& getQuantizedNodeTests4()
+{
+    static std::vector<BVHNodeTestInfo<BVHQuantizedNode<4, Q>>> tests;
+    if (tests.empty()) {
+        tests.push_back({"scalar", true, testQuantizedBoxesScalar<4, Q>});
+#ifdef SIMD_X86
+        tests.push_back({"sse", true, testQuantizedBoxes4SSE<Q>});
+#endif
+    }
+    return tests;
+}
+
+template <typename Q>
+static const std::vector<BVHNodeTestInfo<BVHQuantizedNode<8, Q>>>& getQuantizedNodeTests8()
+{
+    static std::vector<BVHNodeTestInfo<BVHQuantizedNode<8, Q>>> tests;
+    if (tests.empty()) {
+        tests.push_back({"scalar", true, testQuantizedBoxesScalar<8, Q>});
+#ifdef SIMD_X86
+        tests.push_back({"sse", true, testQuantizedBoxes8SSE<Q>});
+        tests.push_back({"avx", cpuSupportsAVX(), testQuantizedBoxes8AVX<Q>});
+#endif
+    }
+    return tests;
+}
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHQuantizedNode<4, uint8_t>>>& getBVHNodeTests()
+{
+    return getQuantizedNodeTests4<uint8_t>();
+}
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHQuantizedNode<8, uint8_t>>>& getBVHNodeTests()
+{
+    return getQuantizedNodeTests8<uint8_t>();
+}
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHQuantizedNode<4, uint16_t>>>& getBVHNodeTests()
+{
+    return getQuantizedNodeTests4<uint16_t>();
+}
+
+template <>
+const std::vector<BVHNodeTestInfo<BVHQuantizedNode<8, uint16_t>>>& getBVHNodeTests()
+{
+    return getQuantizedNodeTests8<uint16_t>();
+}
+
+/** Returns the last, and so widest, test the CPU supports. */
+template <typename Node>
+static BVHNodeTest<Node> selectNodeTest()
+{
+    const std::vector<BVHNodeTestInfo<Node>>& tests = getBVHNodeTests<Node>();
+    BVHNodeTest<Node> selected = NULL;
+    for (int i = 0; i < (int)tests.size(); i++) {
+        if (tests[i].supported) selected = tests[i].test;
+    }
+    return selected;
+}
+
+static BVHNodeTest<BVHNode<4>> nodeTest4 = selectNodeTest<BVHNode<4>>();
+static BVHNodeTest<BVHNode<8>> nodeTest8 = selectNodeTest<BVHNode<8>>();
+static BVHNodeTest<BVHQuantizedNode<4, uint8_t>> nodeTest4q8 = selectNodeTest<BVHQuantizedNode<4, uint8_t>>();
+static BVHNodeTest<BVHQuantizedNode<8, uint8_t>> nodeTest8q8 = selectNodeTest<BVHQuantizedNode<8, uint8_t>>();
+static BVHNodeTest<BVHQuantizedNode<4, uint16_t>> nodeTest4q16 = selectNodeTest<BVHQuantizedNode<4, uint16_t>>();
+static BVHNodeTest<BVHQuantizedNode<8, uint16_t>> nodeTest8q16 = selectNodeTest<BVHQuantizedNode<8, uint16_t>>();
+
+// ------------------------------------------------------------
+// Quantizing
+// ------------------------------------------------------------
+
+template <int N, typename Q>
+void quantizeBVHNode(BVHQuantizedNode<N, Q>& node, const float boundsMin[3][N], const float boundsMax[3][N],
+    int children)
+{
+    const float steps = (float)std::numeric_limits<Q>::max();
+
+    memset(&node, 0, sizeof(node));
+    node.children = (uint8_t)children;
+    for (int axis = 0; axis < 3; axis++) {
+        float low = FLT_MAX;
+        float high = -FLT_MAX;
+        for (int i = 0; i < children; i++) {
+            low = std::min(low, boundsMin[axis][i]);
+            high = std::max(high, boundsMax[axis][i]);
+        }
+        if (children == 0) low = high = 0;
+        node.origin[axis] = low;
+
+        // the smallest power of two step that spans the boxes in the steps available.  Decoding a box rounds, so
+        // its ends are moved out a step at a time until they hold the original, which may need a larger step.
+        int exponent;
+        frexpf((high - low) / steps, &exponent);
+        for (exponent = std::max(exponent, -126); exponent < 127; exponent++) {
+            float scale = exponentToScale(exponent);
+            bool covered = true;
+            for (int i = 0; i < children; i++) {
+                float qMin = floorf((boundsMin[axis][i] - low) / scale);
+                float qMax = std::min(ceilf((boundsMax[axis][i] - low) / scale), steps);
+                while (qMin > 0 && low + qMin * scale > boundsMin[axis][i]) qMin--;
+                while (qMax < steps && low + qMax * scale < boundsMax[axis][i]) qMax++;
+                if (low + qMax * scale < boundsMax[axis][i]) covered = false;
+                node.boundsMin[axis][i] = (Q)qMin;
+                node.boundsMax[axis][i] = (Q)qMax;
+            }
+            if (covered) break;
+        }
+        node.exponent[axis] = (int8_t)exponent;
+    }
+}
+
+template void quantizeBVHNode(BVHQuantizedNode<4, uint8_t>&, const float[3][4], const float[3][4], int);
+template void quantizeBVHNode(BVHQuantizedNode<8, uint8_t>&, const float[3][8], const float[3][8], int);
+template void quantizeBVHNode(BVHQuantizedNode<4, uint16_t>&, const float[3][4], const float[3][4], int);
+template void quantizeBVHNode(BVHQuantizedNode<8, uint16_t>&, const float[3][8], const float[3][8], int);
+
+/** Sets boundsMin and boundsMax to the boxes of a quantized node, which are at least as large as the originals. */
+template <int N, typename Q>
+static inline void decodeBVHNode(const BVHQuantizedNode<N, Q>& node, float boundsMin[3][N], float boundsMax[3][N])
+{
+    for (int axis = 0; axis < 3; axis++) {
+        float scale = exponentToScale(node.exponent[axis]);
+        for (int i = 0; i < N; i++) {
+            boundsMin[axis][i] = node.origin[axis] + node.boundsMin[axis][i] * scale;
+            boundsMax[axis][i] = node.origin[axis] + node.boundsMax[axis][i] * scale;
+        }
+    }
+}
+
+// ------------------------------------------------------------
+// Building
+// ------------------------------------------------------------
+
+/** A node of the binary tree the wide tree is collapsed from. */
+struct BVHBuildNode
+{
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // child nodes, or -1 for leaves.
+    int left = -1;
+    int right = -1;
+
+    // objects in a leaf.
+    int first = 0;
+    int count = 0;
+};
+
+static float surfaceArea(glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    glm::vec3 size = boundsMax - boundsMin;
+    return 2 * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+/** A range of objects to build a node over, with the bounds of the objects and of their centers. */
+struct BVHBuildRange
+{
+    int start;
+    int end;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 centerMin;
+    glm::vec3 centerMax;
+};
+
+/** Objects whose centers fall in one bin along an axis. */
+struct BVHBin
+{
+    glm::vec3 boundsMin = glm::vec3(+INFINITY);
+    glm::vec3 boundsMax = glm::vec3(-INFINITY);
+    glm::vec3 centerMin = glm::vec3(+INFINITY);
+    glm::vec3 centerMax = glm::vec3(-INFINITY);
+    int count = 0;
+
+    void add(const BVHObject& object)
+    {
+        glm::vec3 center = (object.boundsMin + object.boundsMax) * 0.5f;
+        boundsMin = glm::min(boundsMin, object.boundsMin);
+        boundsMax = glm::max(boundsMax, object.boundsMax);
+        centerMin = glm::min(centerMin, center);
+        centerMax = glm::max(centerMax, center);
+        count++;
+    }
+
+    void add(const BVHBin& bin)
+    {
+        boundsMin = glm::min(boundsMin, bin.boundsMin);
+        boundsMax = glm::max(boundsMax, bin.boundsMax);
+        centerMin = glm::min(centerMin, bin.centerMin);
+        centerMax = glm::max(centerMax, bin.centerMax);
+        count += bin.count;
+    }
+};
+
+/** A subtree left to be built once the top of the tree is done, and the node waiting for it. */
+struct BVHSubtreeTask
+{
+    int node;
+    BVHBuildRange range;
+};
+
+/** Returns the bin along axis that center falls in. */
+static inline int getBin(glm::vec3 center, int axis, const BVHBuildRange& range, float scale)
+{
+    int bin = (int)((center[axis] - range.centerMin[axis]) * scale);
+    return std::max(0, std::min(bin, BVH_SAH_BINS - 1));
+}
+
+/** Calls binRange(start, end, bins) over [range.start, range.end), on the thread pool if the range is large, and
+ * adds together the bins it fills. */
+template <int BINS, typename F>
+static void binInParallel(const BVHBuildRange& range, BVHBin* bins, F binRange)
+{
+    int count = range.end - range.start;
+    if (count < BVH_PARALLEL_BIN_OBJECTS) {
+        binRange(range.start, range.end, bins);
+        return;
+    }
+    std::mutex mutex;
+    ThreadPool::global().parallelFor(count, BVH_PARALLEL_BIN_OBJECTS / 4, [&](int start, int end) {
+        BVHBin chunkBins[BINS];
+        binRange(range.start + start, range.start + end, chunkBins);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < BINS; i++) {
+            bins[i].add(chunkBins[i]);
+        }
+    });
+}
+
+/** Returns range [start, end) of objects with its bounds filled in. */
+static BVHBuildRange getBuildRange(const std::vector<BVHObject>& objects, int start, int end)
+{
+    BVHBuildRange range;
+    range.start = start;
+    range.end = end;
+    BVHBin all;
+    binInParallel<1>(range, &all, [&objects](int start, int end, BVHBin* bins) {
+        for (int i = start; i < end; i++) {
+            bins[0].add(objects[i]);
+        }
+    });
+    range.boundsMin = all.boundsMin;
+    range.boundsMax = all.boundsMax;
+    range.centerMin = all.centerMin;
+    range.centerMax = all.centerMax;
+    return range;
+}
+
+/** Builds a binary node over range, splitting it where the surface area heuristic finds cheapest among
+ * BVH_SAH_BINS bins of their centers along each axis.  Returns the nodes index.  When subtrees is given, ranges
+ * smaller than BVH_SUBTREE_OBJECTS are left as empty nodes for a task in subtrees to fill in later. */
+static int buildBinaryNode(std::vector<BVHObject>& objects, const BVHBuildRange& range,
+    std::vector<BVHBuildNode>& nodes, std::vector<BVHSubtreeTask>* subtrees)
+{
+    int start = range.start;
+    int end = range.end;
+
+    BVHBuildNode node;
+    node.boundsMin = range.boundsMin;
+    node.boundsMax = range.boundsMax;
+    int index = (int)nodes.size();
+    nodes.push_back(node);
+
+    if (end - start <= BVH_MAX_LEAF_OBJECTS) {
+        nodes[index].first = start;
+        nodes[index].count = end - start;
+        return index;
+    }
+
+    if (subtrees && end - start < BVH_SUBTREE_OBJECTS) {
+        subtrees->push_back({index, range});
+        return index;
+    }
+
+    glm::vec3 extent = range.centerMax - range.centerMin;
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0 ? BVH_SAH_BINS * 0.9999f / extent[axis] : 0;
+    }
+
+    BVHBin bins[3 * BVH_SAH_BINS];
+    binInParallel<3 * BVH_SAH_BINS>(range, bins, [&](int start, int end, BVHBin* bins) {
+        for (int i = start; i < end; i++) {
+            glm::vec3 center = (objects[i].boundsMin + objects[i].boundsMax) * 0.5f;
+            for (int axis = 0; axis < 3; axis++) {
+                bins[axis * BVH_SAH_BINS + getBin(center, axis, range, scale[axis])].add(objects[i]);
+            }
+        }
+    });
+
+    // sweep each axis from the right, then from the left, to find the split with the least cost, which is the
+    // number of objects on each side weighted by the chance of a ray that hits this node hitting that side.
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = INFINITY;
+    BVHBin bestLeft;
+    BVHBin bestRight;
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0) continue;
+        const BVHBin* axisBins = &bins[axis * BVH_SAH_BINS];
+        BVHBin right[BVH_SAH_BINS];
+        right[BVH_SAH_BINS - 1] = axisBins[BVH_SAH_BINS - 1];
+        for (int i = BVH_SAH_BINS - 2; i > 0; i--) {
+            right[i] = right[i + 1];
+            right[i].add(axisBins[i]);
+        }
+        BVHBin left;
+        for (int split = 1; split < BVH_SAH_BINS; split++) {
+            left.add(axisBins[split - 1]);
+            if (left.count == 0 || right[split].count == 0) continue;
+            float cost = surfaceArea(left.boundsMin, left.boundsMax) * left.count +
+                surfaceArea(right[split].boundsMin, right[split].boundsMax) * right[split].count;
+            if (cost < bestCost) {
+                bestAxis = axis;
+                bestSplit = split;
+                bestCost = cost;
+                bestLeft = left;
+                bestRight = right[split];
+            }
+        }
+    }
+
+    int middle;
+    BVHBuildRange leftRange;
+    BVHBuildRange rightRange;
+    if (bestAxis >= 0) {
+        int axis = bestAxis;
+        float axisScale = scale[axis];
+        middle = (int)(std::partition(objects.begin() + start, objects.begin() + end,
+            [&](const BVHObject& object) {
+                return getBin((object.boundsMin + object.boundsMax) * 0.5f, axis, range, axisScale) < bestSplit;
+            }) - objects.begin());
+        leftRange = {start, middle, bestLeft.boundsMin, bestLeft.boundsMax, bestLeft.centerMin, bestLeft.centerMax};
+        rightRange = {middle, end, bestRight.boundsMin, bestRight.boundsMax, bestRight.centerMin, bestRight.centerMax};
+    } else {
+        // every center is in the same place, so any split is as good as another.
+        middle = (start + end) / 2;
+        leftRange = getBuildRange(objects, start, middle);
+        rightRange = getBuildRange(objects, middle, end);
+    }
+
+    int left = buildBinaryNode(objects, leftRange, nodes, subtrees);
+    int right = buildBinaryNode(objects, rightRange, nodes, subtrees);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+/** Builds the binary tree over objects into nodes, with the root first.  The top of the tree is built first,
+ * binning large ranges in parallel, then the subtrees below it are built at the same time on the thread pool. */
+static void buildBinaryTree(std::vector<BVHObject>& objects, std::vector<BVHBuildNode>& nodes)
+{
+    std::vector<BVHSubtreeTask> subtrees;
+    buildBinaryNode(objects, getBuildRange(objects, 0, (int)objects.size()), nodes, &subtrees);
+
+    // each subtree covers its own range of objects, so they can be built and reordered independently.
+    std::vector<std::vector<BVHBuildNode>> subtreeNodes(subtrees.size());
+    ThreadPool::global().parallelFor((int)subtrees.size(), 1, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            TRACE_ZONE("build bvh subtree");
+            subtreeNodes[i].reserve((subtrees[i].range.end - subtrees[i].range.start) * 2);
+            buildBinaryNode(objects, subtrees[i].range, subtreeNodes[i], NULL);
+        }
+    });
+
+    // the root of each subtree replaces the node waiting for it and the rest are appended, in the order the tasks
+    // were made so the tree is the same however the work was shared out.
+    for (int i = 0; i < (int)subtrees.size(); i++) {
+        const std::vector<BVHBuildNode>& subtree = subtreeNodes[i];
+        int offset = (int)nodes.size() - 1;
+        for (int j = 0; j < (int)subtree.size(); j++) {
+            BVHBuildNode node = subtree[j];
+            if (node.left >= 0) {
+                node.left += offset;
+                node.right += offset;
+            }
+            if (j == 0) {
+                nodes[subtrees[i].node] = node;
+            } else {
+                nodes.push_back(node);
+            }
+        }
+    }
+}
+
+/** A Morton code and the index of the object it belongs to. */
+typedef std::pair<uint64_t, int> BVHMortonKey;
+
+/** Sorts keys by the low bits of their codes with a radix sort, keeping keys with equal codes in order.  Each pass
+ * counts the digits in a chunk of keys per task, then each chunk scatters its keys to where the counts put them. */
+static void sortMortonKeys(std::vector<BVHMortonKey>& keys, int bits)
+{
+    const int DIGIT_BITS = 8;
+    const int DIGITS = 1 << DIGIT_BITS;
+    int n = (int)keys.size();
+    int chunkSize = std::max(BVH_SORT_CHUNK_KEYS, (n + ThreadPool::global().size() - 1) / ThreadPool::global().size());
+    int chunks = (n + chunkSize - 1) / chunkSize;
+
+    std::vector<BVHMortonKey> scratch(n);
+    std::vector<int> offsets(chunks * DIGITS);
+    for (int shift = 0; shift < bits; shift += DIGIT_BITS) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        ThreadPool::global().parallelFor(chunks, 1, [&](int start, int end) {
+            for (int chunk = start; chunk < end; chunk++) {
+                int* counts = &offsets[chunk * DIGITS];
+                for (int i = chunk * chunkSize; i < std::min(n, (chunk + 1) * chunkSize); i++) {
+                    counts[(keys[i].first >> shift) & (DIGITS - 1)]++;
+                }
+            }
+        });
+
+        // each digit's keys go after those of the smaller digits, and within a digit in the order of the chunks.
+        int total = 0;
+        for (int digit = 0; digit < DIGITS; digit++) {
+            for (int chunk = 0; chunk < chunks; chunk++) {
+                int count = offsets[chunk * DIGITS + digit];
+                offsets[chunk * DIGITS + digit] = total;
+                total += count;
+            }
+        }
+
+        ThreadPool::global().parallelFor(chunks, 1, [&](int start, int end) {
+            for (int chunk = start; chunk < end; chunk++) {
+                int* next = &offsets[chunk * DIGITS];
+                for (int i = chunk * chunkSize; i < std::min(n, (chunk + 1) * chunkSize); i++) {
+                    scratch[next[(keys[i].first >> shift) & (DIGITS - 1)]++] = keys[i];
+                }
+            }
+        });
+        keys.swap(scratch);
+    }
+}
+
+static inline int countLeadingZeros(uint64_t x)
+{
+    if (x == 0) return 64;
+    int count = 0;
+    for (int step = 32; step > 0; step /= 2) {
+        if (!(x >> (64 - step))) {
+            count += step;
+            x <<= step;
+        }
+    }
+    return count;
+}
+
+/** Returns the number of leading bits the keys at i and j share, or -1 if j is not a key.  Keys with equal codes
+ * are told apart by their position, so every key is unique. */
+static inline int commonPrefix(const std::vector<BVHMortonKey>& keys, int i, int j)
+{
+    if (j < 0 || j >= (int)keys.size()) return -1;
+    if (keys[i].first == keys[j].first) return 64 + countLeadingZeros((uint64_t)(uint32_t)(i ^ j)) - 32;
+    return countLeadingZeros(keys[i].first ^ keys[j].first);
+}
+
+/** Finds the children of inner node i of the radix tree over keys (Karras, "Maximizing Parallelism in the
+ * Construction of BVHs, Octrees, and k-d Trees").  Inner node i covers a range of keys with i at one end, and
+ * splits it where the highest bit that differs in the range changes.  Inner nodes are numbered 0 to n - 2 and
+ * leaves follow them, so the root is the first node. */
+static void findRadixChildren(const std::vector<BVHMortonKey>& keys, int i, int& left, int& right)
+{
+    int n = (int)keys.size();
+
+    // the range runs toward the neighbour that shares more of its prefix.
+    int direction = commonPrefix(keys, i, i + 1) > commonPrefix(keys, i, i - 1) ? 1 : -1;
+    int minPrefix = commonPrefix(keys, i, i - direction);
+
+    // find the other end of the range, which shares more than minPrefix with i, by doubling then bisecting.
+    int maxLength = 2;
+    while (commonPrefix(keys, i, i + maxLength * direction) > minPrefix) maxLength *= 2;
+    int length = 0;
+    for (int step = maxLength / 2; step >= 1; step /= 2) {
+        if (commonPrefix(keys, i, i + (length + step) * direction) > minPrefix) length += step;
+    }
+    int j = i + length * direction;
+
+    // the split is the last key sharing more than the whole ranges prefix with i.
+    int nodePrefix = commonPrefix(keys, i, j);
+    int split = 0;
+    int step = length;
+    while (step > 1) {
+        step = (step + 1) / 2;
+        if (commonPrefix(keys, i, i + (split + step) * direction) > nodePrefix) split += step;
+    }
+    int gamma = i + split * direction + std::min(direction, 0);
+
+    left = (std::min(i, j) == gamma) ? (n - 1) + gamma : gamma;
+    right = (std::max(i, j) == gamma + 1) ? (n - 1) + gamma + 1 : gamma + 1;
+}
+
+/** Returns the index of the only bit set in bit. */
+static inline int getBitIndex(int bit)
+{
+    int index = 0;
+    while (bit > 1) {
+        bit >>= 1;
+        index++;
+    }
+    return index;
+}
+
+/** Rearranges the treelet below root, made by opening up to BVH_TREELET_LEAVES of its largest descendants, into the
+ * layout with the least surface area heuristic cost (Karras and Aila, "Fast Parallel Construction of High-Quality
+ * Bounding Volume Hierarchies").  The subtrees below the treelet are left as they are.  cost holds each node's
+ * cost, and is kept up to date. */
+static void optimizeTreelet(std::vector<BVHBuildNode>& nodes, std::vector<float>& cost, int root)
+{
+    int leaves[BVH_TREELET_LEAVES];
+    int inner[BVH_TREELET_LEAVES];
+    int leafCount = 0;
+    int innerCount = 0;
+    inner[innerCount++] = root;
+    leaves[leafCount++] = nodes[root].left;
+    leaves[leafCount++] = nodes[root].right;
+    while (leafCount < BVH_TREELET_LEAVES) {
+        int largest = -1;
+        float largestArea = -1;
+        for (int i = 0; i < leafCount; i++) {
+            const BVHBuildNode& node = nodes[leaves[i]];
+            float area = surfaceArea(node.boundsMin, node.boundsMax);
+            if (node.left >= 0 && area > largestArea) {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest < 0) break;
+        int open = leaves[largest];
+        inner[innerCount++] = open;
+        leaves[largest] = nodes[open].left;
+        leaves[leafCount++] = nodes[open].right;
+    }
+    if (leafCount < 3) return;
+
+    // the best cost of a node over each subset of the leaves, found from the smaller subsets first.  Subsets are
+    // bitmasks of the leaves, and a subsets best split is the part holding its lowest leaf.
+    const int SUBSETS = 1 << BVH_TREELET_LEAVES;
+    glm::vec3 boundsMin[SUBSETS];
+    glm::vec3 boundsMax[SUBSETS];
+    float best[SUBSETS];
+    int bestPart[SUBSETS];
+    int all = (1 << leafCount) - 1;
+    for (int subset = 1; subset <= all; subset++) {
+        int lowest = subset & -subset;
+        int rest = subset ^ lowest;
+        if (!rest) {
+            int leaf = leaves[getBitIndex(lowest)];
+            boundsMin[subset] = nodes[leaf].boundsMin;
+            boundsMax[subset] = nodes[leaf].boundsMax;
+            best[subset] = cost[leaf];
+            continue;
+        }
+        boundsMin[subset] = glm::min(boundsMin[lowest], boundsMin[rest]);
+        boundsMax[subset] = glm::max(boundsMax[lowest], boundsMax[rest]);
+        best[subset] = INFINITY;
+        for (int part = rest; ; part = (part - 1) & rest) {
+            int left = part | lowest;
+            int right = subset ^ left;
+            if (right && best[left] + best[right] < best[subset]) {
+                best[subset] = best[left] + best[right];
+                bestPart[subset] = left;
+            }
+            if (part == 0) break;
+        }
+        best[subset] += BVH_SAH_NODE_COST * surfaceArea(boundsMin[subset], boundsMax[subset]);
+    }
+    if (best[all] >= cost[root]) return;
+
+    // lay the treelet out again from the best splits, reusing its inner nodes.
+    int nextInner = 1;
+    int pending[BVH_TREELET_LEAVES][2];
+    int pendingCount = 0;
+    pending[pendingCount][0] = root;
+    pending[pendingCount++][1] = all;
+    while (pendingCount > 0) {
+        pendingCount--;
+        int index = pending[pendingCount][0];
+        int subset = pending[pendingCount][1];
+        int parts[2] = {bestPart[subset], subset ^ bestPart[subset]};
+        int children[2];
+        for (int i = 0; i < 2; i++) {
+            if (!(parts[i] & (parts[i] - 1))) {
+                children[i] = leaves[getBitIndex(parts[i])];
+            } else {
+                children[i] = inner[nextInner++];
+                pending[pendingCount][0] = children[i];
+                pending[pendingCount++][1] = parts[i];
+            }
+        }
+        nodes[index].left = children[0];
+        nodes[index].right = children[1];
+        nodes[index].boundsMin = boundsMin[subset];
+        nodes[index].boundsMax = boundsMax[subset];
+        cost[index] = best[subset];
+    }
+}
+
+/** Builds the binary tree over objects into nodes as a linear BVH, with the root first, reordering objects along
+ * the Morton curve through their centers.  Every step runs on the thread pool. */
+static void buildLinearTree(std::vector<BVHObject>& objects, std::vector<BVHBuildNode>& nodes, bool treelets)
+{
+    int n = (int)objects.size();
+    BVHBuildRange range = getBuildRange(objects, 0, n);
+    glm::vec3 extent = range.centerMax - range.centerMin;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0 ? 1.0f / extent[axis] : 0;
+    }
+
+    // short codes sort in half the passes, but leave too many objects of larger containers sharing a code.
+    bool longCodes = n >= BVH_LONG_MORTON_OBJECTS;
+    std::vector<BVHMortonKey> keys(n);
+    ThreadPool::global().parallelFor(n, BVH_SORT_CHUNK_KEYS, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            glm::vec3 center = (objects[i].boundsMin + objects[i].boundsMax) * 0.5f;
+            glm::vec3 p = (center - range.centerMin) * scale;
+            keys[i] = std::make_pair(longCodes ? mortonCode64(p) : (uint64_t)mortonCode(p), i);
+        }
+    });
+    sortMortonKeys(keys, longCodes ? 63 : 30);
+
+    std::vector<BVHObject> sorted(n);
+    for (int i = 0; i < n; i++) {
+        sorted[i] = objects[keys[i].second];
+    }
+    objects.swap(sorted);
+
+    nodes.resize(2 * n - 1);
+    std::vector<int> parents(2 * n - 1, -1);
+    for (int i = 0; i < n; i++) {
+        BVHBuildNode& leaf = nodes[(n - 1) + i];
+        leaf.boundsMin = objects[i].boundsMin;
+        leaf.boundsMax = objects[i].boundsMax;
+        leaf.first = i;
+        leaf.count = 1;
+    }
+    ThreadPool::global().parallelFor(n - 1, BVH_SORT_CHUNK_KEYS, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            findRadixChildren(keys, i, nodes[i].left, nodes[i].right);
+            parents[nodes[i].left] = i;
+            parents[nodes[i].right] = i;
+        }
+    });
+
+    // bounds go up the tree from each leaf, with the second child to finish carrying on to the parent, which then
+    // has both children done.  Treelets are rearranged on the way, below any node they are rooted at.
+    std::vector<float> cost(2 * n - 1);
+    std::unique_ptr<std::atomic<int>[]> arrivals(new std::atomic<int>[std::max(n - 1, 1)]);
+    for (int i = 0; i < n - 1; i++) {
+        arrivals[i] = 0;
+    }
+    ThreadPool::global().parallelFor(n, BVH_SORT_CHUNK_KEYS, [&](int start, int end) {
+        for (int i = start; i < end; i++) {
+            int node = (n - 1) + i;
+            cost[node] = surfaceArea(nodes[node].boundsMin, nodes[node].boundsMax);
+            for (int parent = parents[node]; parent >= 0; parent = parents[parent]) {
+                if (arrivals[parent].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+                BVHBuildNode& inner = nodes[parent];
+                inner.boundsMin = glm::min(nodes[inner.left].boundsMin, nodes[inner.right].boundsMin);
+                inner.boundsMax = glm::max(nodes[inner.left].boundsMax, nodes[inner.right].boundsMax);
+                cost[parent] = BVH_SAH_NODE_COST * surfaceArea(inner.boundsMin, inner.boundsMax) +
+                    cost[inner.left] + cost[inner.right];
+                if (treelets) optimizeTreelet(nodes, cost, parent);
+            }
+        }
+    });
+}
+
+/** Creates a wide node from the binary node root and the nodes below it, returns the wide nodes index. */
+template <int N>
+static int collapseNode(const std::vector<BVHBuildNode>& binary, int root, std::vector<BVHNode<N>>& nodes)
+{
+    // start with the binary nodes two children, then keep replacing the inner child with the largest surface area
+    // (the one most likely to be hit) by its own two children until the node is full.
+    std::vector<int> slots;
+    if (binary[root].left < 0) {
+        slots.push_back(root);
+    } else {
+        slots.push_back(binary[root].left);
+        slots.push_back(binary[root].right);
+    }
+    while ((int)slots.size() < N) {
+        int largest = -1;
+        float largestArea = -1;
+        for (int i = 0; i < (int)slots.size(); i++) {
+            const BVHBuildNode& node = binary[slots[i]];
+            float area = surfaceArea(node.boundsMin, node.boundsMax);
+            if (node.left >= 0 && area > largestArea) {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest < 0) break;
+        int open = slots[largest];
+        slots[largest] = binary[open].left;
+        slots.push_back(binary[open].right);
+    }
+
+    int index = (int)nodes.size();
+    nodes.push_back(BVHNode<N>());
+    memset(&nodes[index], 0, sizeof(BVHNode<N>));
+    nodes[index].children = (int)slots.size();
+
+    for (int i = 0; i < (int)slots.size(); i++) {
+        const BVHBuildNode& node = binary[slots[i]];
+        // padded a little so rays still hit flat boxes, such as those around axis aligned triangles.
+        for (int axis = 0; axis < 3; axis++) {
+            nodes[index].boundsMin[axis][i] = node.boundsMin[axis] - EPSILON;
+            nodes[index].boundsMax[axis][i] = node.boundsMax[axis] + EPSILON;
+        }
+        if (node.left < 0) {
+            nodes[index].child[i] = node.first;
+            nodes[index].count[i] = node.count;
+        } else {
+            // nodes may move as children are added, so index rather than holding a reference.
+            int child = collapseNode(binary, slots[i], nodes);
+            nodes[index].child[i] = child;
+            nodes[index].count[i] = 0;
+        }
+    }
+    return index;
+}
+
+template <int N, typename Q>
+void WideBVH::quantizeNodes(const std::vector<BVHNode<N>>& full, std::vector<BVHQuantizedNode<N, Q>>& nodes)
+{
+    // each node claims slots for all its inner children at once so they are next to each other, then they are
+    // filled in from the stack of nodes waiting to be converted.  Leaf objects are moved together in the same way.
+    std::vector<BVHObject> leafObjects;
+    leafObjects.reserve(objects.size());
+    nodes.reserve(full.size());
+    nodes.resize(1);
+
+    std::vector<std::pair<int, int>> pending;
+    pending.push_back(std::make_pair(0, 0));
+    while (!pending.empty()) {
+        int source = pending.back().first;
+        int target = pending.back().second;
+        pending.pop_back();
+
+        const BVHNode<N>& node = full[source];
+        BVHQuantizedNode<N, Q> quantized;
+        quantizeBVHNode(quantized, node.boundsMin, node.boundsMax, node.children);
+        quantized.firstChild = (int)nodes.size();
+        quantized.firstObject = (int)leafObjects.size();
+        for (int lane = 0; lane < node.children; lane++) {
+            quantized.count[lane] = (uint8_t)node.count[lane];
+            if (node.count[lane] > 0) {
+                for (int i = node.child[lane]; i < node.child[lane] + node.count[lane]; i++) {
+                    leafObjects.push_back(objects[i]);
+                }
+            } else {
+                pending.push_back(std::make_pair(node.child[lane], (int)nodes.size()));
+                nodes.push_back(BVHQuantizedNode<N, Q>());
+            }
+        }
+        nodes[target] = quantized;
+    }
+    objects.swap(leafObjects);
+}
+
+WideBVH::WideBVH(std::vector<BVHObject>& objects, int width, int bits, BVHBuilder builder)
+{
+    TRACE_ZONE("build bvh");
+
+    this->width = width;
+    this->bits = bits;
+    for (int i = 0; i < (int)objects.size(); i++) {
+        BVHObject object = objects[i];
+        object.index = i;
+        if (!object.object->getBounds(object.boundsMin, object.boundsMax)) {
+            unbounded.push_back(object);
+            continue;
+        }
+        object.boundsMin += object.offset;
+        object.boundsMax += object.offset;
+        this->objects.push_back(object);
+    }
+
+    if (this->objects.empty()) return;
+
+    std::vector<BVHBuildNode> binary;
+    binary.reserve(this->objects.size() * 2);
+    if (builder == BVH_BUILD_SAH) {
+        buildBinaryTree(this->objects, binary);
+    } else {
+        buildLinearTree(this->objects, binary, builder == BVH_BUILD_LINEAR_TREELETS);
+    }
+
+    if (width == 4) {
+        collapseNode(binary, 0, nodes4);
+    } else {
+        collapseNode(binary, 0, nodes8);
+    }
+
+    // quantized nodes are made from the full ones, which are then freed.
+    if (bits == 8 && width == 4) {
+        quantizeNodes(nodes4, nodes4q8);
+    } else if (bits == 8) {
+        quantizeNodes(nodes8, nodes8q8);
+    } else if (bits == 16 && width == 4) {
+        quantizeNodes(nodes4, nodes4q16);
+    } else if (bits == 16) {
+        quantizeNodes(nodes8, nodes8q16);
+    }
+    if (bits) {
+        std::vector<BVHNode<4>>().swap(nodes4);
+        std::vector<BVHNode<8>>().swap(nodes8);
+    }
+}
+
+// ------------------------------------------------------------
+// Refitting
+// ------------------------------------------------------------
+
+/** Pads a box a little so rays still hit flat boxes, as collapseNode does, and stores it in lane of a nodes boxes. */
+template <int N>
+static inline void setLaneBounds(float boundsMin[3][N], float boundsMax[3][N], int lane, glm::vec3 low, glm::vec3 high)
+{
+    for (int axis = 0; axis < 3; axis++) {
+        boundsMin[axis][lane] = low[axis] - EPSILON;
+        boundsMax[axis][lane] = high[axis] + EPSILON;
+    }
+}
+
+template <int N>
+void WideBVH::refitNodes(std::vector<BVHNode<N>>& nodes)
+{
+    // children are always stored after their parents, so going backwards each nodes children are done before it.
+    // The box around each node is kept unpadded, so the padding does not grow with the depth of the tree.
+    std::vector<glm::vec3> nodeMin(nodes.size());
+    std::vector<glm::vec3> nodeMax(nodes.size());
+    for (int index = (int)nodes.size() - 1; index >= 0; index--) {
+        BVHNode<N>& node = nodes[index];
+        glm::vec3 allMin = glm::vec3(+INFINITY);
+        glm::vec3 allMax = glm::vec3(-INFINITY);
+        for (int lane = 0; lane < node.children; lane++) {
+            glm::vec3 low = glm::vec3(+INFINITY);
+            glm::vec3 high = glm::vec3(-INFINITY);
+            if (node.count[lane] > 0) {
+                for (int i = node.child[lane]; i < node.child[lane] + node.count[lane]; i++) {
+                    low = glm::min(low, objects[i].boundsMin);
+                    high = glm::max(high, objects[i].boundsMax);
+                }
+            } else {
+                low = nodeMin[node.child[lane]];
+                high = nodeMax[node.child[lane]];
+            }
+            setLaneBounds<N>(node.boundsMin, node.boundsMax, lane, low, high);
+            allMin = glm::min(allMin, low);
+            allMax = glm::max(allMax, high);
+        }
+        nodeMin[index] = allMin;
+        nodeMax[index] = allMax;
+    }
+}
+
+template <int N, typename Q>
+void WideBVH::refitNodes(std::vector<BVHQuantizedNode<N, Q>>& nodes)
+{
+    // as for full nodes, then each node is quantized again relative to its childrens new boxes.
+    std::vector<glm::vec3> nodeMin(nodes.size());
+    std::vector<glm::vec3> nodeMax(nodes.size());
+    for (int index = (int)nodes.size() - 1; index >= 0; index--) {
+        BVHQuantizedNode<N, Q>& node = nodes[index];
+        float boundsMin[3][N] = {};
+        float boundsMax[3][N] = {};
+        glm::vec3 allMin = glm::vec3(+INFINITY);
+        glm::vec3 allMax = glm::vec3(-INFINITY);
+        int nextChild = node.firstChild;
+        int nextObject = node.firstObject;
+        for (int lane = 0; lane < node.children; lane++) {
+            glm::vec3 low = glm::vec3(+INFINITY);
+            glm::vec3 high = glm::vec3(-INFINITY);
+            if (node.count[lane] > 0) {
+                for (int i = nextObject; i < nextObject + node.count[lane]; i++) {
+                    low = glm::min(low, objects[i].boundsMin);
+                    high = glm::max(high, objects[i].boundsMax);
+                }
+                nextObject += node.count[lane];
+            } else {
+                low = nodeMin[nextChild];
+                high = nodeMax[nextChild];
+                nextChild++;
+            }
+            setLaneBounds<N>(boundsMin, boundsMax, lane, low, high);
+            allMin = glm::min(allMin, low);
+            allMax = glm::max(allMax, high);
+        }
+        nodeMin[index] = allMin;
+        nodeMax[index] = allMax;
+
+        // quantizing resets the whole node, so the links to the children are put back afterwards.
+        int firstChild = node.firstChild;
+        int firstObject = node.firstObject;
+        uint8_t count[N];
+        memcpy(count, node.count, sizeof(count));
+        quantizeBVHNode(node, boundsMin, boundsMax, node.children);
+        node.firstChild = firstChild;
+        node.firstObject = firstObject;
+        memcpy(node.count, count, sizeof(count));
+    }
+}
+
+bool WideBVH::refit(const std::vector<BVHObject>& objects)
+{
+    TRACE_ZONE("refit bvh");
+
+    if (objects.size() != this->objects.size() + unbounded.size()) return false;
+
+    // the new bounds are all found before anything is changed, so that a failed refit leaves the hierarchy intact.
+    std::vector<BVHObject> refitted(this->objects.size());
+    for (int i = 0; i < (int)this->objects.size(); i++) {
+        const BVHObject& object = objects[this->objects[i].index];
+        if (object.object != this->objects[i].object) return false;
+        refitted[i] = object;
+        refitted[i].index = this->objects[i].index;
+        if (!object.object->getBounds(refitted[i].boundsMin, refitted[i].boundsMax)) return false;
+        refitted[i].boundsMin += object.offset;
+        refitted[i].boundsMax += object.offset;
+    }
+    for (int i = 0; i < (int)unbounded.size(); i++) {
+        const BVHObject& object = objects[unbounded[i].index];
+        glm::vec3 boundsMin, boundsMax;
+        if (object.object != unbounded[i].object || object.object->getBounds(boundsMin, boundsMax)) return false;
+    }
+
+    this->objects.swap(refitted);
+    for (int i = 0; i < (int)unbounded.size(); i++) {
+        unbounded[i].offset = objects[unbounded[i].index].offset;
+    }
+
+    if (this->objects.empty()) return true;
+    if (!nodes4.empty()) refitNodes(nodes4);
+    if (!nodes8.empty()) refitNodes(nodes8);
+    if (!nodes4q8.empty()) refitNodes(nodes4q8);
+    if (!nodes8q8.empty()) refitNodes(nodes8q8);
+    if (!nodes4q16.empty()) refitNodes(nodes4q16);
+    if (!nodes8q16.empty()) refitNodes(nodes8q16);
+    return true;
+}
+
+int WideBVH::getNodeCount()
+{
+    return (int)(nodes4.size() + nodes8.size() + nodes4q8.size() + nodes8q8.size() + nodes4q16.size() +
+        nodes8q16.size());
+}
+
+size_t WideBVH::getNodeBytes()
+{
+    return nodes4.size() * sizeof(nodes4[0]) + nodes8.size() * sizeof(nodes8[0]) +
+        nodes4q8.size() * sizeof(nodes4q8[0]) + nodes8q8.size() * sizeof(nodes8q8[0]) +
+        nodes4q16.size() * sizeof(nodes4q16[0]) + nodes8q16.size() * sizeof(nodes8q16[0]);
+}
+
+// ------------------------------------------------------------
+// Traversal
+// ------------------------------------------------------------
+
+/** Intersects ray with object, which is offset from the rays space. */
+static inline bool intersectBVHObject(const BVHObject& object, Ray* ray)
+{
+    if (ray->shadowTrace && !object.object->castsShadows) return false;
+
+    ray->pos -= object.offset;
+    bool didCollide = object.object->intersect(ray);
+    ray->pos += object.offset;
+    if (didCollide) ray->collision.location += object.offset;
+    return didCollide;
+}
+
+/** Intersects the rays of packet selected by mask with object, returns a mask of the rays that hit it. */
+static inline int intersectBVHObjectPacket(const BVHObject& object, RayPacket& packet, int mask)
+{
+    for (int i = 0; i < packet.count; i++) {
+        if (packet.rays[i]->shadowTrace && !object.object->castsShadows) mask &= ~(1 << i);
+    }
+    if (!mask) return 0;
+
+    for (int i = 0; i < packet.count; i++) {
+        if (mask & (1 << i)) packet.rays[i]->pos -= object.offset;
+    }
+    int hits = object.object->intersectPacket(packet, mask);
+    for (int i = 0; i < packet.count; i++) {
+        if (!(mask & (1 << i))) continue;
+        packet.rays[i]->pos += object.offset;
+        if (hits & (1 << i)) packet.rays[i]->collision.location += object.offset;
+    }
+    return hits;
+}
+
+static inline BVHRay getBVHRay(const Ray* ray)
+{
+    BVHRay bvhRay;
+    for (int axis = 0; axis < 3; axis++) {
+        bvhRay.origin[axis] = ray->pos[axis];
+        // zero components are nudged so the slab distances stay finite.
+        float d = ray->dir[axis];
+        bvhRay.invDir[axis] = 1.0f / (fabs(d) > 1e-20f ? d : (d < 0 ? -1e-20f : 1e-20f));
+    }
+    bvhRay.length = ray->length;
+    return bvhRay;
+}
+
+/** Sets child to the index of each child of node, which is a node for inner children and the first object for
+ * leaves. */
+template <int N>
+static inline void getChildIndices(const BVHNode<N>& node, int* child)
+{
+    for (int lane = 0; lane < node.children; lane++) {
+        child[lane] = node.child[lane];
+    }
+}
+
+template <int N, typename Q>
+static inline void getChildIndices(const BVHQuantizedNode<N, Q>& node, int* child)
+{
+    int nextChild = node.firstChild;
+    int nextObject = node.firstObject;
+    for (int lane = 0; lane < node.children; lane++) {
+        if (node.count[lane] > 0) {
+            child[lane] = nextObject;
+            nextObject += node.count[lane];
+        } else {
+            child[lane] = nextChild++;
+        }
+    }
+}
+
+static inline int countBits(int mask)
+{
+    int count = 0;
+    for (; mask; mask &= mask - 1) count++;
+    return count;
+}
+
+template <typename Node>
+bool WideBVH::intersectNodes(const std::vector<Node>& nodes, BVHNodeTest<Node> test, Ray* ray, int root, int rootCount)
+{
+    const int N = Node::WIDTH;
+    BVHRay bvhRay = getBVHRay(ray);
+
+    struct StackEntry
+    {
+        int child;
+        int count;
+        float t;
+    };
+    StackEntry stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = {root, rootCount, 0};
+
+    bool didCollide = false;
+    while (top > 0) {
+        StackEntry entry = stack[--top];
+
+        // something nearer has been hit since this was pushed.
+        if (entry.t > ray->length) continue;
+
+        if (entry.count > 0) {
+            for (int i = entry.child; i < entry.child + entry.count; i++) {
+                didCollide |= intersectBVHObject(objects[i], ray);
+            }
+            continue;
+        }
+
+        const Node& node = nodes[entry.child];
+        bvhRay.length = ray->length;
+        float tNear[N];
+        int hits = test(node, bvhRay, tNear) & ((1 << node.children) - 1);
+        RAY_COUNT_TESTS(ray, boundsTests, node.children);
+
+        // sort the children hit from furthest to nearest, so the nearest is on top of the stack.
+        int order[N];
+        int count = 0;
+        for (int i = 0; i < node.children; i++) {
+            if (!(hits & (1 << i))) continue;
+            int j = count++;
+            while (j > 0 && tNear[order[j-1]] < tNear[i]) {
+                order[j] = order[j-1];
+                j--;
+            }
+            order[j] = i;
+        }
+        int child[N];
+        getChildIndices(node, child);
+        for (int i = 0; i < count; i++) {
+            int lane = order[i];
+            stack[top++] = {child[lane], node.count[lane], tNear[lane]};
+        }
+    }
+    return didCollide;
+}
+
+/** Conservatively tests a packet against the boxes of a nodes children, returning a bitmask of the children any of
+ * its rays may hit, with the nearest distance any of them could hit each at in tNear.  The rays must all head the
+ * same way along each axis, so that they enter each slab through the same plane. */
+template <int N>
+static int testBoxesPacket(const float boundsMin[3][N], const float boundsMax[3][N], const BVHPacketBounds& bounds,
+    float* tNear)
+{
+    float tMin[N];
+    float tMax[N];
+    for (int i = 0; i < N; i++) {
+        tMin[i] = 0;
+        tMax[i] = bounds.length;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        bool positive = bounds.invDirMin[axis] > 0;
+        const float* nearPlane = positive ? boundsMin[axis] : boundsMax[axis];
+        const float* farPlane = positive ? boundsMax[axis] : boundsMin[axis];
+        // the ray whose origin is furthest from a plane reaches it soonest or latest, depending on the side.
+        float nearOrigin = positive ? bounds.originMax[axis] : bounds.originMin[axis];
+        float farOrigin = positive ? bounds.originMin[axis] : bounds.originMax[axis];
+        float invMin = bounds.invDirMin[axis];
+        float invMax = bounds.invDirMax[axis];
+        for (int i = 0; i < N; i++) {
+            float dNear = nearPlane[i] - nearOrigin;
+            float dFar = farPlane[i] - farOrigin;
+            tMin[i] = std::max(tMin[i], std::min(dNear * invMin, dNear * invMax));
+            tMax[i] = std::min(tMax[i], std::max(dFar * invMin, dFar * invMax));
+        }
+    }
+    int hits = 0;
+    for (int i = 0; i < N; i++) {
+        tNear[i] = tMin[i];
+        if (tMin[i] <= tMax[i]) hits |= 1 << i;
+    }
+    return hits;
+}
+
+template <int N>
+static inline int testNodePacket(const BVHNode<N>& node, const BVHPacketBounds& bounds, float* tNear)
+{
+    return testBoxesPacket<N>(node.boundsMin, node.boundsMax, bounds, tNear);
+}
+
+template <int N, typename Q>
+static inline int testNodePacket(const BVHQuantizedNode<N, Q>& node, const BVHPacketBounds& bounds, float* tNear)
+{
+    float boundsMin[3][N];
+    float boundsMax[3][N];
+    decodeBVHNode(node, boundsMin, boundsMax);
+    return testBoxesPacket<N>(boundsMin, boundsMax, bounds, tNear);
+}
+
+template <typename Node>
+int WideBVH::intersectNodesPacket(const std::vector<Node>& nodes, BVHNodeTest<Node> test, RayPacket& packet, int mask)
+{
+    const int N = Node::WIDTH;
+    BVHRay bvhRays[RAY_PACKET_SIZE];
+    BVHPacketBounds bounds;
+    for (int axis = 0; axis < 3; axis++) {
+        bounds.originMin[axis] = bounds.invDirMin[axis] = FLT_MAX;
+        bounds.originMax[axis] = bounds.invDirMax[axis] = -FLT_MAX;
+    }
+    for (int i = 0; i < packet.count; i++) {
+        if (!(mask & (1 << i))) continue;
+        bvhRays[i] = getBVHRay(packet.rays[i]);
+        for (int axis = 0; axis < 3; axis++) {
+            bounds.originMin[axis] = std::min(bounds.originMin[axis], bvhRays[i].origin[axis]);
+            bounds.originMax[axis] = std::max(bounds.originMax[axis], bvhRays[i].origin[axis]);
+            bounds.invDirMin[axis] = std::min(bounds.invDirMin[axis], bvhRays[i].invDir[axis]);
+            bounds.invDirMax[axis] = std::max(bounds.invDirMax[axis], bvhRays[i].invDir[axis]);
+        }
+    }
+
+    // rays heading different ways along an axis can not share box tests, so are traced one at a time.
+    for (int axis = 0; axis < 3; axis++) {
+        if (bounds.invDirMin[axis] < 0 && bounds.invDirMax[axis] > 0) {
+            int hits = 0;
+            for (int i = 0; i < packet.count; i++) {
+                if ((mask & (1 << i)) && intersectNodes(nodes, test, packet.rays[i], 0, 0)) hits |= 1 << i;
+            }
+            return hits;
+        }
+    }
+
+    // as intersectNodes, but each entry has the rays that may hit it.
+    struct PacketStackEntry
+    {
+        int child;
+        int count;
+        int mask;
+        float t;
+    };
+    PacketStackEntry stack[BVH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = {0, 0, mask, 0};
+
+    int hits = 0;
+    while (top > 0) {
+        PacketStackEntry entry = stack[--top];
+
+        // drop the rays that have hit something nearer since this was pushed.
+        int active = entry.mask;
+        bounds.length = 0;
+        for (int i = 0; i < packet.count; i++) {
+            if (!(active & (1 << i))) continue;
+            if (entry.t > packet.rays[i]->length) {
+                active &= ~(1 << i);
+            } else {
+                bounds.length = std::max(bounds.length, packet.rays[i]->length);
+            }
+        }
+        if (!active) continue;
+
+        // the packet has diverged, so the few rays left are better off visiting this subtree nearest first on their
+        // own.
+        if (countBits(active) < BVH_PACKET_MIN_RAYS) {
+            for (int i = 0; i < packet.count; i++) {
+                if ((active & (1 << i)) && intersectNodes(nodes, test, packet.rays[i], entry.child, entry.count)) {
+                    hits |= 1 << i;
+                }
+            }
+            continue;
+        }
+
+        if (entry.count > 0) {
+            for (int i = entry.child; i < entry.child + entry.count; i++) {
+                hits |= intersectBVHObjectPacket(objects[i], packet, active);
+            }
+            continue;
+        }
+
+        // one test for the whole packet finds the children worth visiting.  The rays go on together to inner nodes,
+        // which test them again, but leaves are only entered by the rays that really hit them, as testing objects
+        // costs more than testing boxes.
+        const Node& node = nodes[entry.child];
+        float tNear[N];
+        int children = testNodePacket(node, bounds, tNear) & ((1 << node.children) - 1);
+        int leaves = 0;
+        int childMask[N];
+        for (int lane = 0; lane < node.children; lane++) {
+            childMask[lane] = active;
+            if ((children & (1 << lane)) && node.count[lane] > 0) leaves |= 1 << lane;
+        }
+        if (leaves) {
+            for (int lane = 0; lane < node.children; lane++) {
+                if (leaves & (1 << lane)) childMask[lane] = 0;
+            }
+            for (int i = 0; i < packet.count; i++) {
+                if (!(active & (1 << i))) continue;
+                bvhRays[i].length = packet.rays[i]->length;
+                float rayNear[N];
+                int rayHits = test(node, bvhRays[i], rayNear) & leaves;
+                for (int lane = 0; lane < node.children; lane++) {
+                    if (rayHits & (1 << lane)) childMask[lane] |= 1 << i;
+                }
+            }
+        }
+#ifdef RAY_COST
+        for (int i = 0; i < packet.count; i++) {
+            if (active & (1 << i)) RAY_COUNT_TESTS(packet.rays[i], boundsTests, node.children);
+        }
+#endif
+
+        // sort the children hit from furthest to nearest, so the nearest is on top of the stack.
+        int order[N];
+        int count = 0;
+        for (int lane = 0; lane < node.children; lane++) {
+            if (!(children & (1 << lane)) || !childMask[lane]) continue;
+            int j = count++;
+            while (j > 0 && tNear[order[j-1]] < tNear[lane]) {
+                order[j] = order[j-1];
+                j--;
+            }
+            order[j] = lane;
+        }
+        int child[N];
+        getChildIndices(node, child);
+        for (int i = 0; i < count; i++) {
+            int lane = order[i];
+            stack[top++] = {child[lane], node.count[lane], childMask[lane], tNear[lane]};
+        }
+    }
+    return hits;
+}
+
+bool WideBVH::intersect(Ray* ray)
+{
+    // unbounded objects go first, as a hit on them lets the hierarchy skip everything further away.
+    bool didCollide = false;
+    for (int i = 0; i < (int)unbounded.size(); i++) {
+        didCollide |= intersectBVHObject(unbounded[i], ray);
+    }
+
+    if (!nodes8.empty()) {
+        didCollide |= intersectNodes(nodes8, nodeTest8, ray, 0, 0);
+    } else if (!nodes4.empty()) {
+        didCollide |= intersectNodes(nodes4, nodeTest4, ray, 0, 0);
+    } else if (!nodes8q8.empty()) {
+        didCollide |= intersectNodes(nodes8q8, nodeTest8q8, ray, 0, 0);
+    } else if (!nodes4q8.empty()) {
+        didCollide |= intersectNodes(nodes4q8, nodeTest4q8, ray, 0, 0);
+    } else if (!nodes8q16.empty()) {
+        didCollide |= intersectNodes(nodes8q16, nodeTest8q16, ray, 0, 0);
+    } else if (!nodes4q16.empty()) {
+        didCollide |= intersectNodes(nodes4q16, nodeTest4q16, ray, 0, 0);
+    }
+    return didCollide;
+}
+
+int WideBVH::intersectPacket(RayPacket& packet, int mask)
+{
+    int hits = 0;
+    for (int i = 0; i < (int)unbounded.size(); i++) {
+        hits |= intersectBVHObjectPacket(unbounded[i], packet, mask);
+    }
+
+    if (!nodes8.empty()) {
+        hits |= intersectNodesPacket(nodes8, nodeTest8, packet, mask);
+    } else if (!nodes4.empty()) {
+        hits |= intersectNodesPacket(nodes4, nodeTest4, packet, mask);
+    } else if (!nodes8q8.empty()) {
+        hits |= intersectNodesPacket(nodes8q8, nodeTest8q8, packet, mask);
+    } else if (!nodes4q8.empty()) {
+        hits |= intersectNodesPacket(nodes4q8, nodeTest4q8, packet, mask);
+    } else if (!nodes8q16.empty()) {
+        hits |= intersectNodesPacket(nodes8q16, nodeTest8q16, packet, mask);
+    } else if (!nodes4q16.empty()) {
+        hits |= intersectNodesPacket(nodes4q16, nodeTest4q16, packet, mask);
+    }
+    return hits;
+}
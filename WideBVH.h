@@ -0,0 +1,216 @@
+/**
+ * Wide bounding volume hierarchy.
+ *
+ * An alternative to the bounding sphere hierarchy for finding which of a containers objects a ray may hit.  Objects
+ * are first built into a binary tree of axis aligned boxes, which is then collapsed so that each node has up to 4
+ * (BVH4) or 8 (BVH8) children.  A node stores its childrens boxes as structure of arrays, so a single run of SSE or
+ * AVX instructions tests the ray against all of them, and the children that are hit are visited nearest first so
+ * they can be skipped once something closer has been found.
+ *
+ * For scenes too large for full nodes to fit in memory (or cache) the boxes can instead be quantized to 8 or 16 bits
+ * each, relative to the box around all of a nodes children, with compact child indices.  An 8 bit BVH8 node takes 80
+ * bytes rather than 260, and the boxes are rounded outwards so rays still find everything they would have.
+ */
+
+#pragma once
+
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "SceneObject.h"
+
+/** An object in the hierarchy. */
+struct BVHObject
+{
+    SceneObject* object;
+
+    // translation from the containers space to the objects parent space, for objects taken from nested containers.
+    glm::vec3 offset;
+
+    // bounds in the containers space.
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+
+    // position in the list the hierarchy was built from, so that refitting can find the objects new bounds.
+    int index;
+};
+
+template <int N>
+struct BVHNode
+{
+    static const int WIDTH = N;
+
+    float boundsMin[3][N];
+    float boundsMax[3][N];
+
+    // index of the child node, or for leaves the index of their first object.
+    int child[N];
+
+    // number of objects in each leaf, 0 for inner nodes.
+    int count[N];
+
+    // number of children in use, always the first ones.
+    int children;
+};
+
+/** A node whose children's boxes are stored in Q (uint8_t or uint16_t) sized steps. */
+template <int N, typename Q>
+struct BVHQuantizedNode
+{
+    static const int WIDTH = N;
+
+    // a box is origin + bounds * 2^exponent along each axis.
+    float origin[3];
+    int8_t exponent[3];
+
+    // number of children in use, always the first ones.
+    uint8_t children;
+
+    Q boundsMin[3][N];
+    Q boundsMax[3][N];
+
+    // inner children are stored one after another from firstChild, and the objects of the leaf children one after
+    // another from firstObject, both in the order of the children.
+    int firstChild;
+    int firstObject;
+
+    // number of objects in each leaf, 0 for inner nodes.
+    uint8_t count[N];
+};
+
+/** A ray prepared for testing against node boxes. */
+struct BVHRay
+{
+    float origin[3];
+    float invDir[3];
+    float length;
+};
+
+/** Bounds on the rays of a packet. */
+struct BVHPacketBounds
+{
+    float originMin[3];
+    float originMax[3];
+    float invDirMin[3];
+    float invDirMax[3];
+    float length;
+};
+
+/** Tests ray against the boxes of a nodes children.  Returns a bitmask of the children hit, with the distance to
+ * each in tNear. */
+template <typename Node>
+using BVHNodeTest = int (*)(const Node& node, const BVHRay& ray, float* tNear);
+
+template <typename Node>
+struct BVHNodeTestInfo
+{
+    const char* name;
+
+    // if the CPU can run this test.
+    bool supported;
+
+    BVHNodeTest<Node> test;
+};
+
+/** Returns the tests built into this program for a type of node, narrowest first, including those the CPU can not
+ * run.  Defined for BVHNode<4>, BVHNode<8>, and BVHQuantizedNode of either width with uint8_t or uint16_t. */
+template <typename Node>
+const std::vector<BVHNodeTestInfo<Node>>& getBVHNodeTests();
+
+/** Sets node to quantized versions of the boxes, each of which is rounded outwards. */
+template <int N, typename Q>
+void quantizeBVHNode(BVHQuantizedNode<N, Q>& node, const float boundsMin[3][N], const float boundsMax[3][N],
+    int children);
+
+/** How the binary tree that a hierarchy is collapsed from is built. */
+enum BVHBuilder
+{
+    // top down, splitting each node where the surface area heuristic finds best.  Slowest to build, fastest to trace.
+    BVH_BUILD_SAH,
+    // sorts the objects along a Morton curve and emits the tree straight from the sorted codes, for geometry that is
+    // rebuilt every frame.
+    BVH_BUILD_LINEAR,
+    // as BVH_BUILD_LINEAR, then improves the tree by rearranging treelets of up to 7 subtrees to the layout the
+    // surface area heuristic finds best.
+    BVH_BUILD_LINEAR_TREELETS
+};
+
+/** Returns the name used for an acceleration structure on the command line, for example "bvh8". */
+const char* getAccelerationName(int acceleration);
+
+/** Returns the acceleration structure with given name, or -1 if there is none. */
+int parseAcceleration(std::string name);
+
+/** Returns the number of children per node of a BVH acceleration structure, or 0 for the others. */
+int getAccelerationWidth(int acceleration);
+
+/** Returns the bits each box coordinate is quantized to in a BVH acceleration structure, or 0 if they are floats. */
+int getAccelerationBits(int acceleration);
+
+class WideBVH
+{
+protected:
+    // 4 or 8.
+    int width;
+
+    // 8 or 16 for quantized nodes, 0 for full ones.
+    int bits;
+
+    // objects in leaf order.
+    std::vector<BVHObject> objects;
+
+    // objects without bounds (such as infinite planes), which are tested by every ray.
+    std::vector<BVHObject> unbounded;
+
+    // one of these is used, depending on the width and bits.  The root is the first node.
+    std::vector<BVHNode<4>> nodes4;
+    std::vector<BVHNode<8>> nodes8;
+    std::vector<BVHQuantizedNode<4, uint8_t>> nodes4q8;
+    std::vector<BVHQuantizedNode<8, uint8_t>> nodes8q8;
+    std::vector<BVHQuantizedNode<4, uint16_t>> nodes4q16;
+    std::vector<BVHQuantizedNode<8, uint16_t>> nodes8q16;
+
+    /** Replaces nodes and the order of objects with quantized versions of the full nodes. */
+    template <int N, typename Q>
+    void quantizeNodes(const std::vector<BVHNode<N>>& full, std::vector<BVHQuantizedNode<N, Q>>& nodes);
+
+    /** Recalculates the boxes of nodes from the bounds of objects, children before their parents. */
+    template <int N>
+    void refitNodes(std::vector<BVHNode<N>>& nodes);
+
+    template <int N, typename Q>
+    void refitNodes(std::vector<BVHQuantizedNode<N, Q>>& nodes);
+
+    /** Intersects ray with the subtree at root, which is a leaf of rootCount objects or a node if rootCount is 0. */
+    template <typename Node>
+    bool intersectNodes(const std::vector<Node>& nodes, BVHNodeTest<Node> test, Ray* ray, int root, int rootCount);
+
+    template <typename Node>
+    int intersectNodesPacket(const std::vector<Node>& nodes, BVHNodeTest<Node> test, RayPacket& packet, int mask);
+
+public:
+    /** Builds a hierarchy with width (4 or 8) children per node over objects, with boxes quantized to bits (8 or
+     * 16) if it is not 0. */
+    WideBVH(std::vector<BVHObject>& objects, int width, int bits = 0, BVHBuilder builder = BVH_BUILD_SAH);
+
+    /** Intersects ray (in the containers space) with the objects, returns true if any was hit. */
+    bool intersect(Ray* ray);
+
+    /** Intersects the rays of packet selected by mask, returns a mask of the rays that hit something.  The rays
+     * visit the nodes together, testing the bounds of the packet against each node rather than every ray, until
+     * fewer than a quarter of them are left in a subtree, which they then finish one at a time. */
+    int intersectPacket(RayPacket& packet, int mask);
+
+    /** Updates the boxes after the objects have moved, keeping the tree as it was built.  objects must be the list
+     * the hierarchy was built from, with the same objects in the same order (the offsets may change).  Returns false,
+     * leaving the hierarchy unchanged, if they are not or an object has gained or lost its bounds, in which case the
+     * hierarchy needs to be built again. */
+    bool refit(const std::vector<BVHObject>& objects);
+
+    int getNodeCount();
+
+    /** Returns the memory used by the nodes, in bytes. */
+    size_t getNodeBytes();
+};
@@ -1,10 +1,4 @@
-# this script renders all the scenes.  Rendering is performed in parallel, so it will be very taxing
-# 16GB or more RAM is recommended.
+# this script renders all the scenes listed in renderAll.txt.  The jobs run in a single process which loads each
+# scene once and shares one set of threads between the jobs.
 
-./RayTracer.exe 1 &
-./RayTracer.exe 2 &
-./RayTracer.exe 3 &
-./RayTracer.exe 4 &
-./RayTracer.exe 5 &
-./RayTracer.exe 6 &
-./RayTracer.exe 7 &
\ No newline at end of file
+./RenderCLI.exe --batch renderAll.txt --jobs 2